@@ -75,6 +75,18 @@ namespace beenuked
 	    uint32_t exp_result = static_cast<uint32_t>((res_normalized * 2048.f) + 0.5);
 	    exp_table[index] = exp_result;
 	}
+
+	// Waveforms are resolved when the waveform select registers are written,
+	// so the operators only need a plain lookup here
+	for (int wave_sel = 0; wave_sel < 4; wave_sel++)
+	{
+	    for (uint32_t phase = 0; phase < 1024; phase++)
+	    {
+		bool is_negate = false;
+		uint32_t sine_result = fetch_sine_result(phase, wave_sel, is_negate);
+		wave_tables[wave_sel][phase] = (sine_result | (is_negate << 15));
+	    }
+	}
     }
 
     uint32_t YM3526::fetch_sine_result(uint32_t phase, int wave_sel, bool &is_negate)
@@ -127,15 +139,14 @@ namespace beenuked
 	return sine_result;
     }
 
-    int32_t YM3526::calc_output(int32_t phase, int32_t mod, uint32_t env, int wave_sel)
+    int32_t YM3526::calc_output(int32_t phase, int32_t mod, uint32_t env, int wave_index)
     {
 	uint32_t atten = min<uint32_t>(511, env);
 
 	uint32_t combined_phase = ((phase + mod) & 0x3FF);
 
-	bool is_negate = false;
-
-	uint32_t sine_result = fetch_sine_result(combined_phase, wave_sel, is_negate);
+	uint32_t wave_result = wave_tables[wave_index][combined_phase];
+	uint32_t sine_result = (wave_result & 0x7FFF);
 
 	uint32_t attenuation = (atten << 3);
 	uint32_t combined_atten = ((sine_result + attenuation) & 0x1FFF);
@@ -148,12 +159,15 @@ namespace beenuked
 
 	int32_t exp_output = int32_t(output_shifted);
 
-	if (is_negate)
-	{
-	    exp_output = -exp_output;
-	}
+	// Negate the output without branching
+	int32_t negate_mask = -int32_t(wave_result >> 15);
+	return ((exp_output ^ negate_mask) - negate_mask);
+    }
 
-	return exp_output;
+    void YM3526::update_waveform(opl_operator &oper)
+    {
+	// Only the OPL2 has waveform select, and only when it's been enabled
+	oper.wave_index = (is_ws_enable) ? oper.wave_sel : 0;
     }
 
     void YM3526::write_adpcm_reg(uint8_t reg, uint8_t data)
@@ -177,6 +191,7 @@ namespace beenuked
 		{
 		    delta_t_channel.is_int_keyon = false;
 		    delta_t_channel.current_addr = 0xFFFFFFFF;
+		    delta_t_channel.is_eos = false;
 
 		    if (delta_t_channel.is_exec)
 		    {
@@ -186,6 +201,7 @@ namespace beenuked
 			delta_t_channel.num_nibbles = 0;
 			delta_t_channel.reg_accum = 0;
 			delta_t_channel.is_keyon = true;
+			BEENUKED_PROFILE_KEY_ON();
 			delta_t_channel.adpcm_step = 127;
 		    }
 		}
@@ -219,18 +235,41 @@ namespace beenuked
 	    }
 	    break;
 	    case 0x0D:
-	    {
-		cout << "Writing value of " << hex << int(data) << " to Y8950 prescale LSB" << endl;
-	    }
-	    break;
 	    case 0x0E:
 	    {
-		cout << "Writing value of " << hex << int(data) << " to Y8950 prescale MSB" << endl;
+		// Y8950 prescaler (for the A/D converter, which isn't emulated)
+		BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 	    }
 	    break;
 	    case 0x0F:
 	    {
-		cout << "Writing value of " << hex << int(data) << " to Y8950 APDCM data" << endl;
+		// In memory write mode, each byte written here is stored to sample memory,
+		// until the byte at the stop address has been written
+		if (delta_t_channel.is_record && delta_t_channel.is_external && !delta_t_channel.is_eos)
+		{
+		    if (delta_t_channel.current_addr == 0xFFFFFFFF)
+		    {
+			latch_addresses();
+		    }
+
+		    writeRAM(delta_t_channel.current_addr, data);
+
+		    if (advance_delta_t_address())
+		    {
+			delta_t_channel.is_eos = true;
+
+			if (!is_eos_disabled)
+			{
+			    opl_status |= 0x90;
+			}
+		    }
+
+		    // Ready for the next byte
+		    if (!is_brdy_disabled)
+		    {
+			opl_status |= 0x88;
+		    }
+		}
 	    }
 	    break;
 	    case 0x10:
@@ -297,6 +336,11 @@ namespace beenuked
 
     uint8_t YM3526::readROM(uint32_t address)
     {
+	if (delta_mem != NULL)
+	{
+	    return (address < delta_mem_size) ? delta_mem[address] : 0;
+	}
+
 	if (inter == NULL)
 	{
 	    return 0;
@@ -305,6 +349,26 @@ namespace beenuked
 	return inter->readMemory(BeeNukedAccessType::DeltaT, address);
     }
 
+    void YM3526::writeRAM(uint32_t address, uint8_t data)
+    {
+	if (delta_mem != NULL)
+	{
+	    if ((delta_ram != NULL) && (address < delta_mem_size))
+	    {
+		delta_ram[address] = data;
+	    }
+
+	    return;
+	}
+
+	if (inter == NULL)
+	{
+	    return;
+	}
+
+	inter->writeMemory(BeeNukedAccessType::DeltaT, address, data);
+    }
+
     void YM3526::clock_delta_t()
     {
 	if (!delta_t_channel.is_exec || delta_t_channel.is_record || !delta_t_channel.is_int_keyon)
@@ -395,6 +459,14 @@ namespace beenuked
 			if (is_opl2())
 			{
 			    is_ws_enable = testbit(data, 5);
+
+			    for (auto &channel : channels)
+			    {
+				for (auto &oper : channel.opers)
+				{
+				    update_waveform(oper);
+				}
+			    }
 			}
 		    }
 		    break;
@@ -431,6 +503,8 @@ namespace beenuked
 			    is_timer2_running = testbit(data, 1);
 			    is_timer2_disabled = testbit(data, 5);
 			    is_timer1_disabled = testbit(data, 6);
+			    is_brdy_disabled = (is_y8950() && testbit(data, 3));
+			    is_eos_disabled = (is_y8950() && testbit(data, 4));
 			}
 		    }
 		    break;
@@ -458,7 +532,7 @@ namespace beenuked
 			}
 			else
 			{
-			    cout << "Unrecognized register write to register of " << hex << int(reg) << endl;
+			    BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 			}
 		    }
 		    break;
@@ -645,11 +719,6 @@ namespace beenuked
 	    case 0xE0:
 	    case 0xF0:
 	    {
-		if (!is_ws_enable)
-		{
-		    return;
-		}
-
 		int slot_num = slot_array[reg_addr];
 
 		if (slot_num < 0)
@@ -662,9 +731,10 @@ namespace beenuked
 
 		auto &ch_oper = channels[ch_num].opers[oper_num];
 		ch_oper.wave_sel = (data & 0x3);
+		update_waveform(ch_oper);
 	    }
 	    break;
-	    default: cout << "Unrecognized register write to group register of " << hex << int(reg) << endl; break;
+	    default: BEENUKED_TRACE(TraceUnhandledWrite, reg, data); break;
 	}
     }
 
@@ -710,6 +780,7 @@ namespace beenuked
 	if (!oper.is_keyon)
 	{
 	    oper.is_keyon = true;
+	    BEENUKED_PROFILE_KEY_ON();
 
 	    int att_rate = oper.attack_rate;
 	    int env_rate = 0;
@@ -968,17 +1039,18 @@ namespace beenuked
 	short_noise = ((h_bit2 != h_bit7) || (h_bit3 != c_bit5) || (c_bit3 != c_bit5));
     }
 
-    void YM3526::clock_noise(int cycle)
+    void YM3526::clock_noise()
     {
-	for (int i = 0; i < cycle; i++)
+	// The noise is only read in rhythm mode, so outside of it,
+	// both of the per-sample steps are just counted (see opl_noise.h)
+	if (!is_rhythm_enabled)
 	{
-	    if (testbit(noise_lfsr, 0))
-	    {
-		noise_lfsr ^= 0x800200;
-	    }
-
-	    noise_lfsr >>= 1;
+	    BeeNukedOPLNoise::skip(noise_cycles, 18);
+	    return;
 	}
+
+	noise_lfsr = BeeNukedOPLNoise::sync(noise_lfsr, noise_cycles);
+	noise_lfsr = BeeNukedOPLNoise::jump14(noise_lfsr);
     }
 
     void YM3526::channel_output(opl_channel &channel)
@@ -1000,11 +1072,11 @@ namespace beenuked
 	uint32_t car_env = (car_slot.tll_val + car_slot.env_output + car_am);
 
 	mod_slot.outputs[1] = mod_slot.outputs[0];
-	mod_slot.outputs[0] = calc_output(mod_slot.phase_output, feedback, mod_env, mod_slot.wave_sel);
+	mod_slot.outputs[0] = calc_output(mod_slot.phase_output, feedback, mod_env, mod_slot.wave_index);
 
 	if (channel.is_decay_algorithm)
 	{
-	    int32_t car_output = calc_output(car_slot.phase_output, 0, car_env, car_slot.wave_sel);
+	    int32_t car_output = calc_output(car_slot.phase_output, 0, car_env, car_slot.wave_index);
 	    int32_t ch_output = (mod_slot.outputs[0] >> 1);
 	    ch_output += (car_output >> 1);
 	    channel.output = clamp(ch_output, -32768, 32767);
@@ -1012,7 +1084,7 @@ namespace beenuked
 	else
 	{
 	    int32_t phase_mod = ((mod_slot.outputs[0] >> 1) & 0x3FF);
-	    int32_t ch_output = calc_output(car_slot.phase_output, phase_mod, car_env, car_slot.wave_sel);
+	    int32_t ch_output = calc_output(car_slot.phase_output, phase_mod, car_env, car_slot.wave_index);
 	    channel.output = (ch_output >> 1);
 	}
     }
@@ -1037,18 +1109,18 @@ namespace beenuked
 	uint32_t car_env = (car_slot.tll_val + car_slot.env_output + car_am);
 
 	mod_slot.outputs[1] = mod_slot.outputs[0];
-	mod_slot.outputs[0] = calc_output(mod_slot.phase_output, feedback, mod_env, mod_slot.wave_sel);
+	mod_slot.outputs[0] = calc_output(mod_slot.phase_output, feedback, mod_env, mod_slot.wave_index);
 
 	if (channel.is_decay_algorithm)
 	{
-	    int32_t car_output = calc_output(car_slot.phase_output, 0, car_env, car_slot.wave_sel);
+	    int32_t car_output = calc_output(car_slot.phase_output, 0, car_env, car_slot.wave_index);
 	    int32_t ch_output = (car_output >> 1);
 	    channel.output = clamp(ch_output, -32768, 32767);
 	}
 	else
 	{
 	    int32_t phase_mod = ((mod_slot.outputs[0] >> 1) & 0x3FF);
-	    int32_t ch_output = calc_output(car_slot.phase_output, phase_mod, car_env, car_slot.wave_sel);
+	    int32_t ch_output = calc_output(car_slot.phase_output, phase_mod, car_env, car_slot.wave_index);
 	    channel.output = (ch_output >> 1);
 	}
     }
@@ -1069,7 +1141,7 @@ namespace beenuked
 	}
 
 	uint32_t rhythm_env = (slot.env_output + slot.tll_val);
-	int32_t rhythm_output = calc_output(phase, 0, rhythm_env, slot.wave_sel);
+	int32_t rhythm_output = calc_output(phase, 0, rhythm_env, slot.wave_index);
 	slot.rhythm_output = (rhythm_output >> 1);
     }
 
@@ -1090,7 +1162,7 @@ namespace beenuked
 	}
 
 	uint32_t rhythm_env = (slot.env_output + slot.tll_val);
-	int32_t rhythm_output = calc_output(phase, 0, rhythm_env, slot.wave_sel);
+	int32_t rhythm_output = calc_output(phase, 0, rhythm_env, slot.wave_index);
 	slot.rhythm_output = (rhythm_output >> 1);
     }
 
@@ -1099,7 +1171,7 @@ namespace beenuked
 	auto &slot = channels[8].opers[0];
 
 	uint32_t rhythm_env = (slot.env_output + slot.tll_val);
-	int32_t rhythm_output = calc_output(slot.phase_output, 0, rhythm_env, slot.wave_sel);
+	int32_t rhythm_output = calc_output(slot.phase_output, 0, rhythm_env, slot.wave_index);
 	slot.rhythm_output = (rhythm_output >> 1);
     }
 
@@ -1110,7 +1182,7 @@ namespace beenuked
 	uint32_t phase = short_noise ? 0x300 : 0x100;
 
 	uint32_t rhythm_env = (slot.env_output + slot.tll_val);
-	int32_t rhythm_output = calc_output(phase, 0, rhythm_env, slot.wave_sel);
+	int32_t rhythm_output = calc_output(phase, 0, rhythm_env, slot.wave_index);
 	slot.rhythm_output = (rhythm_output >> 1);
     }
 
@@ -1141,6 +1213,7 @@ namespace beenuked
 	pm_clock = 0;
 	short_noise = false;
 	noise_lfsr = 1;
+	noise_cycles = 0;
 
 	for (int i = 0; i < 9; i++)
 	{
@@ -1155,6 +1228,7 @@ namespace beenuked
 		oper.env_output = 511;
 		oper.env_state = opl_oper_state::Off;
 		oper.wave_sel = 0;
+		oper.wave_index = 0;
 	    }
 	}
 
@@ -1167,6 +1241,20 @@ namespace beenuked
 	inter = cb;
     }
 
+    void YM3526::attachDelta_RAM(uint8_t *ram_data, uint32_t ram_size)
+    {
+	delta_mem = ram_data;
+	delta_ram = ram_data;
+	delta_mem_size = ram_size;
+    }
+
+    void YM3526::attachDelta_ROM(const uint8_t *rom_data, uint32_t rom_size)
+    {
+	delta_mem = rom_data;
+	delta_ram = NULL;
+	delta_mem_size = rom_size;
+    }
+
     uint8_t YM3526::readIO(int port)
     {
 	uint8_t data = 0xFF;
@@ -1188,28 +1276,38 @@ namespace beenuked
 	}
 	else
 	{
+	    BEENUKED_PROFILE_WRITE(chip_address);
 	    write_reg(chip_address, data);
 	}
     }
 
     void YM3526::clockchip()
     {
+	BEENUKED_PROFILE_START();
 	env_clock += 1;
 	clock_timers();
+	BEENUKED_PROFILE_LAP(ProfileTimers);
 	clock_ampm();
+	BEENUKED_PROFILE_LAP(ProfileLFO);
 	clock_short_noise();
+	BEENUKED_PROFILE_LAP(ProfileRhythm);
 
+	// The phase and envelope generators are clocked together (and timed as the envelope stage)
 	for (auto &channel : channels)
 	{
 	    clock_phase(channel);
 	    clock_envelope(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileEnvelope);
+
 	for (int i = 0; i < 6; i++)
 	{
 	    channel_output(channels[i]);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileOutput);
+
 	if (!is_rhythm_enabled)
 	{
 	    channel_output(channels[6]);
@@ -1220,7 +1318,7 @@ namespace beenuked
 	    channels[6].output = (channels[6].output * 2);
 	}
 
-	clock_noise(14);
+	clock_noise();
 
 	if (!is_rhythm_enabled)
 	{
@@ -1243,8 +1341,6 @@ namespace beenuked
 	    channels[7].output = (ch7_output * 2);
 	}
 
-	clock_noise(2);
-
 	if (!is_rhythm_enabled)
 	{
 	    channel_output(channels[8]);
@@ -1266,7 +1362,13 @@ namespace beenuked
 	    channels[8].output = (ch8_output * 2);
 	}
 
-	clock_noise(2);
+	if (is_rhythm_enabled)
+	{
+	    noise_lfsr = BeeNukedOPLNoise::jump4(noise_lfsr);
+	}
+
+	// Channels 6-8, with or without rhythm mode
+	BEENUKED_PROFILE_LAP(ProfileRhythm);
 
 	if (is_y8950())
 	{
@@ -1277,10 +1379,13 @@ namespace beenuked
 	{
 	    delta_t_channel.adpcm_output = 0;
 	}
+
+	BEENUKED_PROFILE_LAP(ProfileADPCM);
     }
 
-    vector<int32_t> YM3526::get_samples()
+    int32_t YM3526::mix_output()
     {
+	BEENUKED_PROFILE_START();
 	int32_t output = 0;
 
 	for (int i = 0; i < 9; i++)
@@ -1289,11 +1394,176 @@ namespace beenuked
 	}
 
 	output += delta_t_channel.adpcm_output;
+	BEENUKED_PROFILE_LAP(ProfileMix);
+	return output;
+    }
 
-	int32_t sample = dac_ym3014(output);
+    vector<int32_t> YM3526::get_samples()
+    {
+	int32_t output = mix_output();
+
+	int32_t sample = (is_dac_bypassed) ? clamp(output, -32768, 32767) : dac_ym3014(output);
 
 	vector<int32_t> final_samples;
 	final_samples.push_back(sample);
 	return final_samples;
     }
+
+    void YM3526::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	size_t start = buffer.size();
+	buffer.resize((start + num_samples));
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    clockchip();
+	    buffer[(start + i)] = mix_output();
+	}
+
+	if (is_dac_bypassed)
+	{
+	    dac_bypass(&buffer[start], num_samples);
+	}
+	else
+	{
+	    dac_ym3014(&buffer[start], num_samples);
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YM3526::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    void YM3526::set_dac_bypass(bool val)
+    {
+	is_dac_bypassed = val;
+    }
+
+    template<typename Archive>
+    void YM3526::opl_delta_t::serialize_state(Archive &state)
+    {
+	state.value(is_exec);
+	state.value(is_record);
+	state.value(is_external);
+	state.value(is_repeat);
+	state.value(is_dram_8bit);
+	state.value(is_rom_ram);
+	state.value(current_addr);
+	state.value(start_address, 0, 0xFFFF);
+	state.value(stop_address, 0, 0xFFFF);
+	state.value(limit_address);
+	state.value(current_pos);
+	state.value(delta_n);
+	state.value(reg_accum);
+	state.value(prev_accum);
+	state.value(adpcm_step, 0, 24576);
+	state.value(adpcm_buffer);
+	state.value(num_nibbles, 0, 4);
+	state.value(ch_volume, 0, 0xFF);
+	state.value(is_keyon);
+	state.value(is_int_keyon);
+	state.value(adpcm_output);
+	state.value(is_eos);
+    }
+
+    template<typename Archive>
+    void YM3526::opl_operator::serialize_state(Archive &state)
+    {
+	state.value(is_carrier);
+	state.value(freq_num, 0, 0x3FF);
+	state.value(block, 0, 7);
+	state.value(multiply, 0, 15);
+	state.value(ksl, 0, 3);
+	state.value(total_level, 0, 0x3F);
+	state.value(tll_val);
+	state.value(is_sustained);
+	state.value(is_keyon);
+	state.value(is_ksr);
+	state.value(is_am);
+	state.value(is_vibrato);
+	state.value(rks_val, 0, 15);
+	state.value(attack_rate, 0, 15);
+	state.value(decay_rate, 0, 15);
+	state.value(sustain_level, 0, 0xF0);
+	state.value(release_rate, 0, 15);
+	state.value(wave_sel, 0, 3);
+	state.value(wave_index, 0, 3);
+	state.value(env_rate, 0, 63);
+	state.value(is_rhythm);
+	state.value(phase_keep);
+	state.value(env_output, 0, 511);
+	state.value(env_state, Attack, Off);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(rhythm_output);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YM3526::opl_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 8);
+	state.value(freq_num, 0, 0x3FF);
+	state.value(block, 0, 7);
+	state.value(output);
+	state.value(feedback, 0, 7);
+	state.value(lfo_am);
+	state.value(is_decay_algorithm);
+	state.value(opers);
+    }
+
+    template<typename Archive>
+    void YM3526::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(is_ws_enable);
+	state.value(env_clock);
+	state.value(am_clock);
+	// The PM clock indexes pm_table, and the noise cycles index the jump tables in opl_noise.h
+	state.value(pm_clock, 0, 0x3FFFFF);
+	state.value(lfo_am);
+	state.value(noise_lfsr);
+	state.value(noise_cycles, 0, 0x7FFFFE);
+	state.value(short_noise);
+	state.value(is_csm_mode);
+	state.value(note_select);
+	state.value(is_am_mode);
+	state.value(is_pm_mode);
+	state.value(is_rhythm_enabled);
+	state.value(opl_status);
+	state.value(timer1_freq);
+	state.value(timer2_freq);
+	state.value(timer1_counter);
+	state.value(timer2_counter);
+	state.value(is_timer1_running);
+	state.value(is_timer2_running);
+	state.value(is_timer1_disabled);
+	state.value(is_timer2_disabled);
+	state.value(is_eos_disabled);
+	state.value(is_brdy_disabled);
+	state.value(channels);
+	state.value(delta_t_channel);
+    }
+
+    void YM3526::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYM3526, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YM3526::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYM3526, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 };
\ No newline at end of file
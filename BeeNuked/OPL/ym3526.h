@@ -20,6 +20,12 @@
 #define BEENUKED_YM3526
 
 #include "utils.h"
+#include "trace.h"
+#include "ym3014.h"
+#include "opl_noise.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -44,6 +50,48 @@ namespace beenuked
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+	    // Bypasses the YM3014's quantization for a cleaner, higher-resolution output
+	    void set_dac_bypass(bool val);
+
+	    // Attaches the Y8950's sample memory directly (no copy is made, so it must outlive the chip).
+	    // Sample RAM can also be written through the ADPCM data register,
+	    // while writes to sample ROM are ignored.
+	    void attachDelta_RAM(uint8_t *ram_data, uint32_t ram_size);
+	    void attachDelta_ROM(const uint8_t *rom_data, uint32_t rom_size);
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    // Diagnostic events reported by this chip (see trace.h)
+	    BeeNukedTraceRing &get_trace_ring()
+	    {
+		return trace_ring;
+	    }
+#endif
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -60,11 +108,14 @@ namespace beenuked
 
 	    BeeNukedInterface *inter = NULL;
 
+	    bool is_dac_bypassed = false;
+
 	    void set_chip_type(OPLType type);
 	    void reset();
 
 	    void init_tables();
-	    int32_t calc_output(int32_t phase, int32_t mod, uint32_t atten, int wave_sel);
+	    int32_t mix_output();
+	    int32_t calc_output(int32_t phase, int32_t mod, uint32_t atten, int wave_index);
 
 	    OPLType chip_type;
 
@@ -106,6 +157,12 @@ namespace beenuked
 		bool is_keyon = false;
 		bool is_int_keyon = false;
 		int32_t adpcm_output = 0;
+
+		// Set once a memory write reaches the stop address
+		bool is_eos = false;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    opl_delta_t delta_t_channel;
@@ -126,6 +183,11 @@ namespace beenuked
 	    }
 
 	    uint8_t readROM(uint32_t address);
+	    void writeRAM(uint32_t address, uint8_t data);
+
+	    const uint8_t *delta_mem = NULL;
+	    uint8_t *delta_ram = NULL;
+	    uint32_t delta_mem_size = 0;
 
 	    void append_buffer_byte(uint8_t data)
 	    {
@@ -201,6 +263,7 @@ namespace beenuked
 		int release_rate = 0;
 
 		int wave_sel = 0;
+		int wave_index = 0;
 
 		int env_rate = 0;
 
@@ -208,13 +271,16 @@ namespace beenuked
 		bool phase_keep = false;
 
 		int32_t env_output = 0;
-		opl_oper_state env_state;
+		opl_oper_state env_state = opl_oper_state::Off;
 
 		uint32_t phase_counter = 0;
 		uint32_t phase_freq = 0;
 		uint32_t phase_output = 0;
 		int32_t rhythm_output = 0;
 		array<int32_t, 2> outputs = {0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    struct opl_channel
@@ -227,6 +293,9 @@ namespace beenuked
 		uint8_t lfo_am = 0;
 		bool is_decay_algorithm = false;
 		array<opl_operator, 2> opers;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    uint32_t env_clock = 0;
@@ -248,7 +317,11 @@ namespace beenuked
 	    array<uint32_t, 256> sine_table;
 	    array<uint32_t, 256> exp_table;
 
+	    // Attenuation for each waveform and phase, with bit 15 set for negative outputs
+	    array<array<uint32_t, 1024>, 4> wave_tables;
+
 	    uint32_t fetch_sine_result(uint32_t phase, int wave_sel, bool &is_negate);
+	    void update_waveform(opl_operator &oper);
 
 	    void write_reg(uint8_t reg, uint8_t data);
 	    void write_adpcm_reg(uint8_t reg, uint8_t data);
@@ -273,7 +346,10 @@ namespace beenuked
 	    void clock_timers();
 	    void clock_ampm();
 	    void clock_short_noise();
-	    void clock_noise(int cycle);
+	    void clock_noise();
+
+	    uint32_t noise_cycles = 0;
+
 	    void clock_phase(opl_channel &channel);
 	    void clock_envelope(opl_channel &channel);
 
@@ -300,8 +376,27 @@ namespace beenuked
 	    bool is_timer1_disabled = false;
 	    bool is_timer2_disabled = false;
 
+	    // Y8950 only
+	    bool is_eos_disabled = false;
+	    bool is_brdy_disabled = false;
+
+	    static constexpr uint32_t state_version = 3;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
 	    #include "opl_tables.inl"
-	    #include "ym3014.inl"
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    BeeNukedTraceRing trace_ring;
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
@@ -37,4 +37,86 @@ array<uint8_t, 16> ksl_table =
 {
     112, 64, 48, 38, 32, 26, 22, 18,
      16, 12, 10,  8,  6,  4,  2,  0
+};
+
+// First channel of each 4-op channel pair (the second channel is always 3 channels above it),
+// in the same order as the connection select bits in register 0x104
+array<int, 6> fourop_channels =
+{
+    0, 1, 2, 9, 10, 11
+};
+
+// Table for counter shift values (derived from MAME)
+array<uint8_t, 64> counter_shift_table =
+{
+    12, 12, 12, 12,
+    11, 11, 11, 11, 
+    10, 10, 10, 10,
+     9,  9,  9,  9,
+     8,  8,  8,  8,
+     7,  7,  7,  7,
+     6,  6,  6,  6,
+     5,  5,  5,  5,
+     4,  4,  4,  4,
+     3,  3,  3,  3,
+     2,  2,  2,  2,
+     1,  1,  1,  1,
+     0,  0,  0,  0,
+     0,  0,  0,  0,
+     0,  0,  0,  0,
+     0,  0,  0,  0
+};
+
+// Table for attenuation increment values (derived from MAME)
+array<array<uint8_t, 8>, 64> att_inc_table =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 2, 2, 1, 2, 2, 2, 
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 4, 4, 2, 4, 4, 4, 
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 
+};
+
+// Table for amplitude LFO calculations (verified on a real YM2413)
+// NOTE: each element repeats for 64 cycles
+array<uint8_t, 210> am_table = 
+{
+     0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1,  1,  1,  1,
+     2,  2,  2,  2,  2,  2,  2,  2,  3,  3,  3,  3,  3,  3,  3,  3,
+     4,  4,  4,  4,  4,  4,  4,  4,  5,  5,  5,  5,  5,  5,  5,  5,
+     6,  6,  6,  6,  6,  6,  6,  6,  7,  7,  7,  7,  7,  7,  7,  7,
+     8,  8,  8,  8,  8,  8,  8,  8,  9,  9,  9,  9,  9,  9,  9,  9,
+    10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11,
+    12, 12, 12, 12, 12, 12, 12, 12, 13, 13, 13, 12, 12, 12, 12, 12,
+    12, 12, 12, 11, 11, 11, 11, 11, 11, 11, 11, 10, 10, 10, 10, 10, 
+    10, 10, 10,  9,  9,  9,  9,  9,  9,  9,  9,  8,  8,  8,  8,  8,
+     8,  8,  8,  7,  7,  7,  7,  7,  7,  7,  7,  6,  6,  6,  6,  6,
+     6,  6,  6,  5,  5,  5,  5,  5,  5,  5,  5,  4,  4,  4,  4,  4,
+     4,  4,  4,  3,  3,  3,  3,  3,  3,  3,  3,  2,  2,  2,  2,  2,
+     2,  2,  2,  1,  1,  1,  1,  1,  1,  1,  1,  0,  0,  0,  0,  0,
+     0,  0
+};
+
+// Table for pitch modulation (derived from emu2413)
+array<array<int8_t, 8>, 8> pm_table = 
+{
+    0, 0, 0, 0, 0,  0,  0,  0, // fnum = 000xxxxxx
+    0, 0, 1, 0, 0,  0, -1,  0, // fnum = 001xxxxxx
+    0, 1, 2, 1, 0, -1, -2, -1, // fnum = 010xxxxxx
+    0, 1, 3, 1, 0, -1, -3, -1, // fnum = 011xxxxxx
+    0, 2, 4, 2, 0, -2, -4, -2, // fnum = 100xxxxxx
+    0, 2, 5, 2, 0, -2, -5, -2, // fnum = 101xxxxxx
+    0, 3, 6, 3, 0, -3, -6, -3, // fnum = 110xxxxxx
+    0, 3, 7, 3, 0, -3, -7, -3, // fnum = 111xxxxxx
 };
\ No newline at end of file
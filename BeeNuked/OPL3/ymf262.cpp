@@ -16,7 +16,7 @@
     along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-// BeeNuked-YMF262 (WIP)
+// BeeNuked-YMF262
 // Chip Name: YMF262 (OPL3)
 // Chip Used In:
 // Sound Blaster 16 and 16-bit Pro AudioSpectrum cards
@@ -28,24 +28,998 @@
 //
 // BueniaDev's Notes:
 //
-// This core is still a huge WIP, and lots of features are currently unimplemented.
-// As such, expect a lot of things to work incorrectly (and due to the envelope generator being
-// unimplemented, possibly quite loud as well).
-// However, work is being done to improve this core, so don't lose hope here!
+// Although this core shares its operator and envelope design with the (much more mature) YM3526 core,
+// extended to the OPL3's 18 channels, 4-op channel pairs, 8 waveforms and 4 output channels,
+// the following features are still completely unimplemented:
+// CSM/IRQ functionality (related to timers)
+//
+// However, work is continuing to be done on this core, so don't lose hope here!
+
+#include <ymf262.h>
+using namespace std;
+
+namespace beenuked
+{
+    YMF262::YMF262()
+    {
+
+    }
+
+    YMF262::~YMF262()
+    {
+
+    }
+
+    void YMF262::init_tables()
+    {
+	for (uint32_t index = 0; index < 256; index++)
+	{
+	    double phase_normalized = (static_cast<double>((index << 1) + 1) / 512.f);
+	    double sine_result_normalized = sin(phase_normalized * (M_PI / 2));
+
+	    double sine_result_as_attenuation = -log(sine_result_normalized) / log(2.0);
+
+	    uint32_t sine_result = static_cast<uint32_t>((sine_result_as_attenuation * 256.f) + 0.5);
+	    sine_table[index] = sine_result;
+	}
+
+	for (uint32_t index = 0; index < 256; index++)
+	{
+	    double entry_normalized = (static_cast<double>((index + 1)) / 256.f);
+	    double res_normalized = pow(2, -entry_normalized);
+
+	    uint32_t exp_result = static_cast<uint32_t>((res_normalized * 2048.f) + 0.5);
+	    exp_table[index] = exp_result;
+	}
+
+	for (int wave_sel = 0; wave_sel < 8; wave_sel++)
+	{
+	    for (uint32_t phase = 0; phase < 1024; phase++)
+	    {
+		bool is_negate = false;
+		uint32_t sine_result = fetch_sine_result(phase, wave_sel, is_negate);
+		wave_tables[wave_sel][phase] = (sine_result | (is_negate << 15));
+	    }
+	}
+    }
+
+    // Waveforms 4-7 are OPL3-only (derived from Nuked-OPL3)
+    uint32_t YMF262::fetch_sine_result(uint32_t phase, int wave_sel, bool &is_negate)
+    {
+	bool sign_bit = testbit(phase, 9);
+	bool mirror_bit = testbit(phase, 8);
+	uint8_t quarter_phase = (phase & 0xFF);
+
+	if (mirror_bit)
+	{
+	    quarter_phase = ~quarter_phase;
+	}
+
+	uint32_t sine_result = sine_table[quarter_phase];
+	is_negate = false;
+
+	switch ((wave_sel & 0x7))
+	{
+	    case 0:
+	    {
+		is_negate = sign_bit;
+	    }
+	    break;
+	    case 1:
+	    {
+		if (sign_bit)
+		{
+		    sine_result = 0xFFF;
+		}
+	    }
+	    break;
+	    case 2: break;
+	    case 3:
+	    {
+		if (mirror_bit)
+		{
+		    sine_result = 0xFFF;
+		}
+	    }
+	    break;
+	    case 4:
+	    case 5:
+	    {
+		// Sine (or absolute sine) at twice the frequency, silent for the second half
+		if (sign_bit)
+		{
+		    sine_result = 0xFFF;
+		}
+		else
+		{
+		    uint8_t double_phase = testbit(phase, 7) ? (((phase ^ 0xFF) << 1) & 0xFF) : ((phase << 1) & 0xFF);
+		    sine_result = sine_table[double_phase];
+		    is_negate = ((wave_sel == 4) && mirror_bit);
+		}
+	    }
+	    break;
+	    case 6:
+	    {
+		sine_result = 0;
+		is_negate = sign_bit;
+	    }
+	    break;
+	    case 7:
+	    {
+		uint32_t saw_phase = (phase & 0x1FF);
+
+		if (sign_bit)
+		{
+		    saw_phase ^= 0x1FF;
+		    is_negate = true;
+		}
+
+		sine_result = (saw_phase << 3);
+	    }
+	    break;
+	}
+
+	return sine_result;
+    }
+
+    int32_t YMF262::calc_output(int32_t phase, int32_t mod, uint32_t env, int wave_index)
+    {
+	uint32_t atten = min<uint32_t>(511, env);
+
+	uint32_t combined_phase = ((phase + mod) & 0x3FF);
+
+	uint32_t wave_result = wave_tables[wave_index][combined_phase];
+	uint32_t sine_result = (wave_result & 0x7FFF);
+
+	uint32_t attenuation = (atten << 3);
+	uint32_t combined_atten = ((sine_result + attenuation) & 0x1FFF);
+
+	int shift_count = ((combined_atten >> 8) & 0x1F);
+	uint8_t exp_index = (combined_atten & 0xFF);
+	uint32_t exp_result = exp_table[exp_index];
+
+	uint32_t output_shifted = ((exp_result << 2) >> shift_count);
+
+	int32_t exp_output = int32_t(output_shifted);
+
+	// Negate the output without branching
+	int32_t negate_mask = -int32_t(wave_result >> 15);
+	return ((exp_output ^ negate_mask) - negate_mask);
+    }
+
+    void YMF262::update_waveform(opl3_operator &oper)
+    {
+	// Waveforms 4-7 are only available in OPL3 mode
+	oper.wave_index = (is_new_mode) ? oper.wave_sel : (oper.wave_sel & 0x3);
+    }
+
+    void YMF262::write_port0(uint8_t reg, uint8_t data)
+    {
+	switch (reg)
+	{
+	    // Test register (the OPL2's waveform select enable bit is ignored,
+	    // as waveform select is always enabled on the OPL3)
+	    case 0x01: break;
+	    case 0x02:
+	    {
+		timer1_freq = data;
+	    }
+	    break;
+	    case 0x03:
+	    {
+		timer2_freq = data;
+	    }
+	    break;
+	    case 0x04:
+	    {
+		if (testbit(data, 7))
+		{
+		    opl_status = 0;
+		    write_port0(0x04, 0x00);
+		}
+		else
+		{
+		    if (testbit(data, 0) && !is_timer1_running)
+		    {
+			timer1_counter = (timer1_freq << 2);
+		    }
+
+		    if (testbit(data, 1) && !is_timer2_running)
+		    {
+			timer2_counter = (timer2_freq << 4);
+		    }
+
+		    is_timer1_running = testbit(data, 0);
+		    is_timer2_running = testbit(data, 1);
+		    is_timer2_disabled = testbit(data, 5);
+		    is_timer1_disabled = testbit(data, 6);
+		}
+	    }
+	    break;
+	    case 0x08:
+	    {
+		is_csm_mode = testbit(data, 7);
+		note_select = testbit(data, 6);
+
+		if (is_csm_mode)
+		{
+		    BEENUKED_TRACE(TraceUnimplemented, reg, data);
+		}
+	    }
+	    break;
+	    case 0xBD:
+	    {
+		is_am_mode = testbit(data, 7);
+		is_pm_mode = testbit(data, 6);
+		is_rhythm_enabled = testbit(data, 5);
+
+		// The rhythm key-on bits are OR'd with the channels' own key-on bits,
+		// and are treated as cleared while rhythm mode is off
+		uint8_t rhythm_keys = (is_rhythm_enabled) ? (data & 0x1F) : 0;
+
+		update_key_status(opers[12], KeyRhythm, testbit(rhythm_keys, 4));
+		update_key_status(opers[13], KeyRhythm, testbit(rhythm_keys, 4));
+		update_key_status(opers[14], KeyRhythm, testbit(rhythm_keys, 0));
+		update_key_status(opers[15], KeyRhythm, testbit(rhythm_keys, 3));
+		update_key_status(opers[16], KeyRhythm, testbit(rhythm_keys, 2));
+		update_key_status(opers[17], KeyRhythm, testbit(rhythm_keys, 1));
+	    }
+	    break;
+	    default: write_reg(0, reg, data); break;
+	}
+    }
+
+    void YMF262::write_port1(uint8_t reg, uint8_t data)
+    {
+	switch (reg)
+	{
+	    case 0x04:
+	    {
+		connection_sel = (data & 0x3F);
+		update_4op_mode();
+	    }
+	    break;
+	    case 0x05:
+	    {
+		update_new_mode(testbit(data, 0));
+	    }
+	    break;
+	    default: write_reg(1, reg, data); break;
+	}
+    }
+
+    // Operator and channel registers, which are the same in both register banks
+    void YMF262::write_reg(int bank, uint8_t reg, uint8_t data)
+    {
+	int reg_group = (reg & 0xF0);
+	int reg_addr = (reg & 0x1F);
+
+	int slot_num = slot_array[reg_addr];
+	int ch_num = (reg & 0xF);
+
+	// Operator registers (0x20-0x95 and 0xE0-0xF5)
+	int oper_num = (slot_num < 0) ? -1 : ((bank * 18) + slot_num);
+
+	switch (reg_group)
+	{
+	    case 0x20:
+	    case 0x30:
+	    {
+		if (oper_num < 0)
+		{
+		    return;
+		}
+
+		auto &oper = opers[oper_num];
+
+		oper.is_am = testbit(data, 7);
+		oper.is_vibrato = testbit(data, 6);
+		oper.is_sustained = testbit(data, 5);
+		oper.is_ksr = testbit(data, 4);
+		oper.multiply = (data & 0xF);
+		update_phase(oper);
+		update_rks(oper);
+	    }
+	    break;
+	    case 0x40:
+	    case 0x50:
+	    {
+		if (oper_num < 0)
+		{
+		    return;
+		}
+
+		auto &oper = opers[oper_num];
+
+		oper.ksl = ((data >> 6) & 0x3);
+		oper.total_level = (data & 0x3F);
+		update_total_level(oper);
+	    }
+	    break;
+	    case 0x60:
+	    case 0x70:
+	    {
+		if (oper_num < 0)
+		{
+		    return;
+		}
+
+		auto &oper = opers[oper_num];
+
+		oper.attack_rate = (data >> 4);
+		oper.decay_rate = (data & 0xF);
+		update_eg(oper);
+	    }
+	    break;
+	    case 0x80:
+	    case 0x90:
+	    {
+		if (oper_num < 0)
+		{
+		    return;
+		}
+
+		auto &oper = opers[oper_num];
+
+		oper.sustain_level = ((data >> 4) << 4);
+		oper.release_rate = (data & 0xF);
+		update_eg(oper);
+	    }
+	    break;
+	    case 0xA0:
+	    {
+		if (ch_num > 8)
+		{
+		    return;
+		}
+
+		auto &channel = channels[((bank * 9) + ch_num)];
+		channel.freq_num = ((channel.freq_num & 0x300) | data);
+		update_frequency(channel);
+	    }
+	    break;
+	    case 0xB0:
+	    {
+		if (ch_num > 8)
+		{
+		    return;
+		}
+
+		auto &channel = channels[((bank * 9) + ch_num)];
+
+		update_key_status(channel, testbit(data, 5));
+		channel.freq_num = ((channel.freq_num & 0xFF) | ((data & 0x3) << 8));
+		channel.block = ((data >> 2) & 0x7);
+		update_frequency(channel);
+	    }
+	    break;
+	    case 0xC0:
+	    {
+		if (ch_num > 8)
+		{
+		    return;
+		}
+
+		auto &channel = channels[((bank * 9) + ch_num)];
+
+		channel.output_sel = (data >> 4);
+		channel.feedback = ((data >> 1) & 0x7);
+		channel.is_decay_algorithm = testbit(data, 0);
+		update_output_sel(channel);
+	    }
+	    break;
+	    case 0xE0:
+	    case 0xF0:
+	    {
+		if (oper_num < 0)
+		{
+		    return;
+		}
+
+		auto &oper = opers[oper_num];
+		oper.wave_sel = (data & 0x7);
+		update_waveform(oper);
+	    }
+	    break;
+	    default: BEENUKED_TRACE(TraceUnhandledWrite, ((bank << 8) | reg), data); break;
+	}
+    }
+
+    void YMF262::update_new_mode(bool val)
+    {
+	if (is_new_mode == val)
+	{
+	    return;
+	}
+
+	is_new_mode = val;
+
+	for (auto &oper : opers)
+	{
+	    update_waveform(oper);
+	}
+
+	update_4op_mode();
+    }
+
+    // 4-op mode is only available in OPL3 mode,
+    // so the connection select bits are ignored while NEW is clear
+    void YMF262::update_4op_mode()
+    {
+	for (int pair = 0; pair < 6; pair++)
+	{
+	    auto &first = channels[fourop_channels[pair]];
+	    auto &second = channels[first.pair_index];
+
+	    bool is_4op = (is_new_mode && testbit(connection_sel, pair));
+
+	    if (first.is_4op == is_4op)
+	    {
+		continue;
+	    }
+
+	    first.is_4op = is_4op;
+	    second.is_4op_second = is_4op;
+	    second.output = 0;
+
+	    update_frequency(first);
+	    update_frequency(second);
+	}
+    }
+
+    void YMF262::update_output_sel(opl3_channel &channel)
+    {
+	for (int i = 0; i < 4; i++)
+	{
+	    channel.output_masks[i] = testbit(channel.output_sel, i) ? -1 : 0;
+	}
+    }
+
+    void YMF262::update_frequency(opl3_channel &channel)
+    {
+	// In 4-op mode, the frequency of the first channel is used for all 4 operators
+	if (channel.is_4op_second)
+	{
+	    return;
+	}
+
+	update_frequency(opers[channel.oper_index], channel);
+	update_frequency(opers[(channel.oper_index + 1)], channel);
+
+	if (channel.is_4op)
+	{
+	    int pair_oper = channels[channel.pair_index].oper_index;
+	    update_frequency(opers[pair_oper], channel);
+	    update_frequency(opers[(pair_oper + 1)], channel);
+	}
+    }
+
+    void YMF262::update_frequency(opl3_operator &oper, opl3_channel &channel)
+    {
+	oper.freq_num = channel.freq_num;
+	oper.block = channel.block;
+	update_phase(oper);
+	update_total_level(oper);
+	update_rks(oper);
+    }
+
+    void YMF262::update_key_status(opl3_channel &channel, bool val)
+    {
+	// In 4-op mode, the key-on bit of the first channel is used for all 4 operators
+	if (channel.is_4op_second)
+	{
+	    return;
+	}
+
+	update_key_status(opers[channel.oper_index], KeyNormal, val);
+	update_key_status(opers[(channel.oper_index + 1)], KeyNormal, val);
+
+	if (channel.is_4op)
+	{
+	    int pair_oper = channels[channel.pair_index].oper_index;
+	    update_key_status(opers[pair_oper], KeyNormal, val);
+	    update_key_status(opers[(pair_oper + 1)], KeyNormal, val);
+	}
+    }
+
+    void YMF262::update_key_status(opl3_operator &oper, uint8_t key_bit, bool val)
+    {
+	uint8_t key_state = (val) ? (oper.key_state | key_bit) : (oper.key_state & ~key_bit);
+
+	if ((key_state != 0) && (oper.key_state == 0))
+	{
+	    key_on(oper);
+	}
+	else if ((key_state == 0) && (oper.key_state != 0))
+	{
+	    key_off(oper);
+	}
+
+	oper.key_state = key_state;
+    }
+
+    void YMF262::key_on(opl3_operator &oper)
+    {
+	BEENUKED_PROFILE_KEY_ON();
+	int att_rate = oper.attack_rate;
+	int env_rate = 0;
+
+	if (att_rate != 0)
+	{
+	    int calc_rate = ((att_rate * 4) + oper.rks_val);
+	    env_rate = min(63, calc_rate);
+	}
+
+	if (env_rate >= 60)
+	{
+	    oper.env_state = opl3_oper_state::Decay;
+	    oper.env_output = 0;
+	}
+	else
+	{
+	    oper.env_state = opl3_oper_state::Attack;
+	}
+
+	oper.phase_counter = 0;
+
+	calc_oper_rate(oper);
+    }
+
+    void YMF262::key_off(opl3_operator &oper)
+    {
+	if (oper.env_state < opl3_oper_state::Release)
+	{
+	    oper.env_state = opl3_oper_state::Release;
+	    calc_oper_rate(oper);
+	}
+    }
+
+    void YMF262::update_phase(opl3_operator &oper)
+    {
+	int8_t lfo_pm = 0;
+
+	if (oper.is_vibrato)
+	{
+	    lfo_pm = pm_table[((oper.freq_num >> 7) & 7)][(pm_clock >> 19)];
+
+	    if (!is_pm_mode)
+	    {
+		lfo_pm >>= 1;
+	    }
+	}
+
+	uint32_t phase_result = (oper.freq_num + lfo_pm);
+	int multiply = multiply_table[oper.multiply];
+	oper.phase_freq = (((phase_result * multiply) << oper.block) >> 1);
+    }
+
+    // Total level calculation (KSL calculation derived from Nuked-OPL3)
+    void YMF262::update_total_level(opl3_operator &oper)
+    {
+	int temp_ksl = ((16 * oper.block - ksl_table[(oper.freq_num >> 6)]) << 1);
+	array<int, 4> kslx_table = {3, 1, 2, 0};
+	int ksl_val = (oper.ksl == 0) ? 0 : (max(0, temp_ksl) >> kslx_table[oper.ksl]);
+	oper.tll_val = ((oper.total_level << 2) + ksl_val);
+    }
+
+    void YMF262::update_rks(opl3_operator &oper)
+    {
+	// If NTS = 0, then bit 9 of FNUM is used.
+	// Otherwise, if NTS = 1, then bit 8 of FNUM is used.
+	bool freq_num = testbit(oper.freq_num, (note_select) ? 8 : 9);
+
+	int block_fnum = ((oper.block << 1) | freq_num);
+
+	oper.rks_val = (oper.is_ksr) ? block_fnum : (block_fnum >> 2);
+	calc_oper_rate(oper);
+    }
+
+    void YMF262::update_eg(opl3_operator &oper)
+    {
+	calc_oper_rate(oper);
+    }
+
+    void YMF262::calc_oper_rate(opl3_operator &oper)
+    {
+	int p_rate = 0;
+
+	switch (oper.env_state)
+	{
+	    case opl3_oper_state::Attack: p_rate = oper.attack_rate; break;
+	    case opl3_oper_state::Decay: p_rate = oper.decay_rate; break;
+	    case opl3_oper_state::Sustain:
+	    {
+		if (oper.is_sustained)
+		{
+		    p_rate = 0;
+		}
+		else
+		{
+		    p_rate = oper.release_rate;
+		}
+	    }
+	    break;
+	    case opl3_oper_state::Release: p_rate = oper.release_rate; break;
+	    default: p_rate = 0; break;
+	}
 
-#include <ymf262.h>
-using namespace std;
+	if (p_rate == 0)
+	{
+	    oper.env_rate = 0;
+	}
+	else
+	{
+	    int temp_rate = ((p_rate * 4) + oper.rks_val);
+	    oper.env_rate = min(63, temp_rate);
+	}
+    }
 
-namespace beenuked
-{
-    YMF262::YMF262()
+    void YMF262::clock_timers()
     {
+	if (is_timer1_running)
+	{
+	    if (timer1_counter != 1023)
+	    {
+		timer1_counter += 1;
+	    }
+	    else if (!is_timer1_disabled)
+	    {
+		opl_status |= 0xC0;
+		timer1_counter = (timer1_freq << 2);
+	    }
+	}
 
+	if (is_timer2_running)
+	{
+	    if (timer2_counter != 4095)
+	    {
+		timer2_counter += 1;
+	    }
+	    else if (!is_timer2_disabled)
+	    {
+		opl_status |= 0xA0;
+		timer2_counter = (timer2_freq << 4);
+	    }
+	}
     }
 
-    YMF262::~YMF262()
+    void YMF262::clock_ampm()
+    {
+	pm_clock = ((pm_clock + 512) & 0x3FFFFF);
+	am_clock += 1;
+	lfo_am = am_table[(((am_clock >> 6) % 210) >> (is_am_mode ? 0 : 2))];
+    }
+
+    void YMF262::clock_operators()
+    {
+	for (auto &oper : opers)
+	{
+	    clock_phase(oper);
+	    clock_envelope(oper);
+	}
+    }
+
+    void YMF262::clock_phase(opl3_operator &oper)
+    {
+	update_phase(oper);
+	oper.phase_counter = ((oper.phase_counter + oper.phase_freq) & 0xFFFFF);
+	oper.phase_output = (oper.phase_counter >> 10);
+    }
+
+    void YMF262::clock_envelope(opl3_operator &oper)
+    {
+	uint32_t counter_shift_val = counter_shift_table[oper.env_rate];
+
+	if ((env_clock % (1 << counter_shift_val)) != 0)
+	{
+	    return;
+	}
+
+	int update_cycle = ((env_clock >> counter_shift_val) & 0x7);
+	auto atten_inc = att_inc_table[oper.env_rate][update_cycle];
+
+	switch (oper.env_state)
+	{
+	    case opl3_oper_state::Attack:
+	    {
+		oper.env_output += ((~oper.env_output * atten_inc) >> 3);
+
+		if (oper.env_output <= 0)
+		{
+		    oper.env_output = 0;
+		    oper.env_state = opl3_oper_state::Decay;
+		    calc_oper_rate(oper);
+		}
+	    }
+	    break;
+	    case opl3_oper_state::Decay:
+	    {
+		oper.env_output += atten_inc;
+
+		if (oper.env_output >= oper.sustain_level)
+		{
+		    oper.env_state = opl3_oper_state::Sustain;
+		    calc_oper_rate(oper);
+		}
+	    }
+	    break;
+	    case opl3_oper_state::Sustain:
+	    {
+		oper.env_output += atten_inc;
+
+		if (oper.env_output >= 511)
+		{
+		    oper.env_output = 511;
+		}
+	    }
+	    break;
+	    case opl3_oper_state::Release:
+	    {
+		oper.env_output += atten_inc;
+
+		if (oper.env_output >= 511)
+		{
+		    oper.env_output = 511;
+		    oper.env_state = opl3_oper_state::Off;
+		}
+	    }
+	    break;
+	    default: break;
+	}
+    }
+
+    void YMF262::clock_short_noise()
+    {
+	uint32_t phase_hihat = opers[14].phase_output;
+	uint32_t phase_cymbal = opers[17].phase_output;
+
+	bool h_bit2 = testbit(phase_hihat, 2);
+	bool h_bit7 = testbit(phase_hihat, 7);
+	bool h_bit3 = testbit(phase_hihat, 3);
+
+	bool c_bit3 = testbit(phase_cymbal, 3);
+	bool c_bit5 = testbit(phase_cymbal, 5);
+
+	short_noise = ((h_bit2 != h_bit7) || (h_bit3 != c_bit5) || (c_bit3 != c_bit5));
+    }
+
+    void YMF262::clock_noise()
+    {
+	// The noise is only read in rhythm mode, so outside of it,
+	// both of the per-sample steps are just counted (see opl_noise.h)
+	if (!is_rhythm_enabled)
+	{
+	    BeeNukedOPLNoise::skip(noise_cycles, 18);
+	    return;
+	}
+
+	noise_lfsr = BeeNukedOPLNoise::sync(noise_lfsr, noise_cycles);
+	noise_lfsr = BeeNukedOPLNoise::jump14(noise_lfsr);
+    }
+
+    int32_t YMF262::oper_output(opl3_operator &oper, int32_t phase_mod)
+    {
+	return calc_output(oper.phase_output, phase_mod, get_env(oper), oper.wave_index);
+    }
+
+    int32_t YMF262::feedback_output(opl3_channel &channel, opl3_operator &oper)
+    {
+	int32_t feedback = 0;
+
+	if (channel.feedback != 0)
+	{
+	    feedback = ((oper.outputs[0] + oper.outputs[1]) >> (10 - channel.feedback));
+	}
+
+	oper.outputs[1] = oper.outputs[0];
+	oper.outputs[0] = oper_output(oper, feedback);
+	return oper.outputs[0];
+    }
+
+    void YMF262::channel_output(opl3_channel &channel)
+    {
+	auto &mod_slot = opers[channel.oper_index];
+	auto &car_slot = opers[(channel.oper_index + 1)];
+
+	int32_t mod_output = feedback_output(channel, mod_slot);
+
+	if (channel.is_decay_algorithm)
+	{
+	    int32_t car_output = oper_output(car_slot, 0);
+	    channel.output = ((mod_output >> 1) + (car_output >> 1));
+	}
+	else
+	{
+	    int32_t car_output = oper_output(car_slot, get_phase_mod(mod_output));
+	    channel.output = (car_output >> 1);
+	}
+    }
+
+    // The algorithm is selected by the CNT bits of both channels of the pair
+    void YMF262::channel_output_4op(opl3_channel &channel)
+    {
+	auto &pair = channels[channel.pair_index];
+
+	auto &slot1 = opers[channel.oper_index];
+	auto &slot2 = opers[(channel.oper_index + 1)];
+	auto &slot3 = opers[pair.oper_index];
+	auto &slot4 = opers[(pair.oper_index + 1)];
+
+	int32_t output1 = feedback_output(channel, slot1);
+
+	int algorithm = ((channel.is_decay_algorithm << 1) | pair.is_decay_algorithm);
+
+	switch (algorithm)
+	{
+	    // FM-FM: S1 -> S2 -> S3 -> S4
+	    case 0:
+	    {
+		int32_t output2 = oper_output(slot2, get_phase_mod(output1));
+		int32_t output3 = oper_output(slot3, get_phase_mod(output2));
+		int32_t output4 = oper_output(slot4, get_phase_mod(output3));
+		channel.output = (output4 >> 1);
+	    }
+	    break;
+	    // FM-AM: (S1 -> S2) + (S3 -> S4)
+	    case 1:
+	    {
+		int32_t output2 = oper_output(slot2, get_phase_mod(output1));
+		int32_t output3 = oper_output(slot3, 0);
+		int32_t output4 = oper_output(slot4, get_phase_mod(output3));
+		channel.output = ((output2 >> 1) + (output4 >> 1));
+	    }
+	    break;
+	    // AM-FM: S1 + (S2 -> S3 -> S4)
+	    case 2:
+	    {
+		int32_t output2 = oper_output(slot2, 0);
+		int32_t output3 = oper_output(slot3, get_phase_mod(output2));
+		int32_t output4 = oper_output(slot4, get_phase_mod(output3));
+		channel.output = ((output1 >> 1) + (output4 >> 1));
+	    }
+	    break;
+	    // AM-AM: S1 + (S2 -> S3) + S4
+	    case 3:
+	    {
+		int32_t output2 = oper_output(slot2, 0);
+		int32_t output3 = oper_output(slot3, get_phase_mod(output2));
+		int32_t output4 = oper_output(slot4, 0);
+		channel.output = ((output1 >> 1) + (output3 >> 1) + (output4 >> 1));
+	    }
+	    break;
+	}
+    }
+
+    void YMF262::bd_output()
+    {
+	auto &channel = channels[6];
+	auto &mod_slot = opers[12];
+	auto &car_slot = opers[13];
+
+	int32_t mod_output = feedback_output(channel, mod_slot);
+	int32_t phase_mod = (channel.is_decay_algorithm) ? 0 : get_phase_mod(mod_output);
+	int32_t car_output = oper_output(car_slot, phase_mod);
+	channel.output = (car_output >> 1);
+    }
+
+    void YMF262::hihat_output()
+    {
+	auto &slot = opers[14];
+
+	uint32_t phase = 0;
+
+	if (short_noise)
+	{
+	    phase = testbit(noise_lfsr, 0) ? 0x2D0 : 0x234;
+	}
+	else
+	{
+	    phase = testbit(noise_lfsr, 0) ? 0x34 : 0xD0;
+	}
+
+	int32_t rhythm_output = calc_output(phase, 0, get_env(slot), slot.wave_index);
+	slot.rhythm_output = (rhythm_output >> 1);
+    }
+
+    void YMF262::snare_output()
+    {
+	auto &phase_slot = opers[14];
+	auto &slot = opers[15];
+
+	uint32_t phase = 0;
+
+	if (testbit(phase_slot.phase_output, 8))
+	{
+	    phase = testbit(noise_lfsr, 0) ? 0x300 : 0x200;
+	}
+	else
+	{
+	    phase = testbit(noise_lfsr, 0) ? 0 : 0x100;
+	}
+
+	int32_t rhythm_output = calc_output(phase, 0, get_env(slot), slot.wave_index);
+	slot.rhythm_output = (rhythm_output >> 1);
+    }
+
+    void YMF262::tom_output()
+    {
+	auto &slot = opers[16];
+
+	int32_t rhythm_output = calc_output(slot.phase_output, 0, get_env(slot), slot.wave_index);
+	slot.rhythm_output = (rhythm_output >> 1);
+    }
+
+    void YMF262::cym_output()
     {
+	auto &slot = opers[17];
+
+	uint32_t phase = short_noise ? 0x300 : 0x100;
+
+	int32_t rhythm_output = calc_output(phase, 0, get_env(slot), slot.wave_index);
+	slot.rhythm_output = (rhythm_output >> 1);
+    }
+
+    void YMF262::clock_melody_channels(int first, int last)
+    {
+	// OPL2 mode fast path (no 4-op channels)
+	if (!is_new_mode)
+	{
+	    for (int i = first; i < last; i++)
+	    {
+		channel_output(channels[i]);
+	    }
+
+	    return;
+	}
+
+	for (int i = first; i < last; i++)
+	{
+	    auto &channel = channels[i];
+
+	    if (channel.is_4op)
+	    {
+		channel_output_4op(channel);
+	    }
+	    else if (!channel.is_4op_second)
+	    {
+		channel_output(channel);
+	    }
+	}
+    }
+
+    // Rhythm mode only applies to channels 6-8 (which can't be paired up)
+    void YMF262::clock_channels()
+    {
+	clock_melody_channels(0, 6);
+
+	if (!is_rhythm_enabled)
+	{
+	    clock_melody_channels(6, 9);
+	    clock_noise();
+	}
+	else
+	{
+	    bd_output();
+	    channels[6].output = (channels[6].output * 2);
+
+	    clock_noise();
+
+	    hihat_output();
+	    snare_output();
+
+	    int32_t ch7_output = clamp((opers[14].rhythm_output + opers[15].rhythm_output), -32768, 32767);
+	    channels[7].output = (ch7_output * 2);
+
+	    tom_output();
+	    cym_output();
+
+	    int32_t ch8_output = clamp((opers[16].rhythm_output + opers[17].rhythm_output), -32768, 32767);
+	    channels[8].output = (ch8_output * 2);
+
+	    noise_lfsr = BeeNukedOPLNoise::jump4(noise_lfsr);
+	}
 
+	clock_melody_channels(9, 18);
     }
 
     uint32_t YMF262::get_sample_rate(uint32_t clock_rate)
@@ -60,17 +1034,51 @@ namespace beenuked
 
     void YMF262::reset()
     {
-	return;
-    }
+	init_tables();
+	env_clock = 0;
+	am_clock = 0;
+	pm_clock = 0;
+	lfo_am = 0;
+	short_noise = false;
+	noise_lfsr = 1;
+	noise_cycles = 0;
 
-    void YMF262::write_port0(uint8_t reg, uint8_t data)
-    {
-	cout << "Writing value of " << hex << int(data) << " to YMF262 port 0 register of " << hex << int(reg) << endl;
+	is_new_mode = false;
+	connection_sel = 0;
+	is_rhythm_enabled = false;
+
+	opers.fill(opl3_operator());
+
+	for (int i = 0; i < 18; i++)
+	{
+	    auto &channel = channels[i];
+	    channel = opl3_channel();
+	    channel.number = i;
+	    channel.oper_index = (i * 2);
+	}
+
+	for (int pair = 0; pair < 6; pair++)
+	{
+	    int first = fourop_channels[pair];
+	    channels[first].pair_index = (first + 3);
+	    channels[(first + 3)].pair_index = first;
+	}
+
+	opl_status = 0;
+	timer1_counter = 1023;
+	timer2_counter = 255;
     }
 
-    void YMF262::write_port1(uint8_t reg, uint8_t data)
+    uint8_t YMF262::readIO(int port)
     {
-	cout << "Writing value of " << hex << int(data) << " to YMF262 port 1 register of " << hex << int(reg) << endl;
+	uint8_t data = 0xFF;
+
+	if ((port & 3) == 0)
+	{
+	    data = opl_status;
+	}
+
+	return data;
     }
 
     void YMF262::writeIO(int port, uint8_t data)
@@ -90,6 +1098,7 @@ namespace beenuked
 		    return;
 		}
 
+		BEENUKED_PROFILE_WRITE(chip_address);
 		write_port0(chip_address, data);
 	    }
 	    break;
@@ -106,6 +1115,7 @@ namespace beenuked
 		    return;
 		}
 
+		BEENUKED_PROFILE_WRITE((0x100 | chip_address));
 		write_port1(chip_address, data);
 	    }
 	    break;
@@ -114,19 +1124,194 @@ namespace beenuked
 
     void YMF262::clockchip()
     {
-	return;
+	BEENUKED_PROFILE_START();
+	env_clock += 1;
+	clock_timers();
+	BEENUKED_PROFILE_LAP(ProfileTimers);
+	clock_ampm();
+	BEENUKED_PROFILE_LAP(ProfileLFO);
+	clock_short_noise();
+	BEENUKED_PROFILE_LAP(ProfileRhythm);
+
+	// The phase and envelope generators are clocked together (and timed as the envelope stage)
+	clock_operators();
+	BEENUKED_PROFILE_LAP(ProfileEnvelope);
+
+	// Includes the rhythm channels in rhythm mode
+	clock_channels();
+	BEENUKED_PROFILE_LAP(ProfileOutput);
+    }
+
+    void YMF262::mix_output(int32_t *output)
+    {
+	BEENUKED_PROFILE_START();
+
+	// OPL2 mode fast path (every channel goes to outputs A and B only)
+	if (!is_new_mode)
+	{
+	    int32_t sample = 0;
+
+	    for (auto &channel : channels)
+	    {
+		sample += channel.output;
+	    }
+
+	    sample = clamp(sample, -32768, 32767);
+	    output[0] = sample;
+	    output[1] = sample;
+	    output[2] = 0;
+	    output[3] = 0;
+	    BEENUKED_PROFILE_LAP(ProfileMix);
+	    return;
+	}
+
+	array<int32_t, 4> samples = {0, 0, 0, 0};
+
+	for (auto &channel : channels)
+	{
+	    for (int i = 0; i < 4; i++)
+	    {
+		samples[i] += (channel.output & channel.output_masks[i]);
+	    }
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+	    output[i] = clamp(samples[i], -32768, 32767);
+	}
+
+	BEENUKED_PROFILE_LAP(ProfileMix);
     }
 
     vector<int32_t> YMF262::get_samples()
     {
 	array<int32_t, 4> output = {0, 0, 0, 0};
+	mix_output(output.data());
 
 	// YMF262 has 4 total outputs
 	vector<int32_t> final_samples;
-	final_samples.push_back(0);
-	final_samples.push_back(0);
-	final_samples.push_back(0);
-	final_samples.push_back(0);
+	final_samples.push_back(output[0]);
+	final_samples.push_back(output[1]);
+	final_samples.push_back(output[2]);
+	final_samples.push_back(output[3]);
 	return final_samples;
     }
+
+    void YMF262::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	size_t start = buffer.size();
+	buffer.resize((start + (num_samples * 4)));
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    clockchip();
+	    mix_output(&buffer[(start + (i * 4))]);
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YMF262::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    template<typename Archive>
+    void YMF262::opl3_operator::serialize_state(Archive &state)
+    {
+	state.value(freq_num, 0, 0x3FF);
+	state.value(block, 0, 7);
+	state.value(multiply, 0, 15);
+	state.value(ksl, 0, 3);
+	state.value(total_level, 0, 0x3F);
+	state.value(tll_val);
+	state.value(is_sustained);
+	state.value(is_ksr);
+	state.value(is_am);
+	state.value(is_vibrato);
+	state.value(key_state, 0, (KeyNormal | KeyRhythm));
+	state.value(rks_val, 0, 15);
+	state.value(attack_rate, 0, 15);
+	state.value(decay_rate, 0, 15);
+	state.value(sustain_level, 0, 0xF0);
+	state.value(release_rate, 0, 15);
+	state.value(wave_sel, 0, 7);
+	state.value(wave_index, 0, 7);
+	state.value(env_rate, 0, 63);
+	state.value(env_output, 0, 511);
+	state.value(env_state, Attack, Off);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(rhythm_output);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YMF262::opl3_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 17);
+	state.value(freq_num, 0, 0x3FF);
+	state.value(block, 0, 7);
+	state.value(output);
+	state.value(feedback, 0, 7);
+	state.value(is_decay_algorithm);
+	state.value(output_sel, 0, 15);
+	state.value(output_masks, -1, 0);
+	state.value(oper_index, 0, 34);
+	state.value(pair_index, -1, 17);
+	state.value(is_4op);
+	state.value(is_4op_second);
+    }
+
+    template<typename Archive>
+    void YMF262::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(is_addr_a1);
+	state.value(env_clock);
+	state.value(am_clock);
+	// The PM clock indexes pm_table, and the noise cycles index the jump tables in opl_noise.h
+	state.value(pm_clock, 0, 0x3FFFFF);
+	state.value(lfo_am);
+	state.value(noise_lfsr);
+	state.value(noise_cycles, 0, 0x7FFFFE);
+	state.value(short_noise);
+	state.value(is_csm_mode);
+	state.value(note_select);
+	state.value(is_am_mode);
+	state.value(is_pm_mode);
+	state.value(is_rhythm_enabled);
+	state.value(is_new_mode);
+	state.value(connection_sel, 0, 0x3F);
+	state.value(opl_status);
+	state.value(timer1_freq);
+	state.value(timer2_freq);
+	state.value(timer1_counter);
+	state.value(timer2_counter);
+	state.value(is_timer1_running);
+	state.value(is_timer2_running);
+	state.value(is_timer1_disabled);
+	state.value(is_timer2_disabled);
+	state.value(opers);
+	state.value(channels);
+    }
+
+    void YMF262::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYMF262, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YMF262::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYMF262, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 };
\ No newline at end of file
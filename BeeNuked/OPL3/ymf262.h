@@ -20,6 +20,11 @@
 #define BEENUKED_YMF262
 
 #include "utils.h"
+#include "opl_noise.h"
+#include "trace.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -31,10 +36,44 @@ namespace beenuked
 
 	    uint32_t get_sample_rate(uint32_t clock_rate);
 	    void init();
+	    uint8_t readIO(int port);
 	    void writeIO(int port, uint8_t data);
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    // Diagnostic events reported by this chip (see trace.h)
+	    BeeNukedTraceRing &get_trace_ring()
+	    {
+		return trace_ring;
+	    }
+#endif
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -44,11 +83,222 @@ namespace beenuked
 
 	    void reset();
 
+	    void init_tables();
+	    void mix_output(int32_t *output);
+	    int32_t calc_output(int32_t phase, int32_t mod, uint32_t env, int wave_index);
+
+	    enum opl3_oper_state : int
+	    {
+		Attack = 0,
+		Decay = 1,
+		Sustain = 2,
+		Release = 3,
+		Off = 4,
+	    };
+
+	    // Operator key-on sources (the channel's key-on bit and the rhythm key-on bits),
+	    // which are OR'd together like on the real chip
+	    enum : uint8_t
+	    {
+		KeyNormal = 0x1,
+		KeyRhythm = 0x2
+	    };
+
+	    struct opl3_operator
+	    {
+		uint32_t freq_num = 0;
+		int block = 0;
+		int multiply = 0;
+		int ksl = 0;
+		int total_level = 0;
+		int tll_val = 0;
+
+		bool is_sustained = false;
+		bool is_ksr = false;
+
+		bool is_am = false;
+		bool is_vibrato = false;
+
+		uint8_t key_state = 0;
+
+		int rks_val = 0;
+
+		int attack_rate = 0;
+		int decay_rate = 0;
+		int sustain_level = 0;
+		int release_rate = 0;
+
+		int wave_sel = 0;
+		int wave_index = 0;
+
+		int env_rate = 0;
+
+		int32_t env_output = 511;
+		opl3_oper_state env_state = Off;
+
+		uint32_t phase_counter = 0;
+		uint32_t phase_freq = 0;
+		uint32_t phase_output = 0;
+		int32_t rhythm_output = 0;
+		array<int32_t, 2> outputs = {0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
+	    };
+
+	    struct opl3_channel
+	    {
+		int number = 0;
+		uint32_t freq_num = 0;
+		int block = 0;
+		int32_t output = 0;
+		int feedback = 0;
+		bool is_decay_algorithm = false;
+
+		// Output enables for channels A-D, expanded to all-ones masks for the mixer
+		uint8_t output_sel = 0;
+		array<int32_t, 4> output_masks = {0, 0, 0, 0};
+
+		// Index of the channel's modulator in the operator array
+		// (its carrier always follows it)
+		int oper_index = 0;
+
+		// Channels 0-2 and 9-11 can each be paired with the channel 3 above them.
+		// In 4-op mode, the first channel of the pair drives all 4 operators,
+		// while the second channel is silent and ignores its frequency and key-on bits.
+		int pair_index = -1;
+		bool is_4op = false;
+		bool is_4op_second = false;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
+	    };
+
+	    // All 36 operators are laid out contiguously (channel N owns operators 2N and 2N + 1),
+	    // so that the phase and envelope generators can be clocked in a single pass
+	    array<opl3_operator, 36> opers;
+	    array<opl3_channel, 18> channels;
+
+	    uint32_t env_clock = 0;
+	    uint32_t am_clock = 0;
+	    uint32_t pm_clock = 0;
+	    uint32_t noise_lfsr = 0;
+
+	    uint8_t lfo_am = 0;
+
+	    bool short_noise = false;
+	    bool is_csm_mode = false;
+
+	    bool note_select = false;
+	    bool is_am_mode = false;
+	    bool is_pm_mode = false;
+
+	    // NEW bit (register 0x105): when clear, the chip runs in OPL2 compatibility mode
+	    bool is_new_mode = false;
+	    uint8_t connection_sel = 0;
+
+	    array<uint32_t, 256> sine_table;
+	    array<uint32_t, 256> exp_table;
+
+	    // Attenuation for each waveform and phase, with bit 15 set for negative outputs
+	    array<array<uint32_t, 1024>, 8> wave_tables;
+
+	    uint32_t fetch_sine_result(uint32_t phase, int wave_sel, bool &is_negate);
+	    void update_waveform(opl3_operator &oper);
+
 	    uint8_t chip_address = 0;
 	    bool is_addr_a1 = false;
 
 	    void write_port0(uint8_t reg, uint8_t data);
 	    void write_port1(uint8_t reg, uint8_t data);
+	    void write_reg(int bank, uint8_t reg, uint8_t data);
+
+	    void update_new_mode(bool val);
+	    void update_4op_mode();
+	    void update_output_sel(opl3_channel &channel);
+
+	    void update_frequency(opl3_channel &channel);
+	    void update_frequency(opl3_operator &oper, opl3_channel &channel);
+	    void update_phase(opl3_operator &oper);
+	    void update_key_status(opl3_channel &channel, bool val);
+	    void update_key_status(opl3_operator &oper, uint8_t key_bit, bool val);
+	    void update_total_level(opl3_operator &oper);
+	    void update_rks(opl3_operator &oper);
+	    void update_eg(opl3_operator &oper);
+	    void calc_oper_rate(opl3_operator &oper);
+
+	    void key_on(opl3_operator &oper);
+	    void key_off(opl3_operator &oper);
+
+	    void clock_timers();
+	    void clock_ampm();
+	    void clock_short_noise();
+	    void clock_noise();
+
+	    uint32_t noise_cycles = 0;
+
+	    void clock_operators();
+	    void clock_phase(opl3_operator &oper);
+	    void clock_envelope(opl3_operator &oper);
+
+	    uint32_t get_env(opl3_operator &oper)
+	    {
+		uint8_t oper_am = oper.is_am ? lfo_am : 0;
+		return (oper.tll_val + oper.env_output + oper_am);
+	    }
+
+	    // Converts an operator output into phase modulation for the next operator
+	    int32_t get_phase_mod(int32_t output)
+	    {
+		return ((output >> 1) & 0x3FF);
+	    }
+
+	    int32_t oper_output(opl3_operator &oper, int32_t phase_mod);
+	    int32_t feedback_output(opl3_channel &channel, opl3_operator &oper);
+
+	    void clock_channels();
+	    void clock_melody_channels(int first, int last);
+	    void channel_output(opl3_channel &channel);
+	    void channel_output_4op(opl3_channel &channel);
+	    void bd_output();
+	    void hihat_output();
+	    void snare_output();
+	    void tom_output();
+	    void cym_output();
+
+	    bool is_rhythm_enabled = false;
+
+	    uint8_t opl_status = 0;
+
+	    uint8_t timer1_freq = 0;
+	    uint8_t timer2_freq = 0;
+
+	    uint16_t timer1_counter = 0;
+	    uint16_t timer2_counter = 0;
+
+	    bool is_timer1_running = false;
+	    bool is_timer2_running = false;
+
+	    bool is_timer1_disabled = false;
+	    bool is_timer2_disabled = false;
+
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
+	    #include "opl3_tables.inl"
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    BeeNukedTraceRing trace_ring;
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
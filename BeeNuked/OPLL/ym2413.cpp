@@ -256,6 +256,7 @@ namespace beenuked
 	if (!oper.is_keyon)
 	{
 	    oper.is_keyon = true;
+	    BEENUKED_PROFILE_KEY_ON();
 	    oper.env_state = opll_oper_state::Damp;
 	    calc_oper_rate(oper);
 	}
@@ -428,17 +429,18 @@ namespace beenuked
 	short_noise = ((h_bit2 != h_bit7) || (h_bit3 != c_bit5) || (c_bit3 != c_bit5));
     }
 
-    void YM2413::clock_noise(int cycle)
+    void YM2413::clock_noise()
     {
-	for (int i = 0; i < cycle; i++)
+	// The noise is only read in rhythm mode, so outside of it,
+	// both of the per-sample steps are just counted (see opl_noise.h)
+	if (!is_rhythm_enabled)
 	{
-	    if (testbit(noise_lfsr, 0))
-	    {
-		noise_lfsr ^= 0x800200;
-	    }
-
-	    noise_lfsr >>= 1;
+	    BeeNukedOPLNoise::skip(noise_cycles, 18);
+	    return;
 	}
+
+	noise_lfsr = BeeNukedOPLNoise::sync(noise_lfsr, noise_cycles);
+	noise_lfsr = BeeNukedOPLNoise::jump14(noise_lfsr);
     }
 
     void YM2413::channel_output(opll_channel &channel)
@@ -754,6 +756,7 @@ namespace beenuked
 	pm_clock = 0;
 	short_noise = false;
 	noise_lfsr = 1;
+	noise_cycles = 0;
 	for (int i = 0; i < 9; i++)
 	{
 	    channels[i].number = i;
@@ -787,26 +790,34 @@ namespace beenuked
 	}
 	else
 	{
+	    BEENUKED_PROFILE_WRITE(chip_address);
 	    write_reg(chip_address, data);
 	}
     }
 
     void YM2413::clockchip()
     {
+	BEENUKED_PROFILE_START();
 	env_clock += 1;
 	clock_ampm();
+	BEENUKED_PROFILE_LAP(ProfileLFO);
 
 	if (!is_vrc7())
 	{
 	    clock_short_noise();
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileRhythm);
+
+	// The phase and envelope generators are clocked together (and timed as the envelope stage)
 	for (auto &channel : channels)
 	{
 	    clock_phase(channel);
 	    clock_envelope(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileEnvelope);
+
 	for (int i = 0; i < 6; i++)
 	{
 	    if (!testbit(channel_mask, i))
@@ -815,6 +826,8 @@ namespace beenuked
 	    }
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileOutput);
+
 	// VRC7 has no rhythm channels, compared to OPLL
 	if (is_vrc7())
 	{
@@ -837,7 +850,7 @@ namespace beenuked
 	    }
 	}
 
-	clock_noise(14);
+	clock_noise();
 
 	if (!is_rhythm_enabled)
 	{
@@ -863,8 +876,6 @@ namespace beenuked
 	    channels[7].output = (ch7_output * 2);
 	}
 
-	clock_noise(2);
-
 	if (!is_rhythm_enabled)
 	{
 	    if (!testbit(channel_mask, 8))
@@ -889,11 +900,18 @@ namespace beenuked
 	    channels[8].output = (ch8_output * 2);
 	}
 
-	clock_noise(2);
+	if (is_rhythm_enabled)
+	{
+	    noise_lfsr = BeeNukedOPLNoise::jump4(noise_lfsr);
+	}
+
+	// Channels 6-8, with or without rhythm mode
+	BEENUKED_PROFILE_LAP(ProfileRhythm);
     }
 
-    vector<int32_t> YM2413::get_samples()
+    int32_t YM2413::mix_output()
     {
+	BEENUKED_PROFILE_START();
 	int32_t output = 0;
 
 	for (auto &channel : channels)
@@ -901,13 +919,40 @@ namespace beenuked
 	    output += channel.output;
 	}
 
-	int32_t sample = ((output * 128) / 9);
+	BEENUKED_PROFILE_LAP(ProfileMix);
+	return ((output * 128) / 9);
+    }
 
+    vector<int32_t> YM2413::get_samples()
+    {
 	vector<int32_t> final_samples;
-	final_samples.push_back(sample);
+	final_samples.push_back(mix_output());
 	return final_samples;
     }
 
+    void YM2413::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	size_t start = buffer.size();
+	buffer.resize((start + num_samples));
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    clockchip();
+	    buffer[(start + i)] = mix_output();
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YM2413::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
     uint32_t YM2413::set_mask(uint32_t mask)
     {
 	uint32_t ret = channel_mask;
@@ -921,4 +966,83 @@ namespace beenuked
 	channel_mask ^= mask;
 	return ret;
     }
+
+    template<typename Archive>
+    void YM2413::opll_operator::serialize_state(Archive &state)
+    {
+	state.value(is_carrier);
+	state.value(freq_num, 0, 0x1FF);
+	state.value(block, 0, 7);
+	state.value(is_am);
+	state.value(is_vibrato);
+	state.value(is_ws);
+	state.value(multiply, 0, 15);
+	state.value(ksl, 0, 3);
+	state.value(total_level, 0, 0x3F);
+	state.value(volume, 0, 15);
+	state.value(tll_val);
+	state.value(rks_val, 0, 15);
+	state.value(is_ksr);
+	state.value(is_keyon);
+	state.value(is_rhythm);
+	state.value(phase_keep);
+	state.value(is_sustained);
+	state.value(sustain_flag);
+	state.value(attack_rate, 0, 15);
+	state.value(decay_rate, 0, 15);
+	state.value(sustain_level, 0, 0x78);
+	state.value(release_rate, 0, 15);
+	state.value(env_output, 0, 127);
+	state.value(env_rate, 0, 63);
+	state.value(env_state, Damp, Off);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(rhythm_output);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YM2413::opll_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 8);
+	state.value(freq_num, 0, 0x1FF);
+	state.value(block, 0, 7);
+	state.value(feedback, 0, 7);
+	state.value(inst_vol_reg);
+	state.value(inst_number, 0, 18);
+	state.value(output);
+	state.value(lfo_am);
+	state.value(opers);
+    }
+
+    template<typename Archive>
+    void YM2413::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(inst_patch);
+	state.value(env_clock);
+	state.value(am_clock);
+	state.value(pm_clock);
+	state.value(noise_lfsr);
+	// The noise cycles index the jump tables in opl_noise.h
+	state.value(noise_cycles, 0, 0x7FFFFE);
+	state.value(short_noise);
+	state.value(is_rhythm_enabled);
+	state.value(channels);
+    }
+
+    void YM2413::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYM2413, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YM2413::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYM2413, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 }
\ No newline at end of file
@@ -20,6 +20,10 @@
 #define BEENUKED_YM2413
 
 #include "utils.h"
+#include "opl_noise.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -45,6 +49,31 @@ namespace beenuked
 	    uint32_t toggle_mask(uint32_t mask);
 	    vector<int32_t> get_samples();
 
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
 	    uint32_t get_mask_ch(int ch)
 	    {
 		if ((ch < 0) || (ch >= 9))
@@ -98,6 +127,8 @@ namespace beenuked
 		return (1 << bit);
 	    }
 
+	    int32_t mix_output();
+
 	    template<typename T>
 	    bool testbit(T reg, int bit)
 	    {
@@ -132,6 +163,14 @@ namespace beenuked
 	    typedef array<uint8_t, 8> opll_inst;
 	    typedef array<opll_inst, 19> opll_patch;
 
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
 	    #include "opll_tables.inl"
 
 	    opll_patch inst_patch;
@@ -185,6 +224,9 @@ namespace beenuked
 		uint32_t phase_output = 0;
 		int32_t rhythm_output = 0;
 		array<int32_t, 2> outputs = {0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    struct opll_channel
@@ -198,6 +240,9 @@ namespace beenuked
 		int32_t output = 0;
 		uint8_t lfo_am = 0;
 		array<opll_operator, 2> opers;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    uint32_t env_clock = 0;
@@ -221,7 +266,9 @@ namespace beenuked
 
 	    void clock_ampm();
 	    void clock_short_noise();
-	    void clock_noise(int cycle);
+	    void clock_noise();
+
+	    uint32_t noise_cycles = 0;
 
 	    void hihat_output();
 	    void snare_output();
@@ -241,6 +288,10 @@ namespace beenuked
 	    void update_instrument(opll_channel &channel);
 
 	    bool is_rhythm_enabled = false;
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
@@ -0,0 +1,917 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeNuked-YM2413xN
+// Multi-chip renderer for the YM2413 (OPLL) and its variants
+//
+// BueniaDev's Notes:
+//
+// This is the same emulation as the YM2413 core, reorganized so that one block render
+// can drive dozens of chips at once (i.e. a server mixing many independent OPLL streams).
+//
+// The hot paths (LFO, phase generator, operator output, mixing) are written as
+// straight loops over lanes with no cross-lane dependencies, which the compiler
+// can vectorize when building with AVX2 (or wider) enabled.
+// The envelope generator and the rhythm section are still stepped one lane at a time,
+// as they branch too much for that to pay off.
+//
+// Register writes are rarely on the hot path, so they're applied per-lane
+// in exactly the same way as in the YM2413 core.
+
+#include "ym2413xn.h"
+using namespace beenuked;
+
+namespace beenuked
+{
+    YM2413xN::YM2413xN()
+    {
+
+    }
+
+    YM2413xN::~YM2413xN()
+    {
+
+    }
+
+    int YM2413xN::calc_rate(int p_rate, int rks)
+    {
+	if (p_rate == 0)
+	{
+	    return 0;
+	}
+	else
+	{
+	    return min(63, ((p_rate * 4) + rks));
+	}
+    }
+
+    void YM2413xN::init_tables()
+    {
+	for (int i = 0; i < 256; i++)
+	{
+	    double phase_normalized = (double((i << 1) + 1) / 512.f);
+	    double sine_result_normalized = sin(phase_normalized * (M_PI / 2));
+
+	    double sine_result_as_att = -log(sine_result_normalized) / log(2.0);
+
+	    uint32_t sine_result = uint32_t((sine_result_as_att * 256.f) + 0.5);
+	    sine_table[i] = sine_result;
+	}
+
+	for (int i = 0; i < 256; i++)
+	{
+	    double entry_normalized = (double(i + 1) / 256.f);
+	    double res_normalized = pow(2, -entry_normalized);
+
+	    uint32_t result = uint32_t((res_normalized * 2048.f) + 0.5);
+	    exp_table[i] = result;
+	}
+
+    }
+
+    void YM2413xN::update_frequency(size_t lane, int ch)
+    {
+	size_t ch_idx = ch_index(ch, lane);
+
+	for (int oper = (ch * 2); oper < ((ch * 2) + 2); oper++)
+	{
+	    size_t index = oper_index(oper, lane);
+	    opers.freq_num[index] = channels.freq_num[ch_idx];
+	    opers.block[index] = channels.block[ch_idx];
+	    update_total_level(lane, oper);
+	    update_rks(lane, oper);
+	}
+    }
+
+    void YM2413xN::update_total_level(size_t lane, int oper)
+    {
+	size_t index = oper_index(oper, lane);
+	int block = opers.block[index];
+	int ksl = opers.ksl[index];
+
+	int temp_ksl = 16 * block - ksl_table[(opers.freq_num[index] >> 5)];
+	int ksl_val = (ksl == 0) ? 0 : (max(0, temp_ksl) >> (3 - ksl));
+
+	if (testbit(oper, 0) || opers.is_rhythm[index])
+	{
+	    opers.tll_val[index] = ((opers.volume[index] << 3) + ksl_val);
+	}
+	else
+	{
+	    opers.tll_val[index] = ((opers.total_level[index] << 1) + ksl_val);
+	}
+    }
+
+    void YM2413xN::update_rks(size_t lane, int oper)
+    {
+	size_t index = oper_index(oper, lane);
+	int block_fnum = ((opers.block[index] << 1) | (opers.freq_num[index] >> 8));
+	opers.rks_val[index] = (opers.is_ksr[index]) ? block_fnum : (block_fnum >> 2);
+	calc_oper_rate(lane, oper);
+    }
+
+    void YM2413xN::calc_oper_rate(size_t lane, int oper)
+    {
+	size_t index = oper_index(oper, lane);
+	int p_rate = 0;
+
+	if ((!testbit(oper, 0) && !opers.is_rhythm[index]) && !opers.is_keyon[index])
+	{
+	    p_rate = 0;
+	}
+	else
+	{
+	    switch (opers.env_state[index])
+	    {
+		case opll_oper_state::Damp: p_rate = 12; break; // Damper speed before key-on is 12
+		case opll_oper_state::Attack: p_rate = opers.attack_rate[index]; break;
+		case opll_oper_state::Decay: p_rate = opers.decay_rate[index]; break;
+		case opll_oper_state::Sustain: p_rate = (opers.is_sustained[index]) ? 0 : opers.release_rate[index]; break;
+		case opll_oper_state::Release:
+		{
+		    if (opers.sustain_flag[index])
+		    {
+			p_rate = 5;
+		    }
+		    else if (opers.is_sustained[index])
+		    {
+			p_rate = opers.release_rate[index];
+		    }
+		    else
+		    {
+			p_rate = 7;
+		    }
+		}
+		break;
+		default: break;
+	    }
+	}
+
+	opers.env_rate[index] = calc_rate(p_rate, opers.rks_val[index]);
+    }
+
+    void YM2413xN::update_sus_flag(size_t lane, int ch, bool flag)
+    {
+	opers.sustain_flag[oper_index((ch * 2), lane)] = flag;
+	opers.sustain_flag[oper_index(((ch * 2) + 1), lane)] = flag;
+    }
+
+    void YM2413xN::update_key_status(size_t lane, int oper, bool val)
+    {
+	if (val == true)
+	{
+	    key_on(lane, oper);
+	}
+	else
+	{
+	    key_off(lane, oper);
+	}
+    }
+
+    void YM2413xN::key_on(size_t lane, int oper)
+    {
+	size_t index = oper_index(oper, lane);
+
+	if (!opers.is_keyon[index])
+	{
+	    opers.is_keyon[index] = true;
+	    opers.env_state[index] = opll_oper_state::Damp;
+	    calc_oper_rate(lane, oper);
+	}
+    }
+
+    void YM2413xN::key_off(size_t lane, int oper)
+    {
+	size_t index = oper_index(oper, lane);
+
+	if (opers.is_keyon[index])
+	{
+	    opers.is_keyon[index] = false;
+
+	    if (testbit(oper, 0) || opers.is_rhythm[index])
+	    {
+		if (opers.env_state[index] < opll_oper_state::Release)
+		{
+		    opers.env_state[index] = opll_oper_state::Release;
+		    calc_oper_rate(lane, oper);
+		}
+	    }
+	}
+    }
+
+    void YM2413xN::set_patch(size_t lane, int ch, int patch_index)
+    {
+	channels.inst_number[ch_index(ch, lane)] = patch_index;
+	update_instrument(lane, ch);
+    }
+
+    void YM2413xN::update_instrument(size_t lane, int ch)
+    {
+	auto &patch_values = inst_patches[lane][channels.inst_number[ch_index(ch, lane)]];
+	size_t mod = oper_index((ch * 2), lane);
+	size_t car = oper_index(((ch * 2) + 1), lane);
+
+	opers.is_am[mod] = testbit(patch_values[0], 7);
+	opers.is_vibrato[mod] = testbit(patch_values[0], 6);
+	opers.is_sustained[mod] = testbit(patch_values[0], 5);
+	opers.is_ksr[mod] = testbit(patch_values[0], 4);
+	opers.multiply[mod] = (patch_values[0] & 0xF);
+	opers.is_am[car] = testbit(patch_values[1], 7);
+	opers.is_vibrato[car] = testbit(patch_values[1], 6);
+	opers.is_sustained[car] = testbit(patch_values[1], 5);
+	opers.is_ksr[car] = testbit(patch_values[1], 4);
+	opers.multiply[car] = (patch_values[1] & 0xF);
+	opers.ksl[mod] = (patch_values[2] >> 6);
+	opers.total_level[mod] = (patch_values[2] & 0x3F);
+	opers.ksl[car] = (patch_values[3] >> 6);
+	opers.is_ws[car] = testbit(patch_values[3], 4);
+	opers.is_ws[mod] = testbit(patch_values[3], 3);
+	channels.feedback[ch_index(ch, lane)] = (patch_values[3] & 0x7);
+	opers.attack_rate[mod] = (patch_values[4] >> 4);
+	opers.decay_rate[mod] = (patch_values[4] & 0xF);
+	opers.attack_rate[car] = (patch_values[5] >> 4);
+	opers.decay_rate[car] = (patch_values[5] & 0xF);
+	opers.sustain_level[mod] = ((patch_values[6] >> 4) << 3);
+	opers.release_rate[mod] = (patch_values[6] & 0xF);
+	opers.sustain_level[car] = ((patch_values[7] >> 4) << 3);
+	opers.release_rate[car] = (patch_values[7] & 0xF);
+
+	for (int oper = (ch * 2); oper < ((ch * 2) + 2); oper++)
+	{
+	    update_total_level(lane, oper);
+	    update_rks(lane, oper);
+	}
+    }
+
+    void YM2413xN::set_rhythm_mode(size_t lane, bool val)
+    {
+	// Operators 14 and 17 are the high-hat and top cymbal,
+	// which keep their phase on key-on
+	for (int oper = 14; oper < 18; oper++)
+	{
+	    size_t index = oper_index(oper, lane);
+	    opers.is_rhythm[index] = val;
+	    opers.phase_keep[index] = (val && ((oper == 14) || (oper == 17)));
+	}
+
+	chips.is_rhythm_enabled[lane] = val;
+    }
+
+    void YM2413xN::write_reg(size_t lane, uint8_t reg, uint8_t data)
+    {
+	int reg_group = (reg & 0xF0);
+	int reg_addr = (reg & 0xF);
+
+	switch (reg_group)
+	{
+	    case 0x00:
+	    {
+		if (reg_addr <= 0x07)
+		{
+		    inst_patches[lane][0][reg_addr] = data;
+
+		    for (int ch = 0; ch < 9; ch++)
+		    {
+			if (channels.inst_number[ch_index(ch, lane)] == 0)
+			{
+			    update_instrument(lane, ch);
+			}
+		    }
+		}
+		else if (reg_addr == 0x0E)
+		{
+		    bool rhythm_enable = testbit(data, 5);
+
+		    if (rhythm_enable && !chips.is_rhythm_enabled[lane])
+		    {
+			set_patch(lane, 6, 16);
+			set_rhythm_mode(lane, true);
+			set_patch(lane, 7, 17);
+			set_patch(lane, 8, 18);
+
+			for (int ch = 7; ch <= 8; ch++)
+			{
+			    opers.volume[oper_index((ch * 2), lane)] = (channels.inst_vol_reg[ch_index(ch, lane)] >> 4);
+			    update_total_level(lane, (ch * 2));
+			}
+		    }
+		    else if (!rhythm_enable && chips.is_rhythm_enabled[lane])
+		    {
+			set_rhythm_mode(lane, false);
+
+			for (int ch = 6; ch <= 8; ch++)
+			{
+			    set_patch(lane, ch, (channels.inst_vol_reg[ch_index(ch, lane)] >> 4));
+			}
+		    }
+
+		    update_key_status(lane, 12, (rhythm_enable && testbit(data, 4)));
+		    update_key_status(lane, 13, (rhythm_enable && testbit(data, 4)));
+		    update_key_status(lane, 14, (rhythm_enable && testbit(data, 0)));
+		    update_key_status(lane, 15, (rhythm_enable && testbit(data, 3)));
+		    update_key_status(lane, 16, (rhythm_enable && testbit(data, 2)));
+		    update_key_status(lane, 17, (rhythm_enable && testbit(data, 1)));
+		}
+	    }
+	    break;
+	    case 0x10:
+	    {
+		if (reg_addr >= 9)
+		{
+		    // Verified on a real YM2413
+		    reg_addr -= 9;
+		}
+
+		size_t ch_idx = ch_index(reg_addr, lane);
+		channels.freq_num[ch_idx] = ((channels.freq_num[ch_idx] & 0x100) | data);
+		update_frequency(lane, reg_addr);
+	    }
+	    break;
+	    case 0x20:
+	    {
+		if (reg_addr >= 9)
+		{
+		    // Verified on a real YM2413
+		    reg_addr -= 9;
+		}
+
+		size_t ch_idx = ch_index(reg_addr, lane);
+		channels.freq_num[ch_idx] = ((channels.freq_num[ch_idx] & 0xFF) | ((data & 0x1) << 8));
+		channels.block[ch_idx] = ((data >> 1) & 0x7);
+		update_frequency(lane, reg_addr);
+		update_key_status(lane, (reg_addr * 2), testbit(data, 4));
+		update_key_status(lane, ((reg_addr * 2) + 1), testbit(data, 4));
+		update_sus_flag(lane, reg_addr, testbit(data, 5));
+	    }
+	    break;
+	    case 0x30:
+	    {
+		if (reg_addr >= 9)
+		{
+		    // Verified on a real YM2413
+		    reg_addr -= 9;
+		}
+
+		channels.inst_vol_reg[ch_index(reg_addr, lane)] = data;
+
+		if (chips.is_rhythm_enabled[lane] && (reg_addr >= 6))
+		{
+		    if (reg_addr >= 7)
+		    {
+			opers.volume[oper_index((reg_addr * 2), lane)] = (data >> 4);
+			update_total_level(lane, (reg_addr * 2));
+		    }
+		}
+		else
+		{
+		    set_patch(lane, reg_addr, (data >> 4));
+		}
+
+		opers.volume[oper_index(((reg_addr * 2) + 1), lane)] = (data & 0xF);
+		update_total_level(lane, ((reg_addr * 2) + 1));
+	    }
+	    break;
+	}
+    }
+
+    void YM2413xN::write_port(size_t lane, int port, uint8_t data)
+    {
+	if ((port & 1) == 0)
+	{
+	    chips.chip_address[lane] = data;
+	}
+	else
+	{
+	    write_reg(lane, chips.chip_address[lane], data);
+	}
+    }
+
+    void YM2413xN::clock_ampm()
+    {
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    chips.env_clock[lane] += 1;
+	    chips.am_clock[lane] += 1;
+	    chips.pm_clock[lane] += 1;
+	    chips.lfo_am[lane] = am_table[((chips.am_clock[lane] >> 6) % 210)];
+	}
+    }
+
+    void YM2413xN::clock_short_noise()
+    {
+	const uint32_t *phase_hihat = &opers.phase_output[oper_index(14, 0)];
+	const uint32_t *phase_cymbal = &opers.phase_output[oper_index(17, 0)];
+
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    uint32_t h_bits = phase_hihat[lane];
+	    uint32_t c_bits = phase_cymbal[lane];
+
+	    uint32_t noise_bits = ((h_bits >> 2) ^ (h_bits >> 7)) | ((h_bits >> 3) ^ (c_bits >> 5)) | ((c_bits >> 3) ^ (c_bits >> 5));
+	    chips.short_noise[lane] = (noise_bits & 1);
+	}
+    }
+
+    void YM2413xN::clock_phase(int oper)
+    {
+	size_t base = oper_index(oper, 0);
+
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    size_t index = (base + lane);
+	    uint32_t freq_num = opers.freq_num[index];
+	    int32_t pitch_mod = (opers.is_vibrato[index]) ? pm_table[((freq_num >> 6) & 7)][((chips.pm_clock[lane] >> 10) & 7)] : 0;
+	    uint32_t phase_level = (freq_num * 2 + pitch_mod);
+	    int multiply = mul_table[opers.multiply[index]];
+	    uint32_t phase_freq = (((phase_level * multiply) << opers.block[index]) >> 2);
+
+	    opers.phase_counter[index] = ((opers.phase_counter[index] + phase_freq) & 0x7FFFF);
+	    opers.phase_output[index] = (opers.phase_counter[index] >> 9);
+	}
+    }
+
+    void YM2413xN::clock_envelope(int oper)
+    {
+	bool is_carrier = testbit(oper, 0);
+	size_t base = oper_index(oper, 0);
+	size_t pair_base = oper_index((oper ^ 1), 0);
+
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    size_t index = (base + lane);
+	    int env_state = opers.env_state[index];
+
+	    if (env_state == opll_oper_state::Off)
+	    {
+		continue;
+	    }
+
+	    uint32_t env_clock = chips.env_clock[lane];
+	    int env_rate = opers.env_rate[index];
+	    uint32_t counter_shift_val = counter_shift_table[env_rate];
+	    int shift_mask = ((1 << counter_shift_val) - 1);
+
+	    bool is_attack = (env_state == opll_oper_state::Attack);
+	    int eg_mask = is_attack ? (shift_mask & ~3) : shift_mask;
+
+	    if ((env_clock & eg_mask) != 0)
+	    {
+		continue;
+	    }
+
+	    int update_cycle = ((env_clock >> counter_shift_val) & 0xF);
+	    int atten_inc = is_attack ? att_inc_attack[env_rate][update_cycle] : att_inc_decay[env_rate][update_cycle];
+	    int32_t &env_output = opers.env_output[index];
+
+	    switch (env_state)
+	    {
+		case opll_oper_state::Damp:
+		{
+		    env_output += atten_inc;
+
+		    if (env_output >= 124)
+		    {
+			if (calc_rate(opers.attack_rate[index], opers.rks_val[index]) >= 60)
+			{
+			    env_output = 0;
+			    opers.env_state[index] = (opers.sustain_level[index] == 0) ? opll_oper_state::Sustain : opll_oper_state::Decay;
+			}
+			else
+			{
+			    env_output = 127;
+			    opers.env_state[index] = opll_oper_state::Attack;
+			}
+
+			if (is_carrier || opers.is_rhythm[index])
+			{
+			    if (!opers.is_rhythm[index])
+			    {
+				// If the operator's not in rhythm mode,
+				// reset both of the channel's operators'
+				// phase counters
+				size_t pair_index = (pair_base + lane);
+
+				if (!opers.phase_keep[pair_index])
+				{
+				    opers.phase_counter[pair_index] = 0;
+				}
+			    }
+
+			    if (!opers.phase_keep[index])
+			    {
+				opers.phase_counter[index] = 0;
+			    }
+			}
+
+			calc_oper_rate(lane, oper);
+		    }
+		}
+		break;
+		case opll_oper_state::Attack:
+		{
+		    env_output += ((~env_output * atten_inc) >> 4);
+
+		    if (env_output <= 0)
+		    {
+			env_output = 0;
+			opers.env_state[index] = opll_oper_state::Decay;
+			calc_oper_rate(lane, oper);
+		    }
+		}
+		break;
+		case opll_oper_state::Decay:
+		{
+		    env_output += atten_inc;
+
+		    if (env_output >= opers.sustain_level[index])
+		    {
+			opers.env_state[index] = opll_oper_state::Sustain;
+			calc_oper_rate(lane, oper);
+		    }
+		}
+		break;
+		case opll_oper_state::Sustain:
+		{
+		    env_output += atten_inc;
+
+		    if (env_output >= 124)
+		    {
+			env_output = 127;
+		    }
+		}
+		break;
+		case opll_oper_state::Release:
+		{
+		    env_output += atten_inc;
+
+		    if (env_output >= 124)
+		    {
+			env_output = 127;
+			opers.env_state[index] = opll_oper_state::Off;
+		    }
+		}
+		break;
+		default: break;
+	    }
+	}
+    }
+
+    // Updates the output of a channel for every lane with lane_enable set,
+    // while leaving the others untouched (as the YM2413 core does for masked channels)
+    void YM2413xN::channel_output(int ch)
+    {
+	size_t mod_base = oper_index((ch * 2), 0);
+	size_t car_base = oper_index(((ch * 2) + 1), 0);
+	size_t ch_base = ch_index(ch, 0);
+
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    size_t mod = (mod_base + lane);
+	    size_t car = (car_base + lane);
+	    bool is_enabled = lane_enable[lane];
+
+	    int32_t feedback_shift = channels.feedback[ch_base + lane];
+	    int32_t mod_sum = (opers.output0[mod] + opers.output1[mod]);
+	    int32_t feedback = (feedback_shift != 0) ? (mod_sum >> (10 - feedback_shift)) : 0;
+
+	    int32_t lfo_am = chips.lfo_am[lane];
+
+	    uint32_t mod_env = (opers.env_output[mod] + opers.tll_val[mod] + (opers.is_am[mod] ? lfo_am : 0));
+	    int32_t mod_output = calc_output(opers.phase_output[mod], feedback, mod_env, opers.is_ws[mod]);
+
+	    int32_t phase_mod = ((mod_output >> 1) & 0x3FF);
+
+	    uint32_t car_env = (opers.env_output[car] + opers.tll_val[car] + (opers.is_am[car] ? lfo_am : 0));
+	    int32_t car_output = calc_output(opers.phase_output[car], phase_mod, car_env, opers.is_ws[car]);
+
+	    opers.output1[mod] = is_enabled ? opers.output0[mod] : opers.output1[mod];
+	    opers.output0[mod] = is_enabled ? mod_output : opers.output0[mod];
+	    channels.output[ch_base + lane] = is_enabled ? (car_output >> 5) : channels.output[ch_base + lane];
+	}
+    }
+
+    void YM2413xN::rhythm_output(size_t lane)
+    {
+	uint32_t mask = chips.channel_mask[lane];
+	bool noise_bit = testbit(chips.noise_lfsr[lane], 0);
+	bool short_noise = chips.short_noise[lane];
+
+	size_t hihat = oper_index(14, lane);
+	size_t snare = oper_index(15, lane);
+	size_t tom = oper_index(16, lane);
+	size_t cymbal = oper_index(17, lane);
+
+	if (!testbit(mask, 9))
+	{
+	    uint32_t phase = 0;
+
+	    if (short_noise)
+	    {
+		phase = noise_bit ? 0x2D0 : 0x234;
+	    }
+	    else
+	    {
+		phase = noise_bit ? 0x34 : 0xD0;
+	    }
+
+	    uint32_t rhythm_env = (opers.env_output[hihat] + opers.tll_val[hihat]);
+	    opers.rhythm_output[hihat] = (calc_output(phase, 0, rhythm_env, opers.is_ws[hihat]) >> 5);
+	}
+
+	if (!testbit(mask, 12))
+	{
+	    uint32_t phase = 0;
+
+	    if (testbit(opers.phase_output[snare], 8))
+	    {
+		phase = noise_bit ? 0x300 : 0x200;
+	    }
+	    else
+	    {
+		phase = noise_bit ? 0 : 0x100;
+	    }
+
+	    uint32_t rhythm_env = (opers.env_output[snare] + opers.tll_val[snare]);
+	    opers.rhythm_output[snare] = (calc_output(phase, 0, rhythm_env, opers.is_ws[snare]) >> 5);
+	}
+
+	int32_t ch7_output = (opers.rhythm_output[hihat] + opers.rhythm_output[snare]);
+	channels.output[ch_index(7, lane)] = (clamp(ch7_output, -257, 256) * 2);
+
+	if (!testbit(mask, 11))
+	{
+	    uint32_t rhythm_env = (opers.env_output[tom] + opers.tll_val[tom]);
+	    opers.rhythm_output[tom] = (calc_output(opers.phase_output[tom], 0, rhythm_env, opers.is_ws[tom]) >> 5);
+	}
+
+	if (!testbit(mask, 10))
+	{
+	    uint32_t phase = short_noise ? 0x300 : 0x100;
+	    uint32_t rhythm_env = (opers.env_output[cymbal] + opers.tll_val[cymbal]);
+	    opers.rhythm_output[cymbal] = (calc_output(phase, 0, rhythm_env, opers.is_ws[cymbal]) >> 5);
+	}
+
+	int32_t ch8_output = (opers.rhythm_output[tom] + opers.rhythm_output[cymbal]);
+	channels.output[ch_index(8, lane)] = (clamp(ch8_output, -257, 256) * 2);
+    }
+
+    void YM2413xN::clock_noise(size_t lane)
+    {
+	// The noise is only read in rhythm mode, so outside of it,
+	// both of the per-sample steps are just counted (see opl_noise.h)
+	if (!chips.is_rhythm_enabled[lane])
+	{
+	    BeeNukedOPLNoise::skip(chips.noise_cycles[lane], 18);
+	    return;
+	}
+
+	chips.noise_lfsr[lane] = BeeNukedOPLNoise::sync(chips.noise_lfsr[lane], chips.noise_cycles[lane]);
+	chips.noise_lfsr[lane] = BeeNukedOPLNoise::jump14(chips.noise_lfsr[lane]);
+    }
+
+    void YM2413xN::clockchips()
+    {
+	clock_ampm();
+	clock_short_noise();
+
+	for (int oper = 0; oper < 18; oper++)
+	{
+	    clock_phase(oper);
+	    clock_envelope(oper);
+	}
+
+	for (int ch = 0; ch < 6; ch++)
+	{
+	    for (size_t lane = 0; lane < lane_count; lane++)
+	    {
+		lane_enable[lane] = !testbit(chips.channel_mask[lane], ch);
+	    }
+
+	    channel_output(ch);
+	}
+
+	// VRC7 has no rhythm channels, compared to OPLL
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    int mask_bit = chips.is_rhythm_enabled[lane] ? 13 : 6;
+	    lane_enable[lane] = (!chips.is_vrc7[lane] && !testbit(chips.channel_mask[lane], mask_bit));
+	}
+
+	channel_output(6);
+
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    if (lane_enable[lane] && chips.is_rhythm_enabled[lane])
+	    {
+		channels.output[ch_index(6, lane)] *= 2;
+	    }
+	}
+
+	for (int ch = 7; ch < 9; ch++)
+	{
+	    for (size_t lane = 0; lane < lane_count; lane++)
+	    {
+		lane_enable[lane] = (!chips.is_vrc7[lane] && !chips.is_rhythm_enabled[lane] && !testbit(chips.channel_mask[lane], ch));
+	    }
+
+	    channel_output(ch);
+	}
+
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    if (chips.is_vrc7[lane])
+	    {
+		continue;
+	    }
+
+	    clock_noise(lane);
+
+	    if (chips.is_rhythm_enabled[lane])
+	    {
+		rhythm_output(lane);
+		chips.noise_lfsr[lane] = BeeNukedOPLNoise::jump4(chips.noise_lfsr[lane]);
+	    }
+	}
+    }
+
+    void YM2413xN::mix_output()
+    {
+	for (size_t chip = 0; chip < chip_count; chip++)
+	{
+	    int32_t output = 0;
+
+	    for (int ch = 0; ch < 9; ch++)
+	    {
+		output += channels.output[ch_index(ch, chip)];
+	    }
+
+	    sample_buffers[chip].push_back(((output * 128) / 9));
+	}
+    }
+
+    void YM2413xN::apply_writes(size_t chip, uint32_t sample)
+    {
+	auto &queue = write_queues[chip];
+
+	while (!queue.empty() && (queue.front().offset <= sample))
+	{
+	    write_port(chip, queue.front().port, queue.front().data);
+	    queue.pop_front();
+	}
+    }
+
+    uint32_t YM2413xN::get_sample_rate(uint32_t clock_rate)
+    {
+	return (clock_rate / 72);
+    }
+
+    void YM2413xN::init(size_t num_chips, OPLLType type)
+    {
+	chip_count = num_chips;
+	// Pad the lane count to a whole number of 8-lane vectors
+	lane_count = ((num_chips + 7) & ~size_t(7));
+
+	init_tables();
+
+	opers.for_each([&](auto &field) { field.assign((18 * lane_count), 0); });
+	channels.for_each([&](auto &field) { field.assign((9 * lane_count), 0); });
+	chips.for_each([&](auto &field) { field.assign(lane_count, 0); });
+	inst_patches.assign(lane_count, ym2413_instruments);
+	lane_enable.assign(lane_count, 0);
+
+	write_queues.assign(chip_count, deque<opll_write>());
+	sample_buffers.assign(chip_count, vector<int32_t>());
+
+	for (size_t lane = 0; lane < lane_count; lane++)
+	{
+	    reset_lane(lane, type);
+	}
+    }
+
+    void YM2413xN::reset_chip(size_t chip, OPLLType type)
+    {
+	check_chip(chip);
+	write_queues[chip].clear();
+	reset_lane(chip, type);
+    }
+
+    void YM2413xN::reset_lane(size_t lane, OPLLType type)
+    {
+	for (int oper = 0; oper < 18; oper++)
+	{
+	    size_t index = oper_index(oper, lane);
+	    opers.for_each([&](auto &field) { field[index] = 0; });
+	    opers.env_output[index] = 127;
+	    opers.env_state[index] = opll_oper_state::Off;
+	}
+
+	for (int ch = 0; ch < 9; ch++)
+	{
+	    size_t index = ch_index(ch, lane);
+	    channels.for_each([&](auto &field) { field[index] = 0; });
+	}
+
+	chips.for_each([&](auto &field) { field[lane] = 0; });
+	chips.noise_lfsr[lane] = 1;
+	chips.is_vrc7[lane] = (type == VRC7_Chip);
+
+	switch (type)
+	{
+	    case YM2413_Chip: inst_patches[lane] = ym2413_instruments; break;
+	    case VRC7_Chip: inst_patches[lane] = vrc7_instruments; break;
+	    case YM2423_Chip: inst_patches[lane] = ym2423_instruments; break;
+	    case YMF281_Chip: inst_patches[lane] = ymf281_instruments; break;
+	    default: inst_patches[lane] = ym2413_instruments; break;
+	}
+    }
+
+    size_t YM2413xN::get_num_chips()
+    {
+	return chip_count;
+    }
+
+    void YM2413xN::writeIO(size_t chip, int port, uint8_t data, uint32_t offset)
+    {
+	check_chip(chip);
+
+	opll_write write;
+	write.offset = offset;
+	write.port = port;
+	write.data = data;
+
+	// Keep the queue sorted by offset, placing the write after any others with the same offset
+	auto &queue = write_queues[chip];
+	auto it = upper_bound(queue.begin(), queue.end(), offset, [](uint32_t offset, const opll_write &queued)
+	{
+	    return (offset < queued.offset);
+	});
+
+	queue.insert(it, write);
+    }
+
+    void YM2413xN::render(size_t num_samples)
+    {
+	for (auto &buffer : sample_buffers)
+	{
+	    buffer.clear();
+	    buffer.reserve(num_samples);
+	}
+
+	for (size_t sample = 0; sample < num_samples; sample++)
+	{
+	    for (size_t chip = 0; chip < chip_count; chip++)
+	    {
+		apply_writes(chip, sample);
+	    }
+
+	    clockchips();
+	    mix_output();
+	}
+
+	// Writes scheduled past the end of this block carry over to the next one
+	for (auto &queue : write_queues)
+	{
+	    for (auto &write : queue)
+	    {
+		write.offset = (write.offset > num_samples) ? (write.offset - num_samples) : 0;
+	    }
+	}
+    }
+
+    const vector<int32_t> &YM2413xN::get_samples(size_t chip)
+    {
+	check_chip(chip);
+	return sample_buffers[chip];
+    }
+
+    uint32_t YM2413xN::set_mask(size_t chip, uint32_t mask)
+    {
+	check_chip(chip);
+	uint32_t ret = chips.channel_mask[chip];
+	chips.channel_mask[chip] = mask;
+	return ret;
+    }
+
+    uint32_t YM2413xN::toggle_mask(size_t chip, uint32_t mask)
+    {
+	check_chip(chip);
+	uint32_t ret = chips.channel_mask[chip];
+	chips.channel_mask[chip] = (ret ^ mask);
+	return ret;
+    }
+}
\ No newline at end of file
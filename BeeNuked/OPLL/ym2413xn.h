@@ -0,0 +1,278 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_YM2413XN
+#define BEENUKED_YM2413XN
+
+#include <deque>
+#include "ym2413.h"
+
+namespace beenuked
+{
+    // Renders many independent YM2413 chips at once.
+    //
+    // Every chip occupies one lane, and each piece of operator, channel and chip state
+    // is stored lane-contiguously, so the per-sample loops run across chips
+    // rather than across operators. The lane count is padded to a multiple of 8,
+    // so each loop covers whole 256-bit vectors of 32-bit values.
+    //
+    // Each lane produces the exact same output as a standalone YM2413.
+    class YM2413xN
+    {
+	public:
+	    YM2413xN();
+	    ~YM2413xN();
+
+	    uint32_t get_sample_rate(uint32_t clock_rate);
+	    void init(size_t num_chips, OPLLType type = YM2413_Chip);
+	    void reset_chip(size_t chip, OPLLType type = YM2413_Chip);
+	    size_t get_num_chips();
+
+	    // Queues a port write for a chip, to be applied right before
+	    // sample number 'offset' of the next call to render()
+	    // Writes can be queued in any order; writes with the same offset
+	    // are applied in the order they were queued
+	    void writeIO(size_t chip, int port, uint8_t data, uint32_t offset = 0);
+
+	    // Renders a block of samples for every chip
+	    void render(size_t num_samples);
+
+	    // Samples produced for a chip by the last call to render()
+	    const vector<int32_t> &get_samples(size_t chip);
+
+	    uint32_t set_mask(size_t chip, uint32_t mask);
+	    uint32_t toggle_mask(size_t chip, uint32_t mask);
+
+	private:
+	    template<typename T>
+	    bool testbit(T reg, int bit)
+	    {
+		return ((reg >> bit) & 1) ? true : false;
+	    }
+
+	    void check_chip(size_t chip)
+	    {
+		if (chip >= chip_count)
+		{
+		    throw out_of_range("Invalid chip number");
+		}
+	    }
+
+	    size_t chip_count = 0;
+	    size_t lane_count = 0;
+
+	    size_t oper_index(int oper, size_t lane)
+	    {
+		return ((oper * lane_count) + lane);
+	    }
+
+	    size_t ch_index(int ch, size_t lane)
+	    {
+		return ((ch * lane_count) + lane);
+	    }
+
+	    array<uint32_t, 256> sine_table;
+	    array<uint32_t, 256> exp_table;
+
+	    typedef array<uint8_t, 8> opll_inst;
+	    typedef array<opll_inst, 19> opll_patch;
+
+	    #include "opll_tables.inl"
+
+	    enum opll_oper_state : int
+	    {
+		Damp = 0,
+		Attack = 1,
+		Decay = 2,
+		Sustain = 3,
+		Release = 4,
+		Off = 5
+	    };
+
+	    // Operator state, indexed by oper_index()
+	    // (operator 2n is channel n's modulator, 2n + 1 is its carrier)
+	    struct opll_operator_lanes
+	    {
+		vector<uint32_t> freq_num;
+		vector<int32_t> block;
+
+		vector<int32_t> is_am;
+		vector<int32_t> is_vibrato;
+		vector<int32_t> is_ws;
+
+		vector<int32_t> multiply;
+		vector<int32_t> ksl;
+		vector<int32_t> total_level;
+		vector<int32_t> volume;
+		vector<int32_t> tll_val;
+		vector<int32_t> rks_val;
+
+		vector<int32_t> is_ksr;
+		vector<int32_t> is_keyon;
+		vector<int32_t> is_rhythm;
+		vector<int32_t> phase_keep;
+
+		vector<int32_t> is_sustained;
+		vector<int32_t> sustain_flag;
+
+		vector<int32_t> attack_rate;
+		vector<int32_t> decay_rate;
+		vector<int32_t> sustain_level;
+		vector<int32_t> release_rate;
+
+		vector<int32_t> env_output;
+		vector<int32_t> env_rate;
+		vector<int32_t> env_state;
+
+		vector<uint32_t> phase_counter;
+		vector<uint32_t> phase_output;
+		vector<int32_t> rhythm_output;
+		vector<int32_t> output0;
+		vector<int32_t> output1;
+
+		template<typename Func>
+		void for_each(Func func)
+		{
+		    func(freq_num); func(block);
+		    func(is_am); func(is_vibrato); func(is_ws);
+		    func(multiply); func(ksl); func(total_level); func(volume); func(tll_val); func(rks_val);
+		    func(is_ksr); func(is_keyon); func(is_rhythm); func(phase_keep);
+		    func(is_sustained); func(sustain_flag);
+		    func(attack_rate); func(decay_rate); func(sustain_level); func(release_rate);
+		    func(env_output); func(env_rate); func(env_state);
+		    func(phase_counter); func(phase_output); func(rhythm_output); func(output0); func(output1);
+		}
+	    };
+
+	    // Channel state, indexed by ch_index()
+	    struct opll_channel_lanes
+	    {
+		vector<uint32_t> freq_num;
+		vector<int32_t> block;
+		vector<int32_t> feedback;
+		vector<uint8_t> inst_vol_reg;
+		vector<int32_t> inst_number;
+		vector<int32_t> output;
+
+		template<typename Func>
+		void for_each(Func func)
+		{
+		    func(freq_num); func(block); func(feedback);
+		    func(inst_vol_reg); func(inst_number); func(output);
+		}
+	    };
+
+	    // Per-chip state, indexed by lane
+	    struct opll_chip_lanes
+	    {
+		vector<uint8_t> chip_address;
+		vector<uint32_t> channel_mask;
+		vector<uint32_t> env_clock;
+		vector<uint32_t> am_clock;
+		vector<uint32_t> pm_clock;
+		vector<int32_t> lfo_am;
+		vector<uint32_t> noise_lfsr;
+		vector<uint32_t> noise_cycles;
+		vector<int32_t> short_noise;
+		vector<int32_t> is_rhythm_enabled;
+		vector<int32_t> is_vrc7;
+
+		template<typename Func>
+		void for_each(Func func)
+		{
+		    func(chip_address); func(channel_mask);
+		    func(env_clock); func(am_clock); func(pm_clock); func(lfo_am);
+		    func(noise_lfsr); func(noise_cycles); func(short_noise);
+		    func(is_rhythm_enabled); func(is_vrc7);
+		}
+	    };
+
+	    opll_operator_lanes opers;
+	    opll_channel_lanes channels;
+	    opll_chip_lanes chips;
+	    vector<opll_patch> inst_patches;
+
+	    // Scratch flags, set for every lane whose channel output gets updated
+	    vector<int32_t> lane_enable;
+
+	    struct opll_write
+	    {
+		uint32_t offset = 0;
+		uint8_t port = 0;
+		uint8_t data = 0;
+	    };
+
+	    vector<deque<opll_write>> write_queues;
+	    vector<vector<int32_t>> sample_buffers;
+
+	    void init_tables();
+	    void reset_lane(size_t lane, OPLLType type);
+
+	    void apply_writes(size_t chip, uint32_t sample);
+	    void write_port(size_t lane, int port, uint8_t data);
+	    void write_reg(size_t lane, uint8_t reg, uint8_t data);
+
+	    int calc_rate(int p_rate, int rks);
+
+	    int32_t calc_output(uint32_t phase, int32_t mod, uint32_t env, int32_t is_ws)
+	    {
+		uint32_t atten = min<uint32_t>(127, env);
+
+		uint32_t combined_phase = ((phase + mod) & 0x3FF);
+		uint32_t sign_bit = ((combined_phase >> 9) & 1);
+		uint32_t quarter_phase = testbit(combined_phase, 8) ? (~combined_phase & 0xFF) : (combined_phase & 0xFF);
+
+		bool is_half_wave = (sign_bit && is_ws);
+		bool is_negate = (sign_bit && !is_ws);
+
+		uint32_t sine_result = is_half_wave ? 0xFFF : sine_table[quarter_phase];
+		uint32_t combined_atten = ((sine_result + (atten << 4)) & 0x1FFF);
+
+		int shift_count = ((combined_atten >> 8) & 0x1F);
+		int32_t exp_output = int32_t((exp_table[(combined_atten & 0xFF)] << 2) >> shift_count);
+		return is_negate ? -exp_output : exp_output;
+	    }
+
+	    void update_frequency(size_t lane, int ch);
+	    void update_total_level(size_t lane, int oper);
+	    void update_rks(size_t lane, int oper);
+	    void calc_oper_rate(size_t lane, int oper);
+
+	    void key_on(size_t lane, int oper);
+	    void key_off(size_t lane, int oper);
+	    void update_key_status(size_t lane, int oper, bool val);
+	    void update_sus_flag(size_t lane, int ch, bool flag);
+
+	    void set_patch(size_t lane, int ch, int patch_index);
+	    void update_instrument(size_t lane, int ch);
+	    void set_rhythm_mode(size_t lane, bool val);
+
+	    void clockchips();
+	    void clock_ampm();
+	    void clock_short_noise();
+	    void clock_phase(int oper);
+	    void clock_envelope(int oper);
+	    void channel_output(int ch);
+	    void rhythm_output(size_t lane);
+	    void mix_output();
+
+	    void clock_noise(size_t lane);
+    };
+};
+
+#endif // BEENUKED_YM2413XN
\ No newline at end of file
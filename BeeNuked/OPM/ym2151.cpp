@@ -310,6 +310,7 @@ namespace beenuked
 	if (!oper.is_keyon)
 	{
 	    oper.is_keyon = true;
+	    BEENUKED_PROFILE_KEY_ON();
 	    start_envelope(oper);
 	    oper.phase_counter = 0;
 	}
@@ -885,6 +886,7 @@ namespace beenuked
 	}
 	else
 	{
+	    BEENUKED_PROFILE_WRITE(chip_address);
 	    write_reg(chip_address, data);
 	}
     }
@@ -901,8 +903,13 @@ namespace beenuked
 
     void YM2151::clockchip()
     {
+	BEENUKED_PROFILE_START();
 	clock_timers();
+	BEENUKED_PROFILE_LAP(ProfileTimers);
+
+	// The noise generator is clocked along with the LFO
 	clock_lfo();
+	BEENUKED_PROFILE_LAP(ProfileLFO);
 
 	env_timer += 1;
 
@@ -910,6 +917,7 @@ namespace beenuked
 	{
 	    env_timer = 0;
 	    clock_channel_eg();
+	    BEENUKED_PROFILE_LAP(ProfileEnvelope);
 	}
 
 	for (auto &channel : channels)
@@ -917,14 +925,20 @@ namespace beenuked
 	    clock_phase(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfilePhase);
+
 	for (auto &channel : channels)
 	{
 	    channel_output(channel);
 	}
+
+	BEENUKED_PROFILE_LAP(ProfileOutput);
     }
 
-    vector<int32_t> YM2151::get_samples()
+    array<int32_t, 2> YM2151::mix_output()
     {
+	BEENUKED_PROFILE_START();
+
 	array<int32_t, 2> output = {0, 0};
 
 	for (int i = 0; i < 8; i++)
@@ -933,13 +947,159 @@ namespace beenuked
 	    output[1] += (channels[i].is_pan_right) ? channels[i].output : 0;
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileMix);
+	return output;
+    }
+
+    vector<int32_t> YM2151::get_samples()
+    {
+	array<int32_t, 2> output = mix_output();
+
 	vector<int32_t> final_samples;
 
 	for (int i = 0; i < 2; i++)
 	{
-	    final_samples.push_back(dac_ym3014(output[i]));
+	    int32_t sample = (is_dac_bypassed) ? clamp(output[i], -32768, 32767) : dac_ym3014(output[i]);
+	    final_samples.push_back(sample);
 	}
 
 	return final_samples;
     }
+
+    void YM2151::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	size_t start = buffer.size();
+	buffer.resize((start + (num_samples * 2)));
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    clockchip();
+	    array<int32_t, 2> output = mix_output();
+	    buffer[(start + (i * 2))] = output[0];
+	    buffer[(start + (i * 2) + 1)] = output[1];
+	}
+
+	if (is_dac_bypassed)
+	{
+	    dac_bypass(&buffer[start], (num_samples * 2));
+	}
+	else
+	{
+	    dac_ym3014(&buffer[start], (num_samples * 2));
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YM2151::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    void YM2151::set_dac_bypass(bool val)
+    {
+	is_dac_bypassed = val;
+    }
+
+    template<typename Archive>
+    void YM2151::opm_operator::serialize_state(Archive &state)
+    {
+	// get_freqnum() can carry the block one step below its range, or two steps above it
+	state.value(keycode, -4, 39);
+	state.value(freq_num);
+	state.value(block, -1, 9);
+	state.value(multiply, 0, 15);
+	state.value(total_level, 0, 0x3FF);
+	state.value(key_scaling, 0, 3);
+	state.value(ksr_val, -4, 39);
+	state.value(detune, 0, 7);
+	state.value(detune2, 0, 3);
+	state.value(lfo_enable);
+	state.value(lfo_pm_sens, 0, 7);
+	state.value(lfo_am_sens, 0, 3);
+	state.value(attack_rate, 0, 31);
+	state.value(decay_rate, 0, 31);
+	state.value(sustain_rate, 0, 31);
+	state.value(sustain_level, 0, 0x3FF);
+	state.value(release_rate, 0, 15);
+	state.value(is_keyon);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(env_rate, 0, 63);
+	state.value(env_output, 0, 0x3FF);
+	state.value(env_state, Attack, Off);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YM2151::opm_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 7);
+	state.value(keyfrac, 0, 63);
+	state.value(keycode, 0, 15);
+	state.value(block, 0, 7);
+	state.value(feedback, 0, 7);
+	state.value(algorithm, 0, 7);
+	state.value(lfo_pm_sens, 0, 7);
+	state.value(lfo_am_sens, 0, 3);
+	state.value(is_pan_left);
+	state.value(is_pan_right);
+	state.value(output);
+	state.value(opers);
+    }
+
+    template<typename Archive>
+    void YM2151::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(env_timer);
+	state.value(env_clock);
+	state.value(lfo_counter);
+	state.value(lfo_rate, 0, 0xFF);
+	state.value(lfo_reset);
+	state.value(lfo_pm_sens, 0, 0x7F);
+	state.value(lfo_am_sens, 0, 0x7F);
+	state.value(lfo_waveform, 0, 3);
+	state.value(lfo_am);
+	state.value(lfo_raw_pm);
+
+	// Unlike the other LFO waveforms, the noise waveform is written as the LFO runs
+	state.value(lfo_table[3]);
+
+	state.value(noise_freq, 0, 31);
+	state.value(noise_enable);
+	state.value(noise_lfsr);
+	state.value(noise_counter);
+	state.value(noise_state);
+	state.value(noise_lfo);
+	state.value(timera_freq, 0, 0x3FF);
+	state.value(timerb_freq, 0, 0xFF);
+	state.value(timera_counter);
+	state.value(timerb_counter);
+	state.value(is_timera_running);
+	state.value(is_timerb_running);
+	state.value(is_timera_enabled);
+	state.value(is_timerb_enabled);
+	state.value(opm_status);
+	state.value(channels);
+    }
+
+    void YM2151::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYM2151, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YM2151::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYM2151, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 };
\ No newline at end of file
@@ -20,6 +20,10 @@
 #define BEENUKED_YM2151
 
 #include "utils.h"
+#include "ym3014.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -38,6 +42,34 @@ namespace beenuked
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+	    // Bypasses the YM3014's quantization for a cleaner, higher-resolution output
+	    void set_dac_bypass(bool val);
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -51,6 +83,9 @@ namespace beenuked
 
 	    BeeNukedInterface *inter = NULL;
 
+	    bool is_dac_bypassed = false;
+	    array<int32_t, 2> mix_output();
+
 	    void init_tables();
 
 	    array<uint32_t, 256> sine_table;
@@ -103,6 +138,9 @@ namespace beenuked
 		opm_oper_state env_state = opm_oper_state::Off;
 
 		array<int32_t, 2> outputs;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    struct opm_channel
@@ -119,6 +157,9 @@ namespace beenuked
 		bool is_pan_right = false;
 		int32_t output = 0;
 		array<opm_operator, 4> opers;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    uint32_t env_timer = 0;
@@ -187,8 +228,19 @@ namespace beenuked
 
 	    uint8_t opm_status = 0;
 
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
 	    #include "opm_tables.inl"
-	    #include "ym3014.inl"
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
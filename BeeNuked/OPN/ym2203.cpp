@@ -113,130 +113,55 @@ namespace beenuked
     {
 	prescaler_val = value;
 
+	// The resampler phases (and the FM clock) follow the total output sample count,
+	// so that changing the prescaler mid-stream lines up the same way it always has
 	switch (value)
 	{
-	    case prescaler_six: fm_samples_per_output = 6; configure_ssg_resampler(4, 3); break;
-	    case prescaler_three: fm_samples_per_output = 3; configure_ssg_resampler(2, 3); break;
-	    case prescaler_two: fm_samples_per_output = 2; configure_ssg_resampler(1, 3); break;
-	    default: fm_samples_per_output = 6; configure_ssg_resampler(4, 3); break;
+	    case prescaler_six: fm_samples_per_output = 6; ssg_resampler.configure(4, 3, int(ssg_sample_index & 0x3)); break;
+	    case prescaler_three: fm_samples_per_output = 3; ssg_resampler.configure(2, 3, int((ssg_sample_index & 0x1) ^ 1)); break;
+	    case prescaler_two: fm_samples_per_output = 2; ssg_resampler.configure(1, 3); break;
+	    default: fm_samples_per_output = 6; ssg_resampler.configure(4, 3, int(ssg_sample_index & 0x3)); break;
 	}
-    }
 
-    void YM2203::configure_ssg_resampler(uint8_t out_samples, uint8_t src_samples)
-    {
-	switch ((out_samples * 10) + src_samples)
-	{
-	    case 43:
-	    {
-		resample = [&]() {
-		    resample_4_3();
-		};
-	    }
-	    break;
-	    case 23:
-	    {
-		resample = [&]() {
-		    resample_2_3();
-		};
-	    }
-	    break;
-	    case 13:
-	    {
-		resample = [&]() {
-		    resample_1_3();
-		};
-	    }
-	    break;
-	    default:
-	    {
-		resample = [&]() {
-		    resample_nop();
-		};
-	    }
-	    break;
-	}
+	fm_clock_countdown = int((fm_samples_per_output - (ssg_sample_index % fm_samples_per_output)) % fm_samples_per_output);
     }
 
-    void YM2203::add_last(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale)
+    void YM2203::clock_ssg(BeeNukedSSGResampler::ssg_frame *samples, size_t num_samples)
     {
-	sum0 += (last_ssg_samples[0] * scale);
-	sum1 += (last_ssg_samples[1] * scale);
-	sum2 += (last_ssg_samples[2] * scale);
-    }
-
-    void YM2203::clock_and_add(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale)
-    {
-	if (inter != NULL)
-	{
-	    inter->clockSSG();
-	    last_ssg_samples = inter->getSSGSamples();
-	}
-
-	add_last(sum0, sum1, sum2, scale);
-    }
-
-    void YM2203::write_to_output(int32_t sum0, int32_t sum1, int32_t sum2, int divisor)
-    {
-	ssg_samples[0] = (sum0 / divisor);
-	ssg_samples[1] = (sum1 / divisor);
-	ssg_samples[2] = (sum2 / divisor);
-	ssg_sample_index += 1;
-    }
-
-    void YM2203::resample_4_3()
-    {
-	int32_t sum0 = 0;
-	int32_t sum1 = 0;
-	int32_t sum2 = 0;
-	int step = (ssg_sample_index & 0x3);
-
-	add_last(sum0, sum1, sum2, step);
-
-	if (step != 3)
-	{
-	    clock_and_add(sum0, sum1, sum2, (3 - step));
-	}
+	BEENUKED_PROFILE_START();
 
-	write_to_output(sum0, sum1, sum2, 3);
-    }
+	ssg_resampler.resample(samples, num_samples, [&](BeeNukedSSGResampler::ssg_frame &sample) {
+	    if (inter != NULL)
+	    {
+		inter->clockSSG();
+		sample = inter->getSSGSamples();
+	    }
+	});
 
-    void YM2203::resample_2_3()
-    {
-	int32_t sum0 = 0;
-	int32_t sum1 = 0;
-	int32_t sum2 = 0;
+	int divisor = ssg_resampler.get_divisor();
 
-	if (testbit(ssg_sample_index, 0))
-	{
-	    clock_and_add(sum0, sum1, sum2, 2);
-	    clock_and_add(sum0, sum1, sum2, 1);
-	}
-	else
+	for (size_t i = 0; i < num_samples; i++)
 	{
-	    add_last(sum0, sum1, sum2, 1);
-	    clock_and_add(sum0, sum1, sum2, 2);
+	    for (auto &sample : samples[i])
+	    {
+		sample /= divisor;
+	    }
 	}
 
-	write_to_output(sum0, sum1, sum2, 3);
+	ssg_sample_index += num_samples;
+	BEENUKED_PROFILE_LAP(ProfileSSG);
     }
 
-    void YM2203::resample_1_3()
+    void YM2203::step_fm()
     {
-	int32_t sum0 = 0;
-	int32_t sum1 = 0;
-	int32_t sum2 = 0;
-
-	for (int rep = 0; rep < 3; rep++)
+	if (fm_clock_countdown == 0)
 	{
-	    clock_and_add(sum0, sum1, sum2);
+	    clock_fm();
+	    output_fm();
+	    fm_clock_countdown = fm_samples_per_output;
 	}
 
-	write_to_output(sum0, sum1, sum2, 3);
-    }
-
-    void YM2203::resample_nop()
-    {
-	ssg_sample_index += 1;
+	fm_clock_countdown -= 1;
     }
 
     void YM2203::update_prescaler()
@@ -289,72 +214,19 @@ namespace beenuked
 	{
 	    case 0x21: break;
 	    case 0x22: break;
+	    // Timers aren't emulated yet
 	    case 0x24:
-	    {
-		cout << "Writing to upper 8 bits of timer A" << endl;
-	    }
-	    break;
 	    case 0x25:
-	    {
-		cout << "Writing to lower 2 bits of timer A" << endl;
-	    }
-	    break;
 	    case 0x26:
 	    {
-		cout << "Writing to timer B" << endl;
+		BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 	    }
 	    break;
 	    case 0x27:
 	    {
 		int ch3_mode = ((data >> 6) & 0x3);
-		cout << "Channel 3 mode: " << dec << ch3_mode << endl;
 		update_ch3_mode(ch3_mode);
-
-		if (testbit(data, 5))
-		{
-		    cout << "Resetting timer B..." << endl;
-		}
-
-		if (testbit(data, 4))
-		{
-		    cout << "Resetting timer A..." << endl;
-		}
-
-		if (testbit(data, 3))
-		{
-		    cout << "Timer B flag enabled..." << endl;
-		}
-		else
-		{
-		    cout << "Timer B flag disabled..." << endl;
-		}
-
-		if (testbit(data, 2))
-		{
-		    cout << "Timer A flag enabled..." << endl;
-		}
-		else
-		{
-		    cout << "Timer A flag disabled..." << endl;
-		}
-
-		if (testbit(data, 1))
-		{
-		    cout << "Starting timer B..." << endl;
-		}
-		else
-		{
-		    cout << "Stopping timer B..." << endl;
-		}
-
-		if (testbit(data, 0))
-		{
-		    cout << "Starting timer A..." << endl;
-		}
-		else
-		{
-		    cout << "Stopping timer A..." << endl;
-		}
+		BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 	    }
 	    break;
 	    case 0x28:
@@ -619,6 +491,7 @@ namespace beenuked
 	if (!oper.is_keyon && (!chan.is_csm_keyon || (chan.number != 2)))
 	{
 	    oper.is_keyon = true;
+	    BEENUKED_PROFILE_KEY_ON();
 
 	    start_envelope(oper);
 	    calc_oper_rate(oper);
@@ -896,11 +769,15 @@ namespace beenuked
 
     void YM2203::clock_fm()
     {
+	BEENUKED_PROFILE_START();
+
 	for (auto &channel : channels)
 	{
 	    clock_ssg_eg(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileSSGEG);
+
 	env_timer += 1;
 
 	// Update the envelope generator every 3 cycles
@@ -909,6 +786,7 @@ namespace beenuked
 	    env_timer = 0;
 	    env_clock += 1;
 	    clock_envelope_gen();
+	    BEENUKED_PROFILE_LAP(ProfileEnvelope);
 	}
 
 	// Clock the phase generator
@@ -917,11 +795,15 @@ namespace beenuked
 	    clock_phase(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfilePhase);
+
 	// Generate channel output
 	for (auto &channel : channels)
 	{
 	    channel_output(channel);
 	}
+
+	BEENUKED_PROFILE_LAP(ProfileOutput);
     }
 
     void YM2203::output_fm()
@@ -933,8 +815,9 @@ namespace beenuked
 	    output += channels[i].output;
 	}
 
-	int16_t fm_sample = dac_ym3014(output);
+	int32_t fm_sample = (is_dac_bypassed) ? clamp(output, -32768, 32767) : dac_ym3014(output);
 	last_samples[3] = fm_sample;
+	BEENUKED_PROFILE_LAP(ProfileMix);
     }
 
     uint32_t YM2203::get_sample_rate(uint32_t clock_rate)
@@ -991,23 +874,15 @@ namespace beenuked
 	}
 	else
 	{
+	    BEENUKED_PROFILE_WRITE(chip_address);
 	    write_reg(chip_address, data);
 	}
     }
 
     void YM2203::clockchip()
     {
-	if ((ssg_sample_index % fm_samples_per_output) == 0)
-	{
-	    clock_fm();
-	    output_fm();
-	}
-
-	if (resample)
-	{
-	    resample();
-	}
-
+	step_fm();
+	clock_ssg(&ssg_samples, 1);
 	copy(ssg_samples.begin(), ssg_samples.end(), last_samples.begin());
     }
 
@@ -1022,4 +897,118 @@ namespace beenuked
 
 	return final_samples;
     }
+
+    void YM2203::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	buffer.reserve((buffer.size() + (num_samples * last_samples.size())));
+
+	// The SSG doesn't depend on the FM section, so it's resampled for the whole block at once
+	ssg_block.resize(num_samples);
+	clock_ssg(ssg_block.data(), num_samples);
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    step_fm();
+	    copy(ssg_block[i].begin(), ssg_block[i].end(), last_samples.begin());
+	    buffer.insert(buffer.end(), last_samples.begin(), last_samples.end());
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YM2203::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    void YM2203::set_dac_bypass(bool val)
+    {
+	is_dac_bypassed = val;
+    }
+
+    void YM2203::set_ssg_band_limited(bool val)
+    {
+	ssg_resampler.set_band_limited(val);
+    }
+
+    template<typename Archive>
+    void YM2203::opn_operator::serialize_state(Archive &state)
+    {
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(multiply, 0, 15);
+	state.value(detune, 0, 7);
+	state.value(total_level, 0, 0x3FF);
+	state.value(keycode, 0, 31);
+	state.value(key_scaling, 0, 3);
+	state.value(ksr_val, 0, 31);
+	state.value(attack_rate, 0, 31);
+	state.value(decay_rate, 0, 31);
+	state.value(sustain_rate, 0, 31);
+	state.value(sustain_level, 0, 0x3FF);
+	state.value(release_rate, 0, 15);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(is_keyon);
+	state.value(ssg_enable);
+	state.value(ssg_att);
+	state.value(ssg_alt);
+	state.value(ssg_hold);
+	state.value(ssg_inv);
+	state.value(env_output, 0, 0x3FF);
+	state.value(env_rate, 0, 63);
+	state.value(env_state, Attack, Off);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YM2203::opn_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 2);
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(ch_mode, 0, 3);
+	state.value(oper_fnums, 0, 0x7FF);
+	state.value(oper_block, 0, 7);
+	state.value(is_csm_keyon);
+	state.value(feedback, 0, 7);
+	state.value(algorithm, 0, 7);
+	state.value(output);
+	state.value(opers);
+    }
+
+    template<typename Archive>
+    void YM2203::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(prescaler_val, prescaler_six, prescaler_two);
+	state.value(fm_samples_per_output, 2, 6);
+	state.value(fm_clock_countdown, 0, fm_samples_per_output);
+	state.value(ssg_sample_index);
+	state.value(ssg_samples);
+	state.value(last_samples);
+	state.value(env_timer);
+	state.value(env_clock);
+	state.value(channels);
+	ssg_resampler.serialize_state(state);
+    }
+
+    void YM2203::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYM2203, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YM2203::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYM2203, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 }
\ No newline at end of file
@@ -20,6 +20,12 @@
 #define BEENUKED_YM2203
 
 #include "utils.h"
+#include "trace.h"
+#include "ym3014.h"
+#include "ssg_resampler.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -36,6 +42,45 @@ namespace beenuked
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+	    // Bypasses the YM3014's quantization for a cleaner, higher-resolution output
+	    void set_dac_bypass(bool val);
+
+	    // Switches the SSG resampler from the chip's box filter to a band-limited (windowed-sinc) filter
+	    void set_ssg_band_limited(bool val);
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    // Diagnostic events reported by this chip (see trace.h)
+	    BeeNukedTraceRing &get_trace_ring()
+	    {
+		return trace_ring;
+	    }
+#endif
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -54,9 +99,12 @@ namespace beenuked
 
 	    BeeNukedInterface *inter = NULL;
 
+	    bool is_dac_bypassed = false;
+
 	    int prescaler_val = 0;
 
 	    int fm_samples_per_output = 0;
+	    int fm_clock_countdown = 0;
 
 	    uint64_t ssg_sample_index = 0;
 
@@ -66,23 +114,13 @@ namespace beenuked
 
 	    void set_prescaler(int value);
 
-	    void configure_ssg_resampler(uint8_t out_samples, uint8_t src_samples);
-
-	    using resample_func = function<void()>;
-
-	    resample_func resample;
-
-	    void resample_4_3();
-	    void resample_2_3();
-	    void resample_1_3();
-	    void resample_nop();
+	    BeeNukedSSGResampler ssg_resampler;
+	    vector<BeeNukedSSGResampler::ssg_frame> ssg_block;
 
 	    array<int32_t, 3> ssg_samples = {0, 0, 0};
-	    array<int32_t, 3> last_ssg_samples = {0, 0, 0};
 
-	    void add_last(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale = 1);
-	    void clock_and_add(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale = 1);
-	    void write_to_output(int32_t sum0, int32_t sum1, int32_t sum2, int divisor = 1);
+	    void clock_ssg(BeeNukedSSGResampler::ssg_frame *samples, size_t num_samples);
+	    void step_fm();
 
 	    void update_prescaler();
 
@@ -132,9 +170,12 @@ namespace beenuked
 
 		int32_t env_output = 0;
 		int env_rate = 0;
-		opn_oper_state env_state;
+		opn_oper_state env_state = opn_oper_state::Off;
 
 		array<int32_t, 2> outputs = {0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    struct opn_channel
@@ -152,6 +193,9 @@ namespace beenuked
 		int algorithm = 0;
 		int32_t output = 0;
 		array<opn_operator, 4> opers;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    array<opn_channel, 3> channels;
@@ -185,8 +229,23 @@ namespace beenuked
 	    void clock_fm();
 	    void output_fm();
 
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
 	    #include "opn_tables.inl"
-	    #include "ym3014.inl"
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    BeeNukedTraceRing trace_ring;
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
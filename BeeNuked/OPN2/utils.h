@@ -19,8 +19,8 @@
 #ifndef BEENUKED_UTILS_H
 #define BEENUKED_UTILS_H
 
-#include <iostream>
 #include <algorithm>
+#include <stdexcept>
 #include <cstdint>
 #include <cmath>
 #include <array>
@@ -57,17 +57,18 @@ namespace beenuked
 
 	    virtual void writeSSG(int port, uint8_t data)
 	    {
-		cout << "Writing value of " << hex << int(data) << " to OPN SSG port of " << dec << int(port) << endl;
+		(void)port;
+		(void)data;
+		return;
 	    }
 
 	    virtual void clockSSG()
 	    {
-		cout << "Clocking SSG..." << endl;
+		return;
 	    }
 
 	    virtual array<int32_t, 3> getSSGSamples()
 	    {
-		cout << "Fetching samples..." << endl;
 		return {0, 0, 0};
 	    }
 
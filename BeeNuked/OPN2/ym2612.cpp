@@ -194,7 +194,7 @@ namespace beenuked
 
 		if (ch3_mode == 2)
 		{
-		    cout << "CSM mode enabled" << endl;
+		    BEENUKED_TRACE(TraceUnimplemented, reg, data);
 		}
 
 		update_ch3_mode(ch3_mode);
@@ -562,6 +562,7 @@ namespace beenuked
 	if (!oper.is_keyon && (!chan.is_csm_keyon || (chan.number != 2)))
 	{
 	    oper.is_keyon = true;
+	    BEENUKED_PROFILE_KEY_ON();
 
 	    start_envelope(oper);
 	    oper.phase_counter = 0;
@@ -1036,6 +1037,7 @@ namespace beenuked
 		    break;
 		}
 
+		BEENUKED_PROFILE_WRITE(chip_address);
 		write_port0(chip_address, data);
 	    }
 	    break;
@@ -1053,6 +1055,7 @@ namespace beenuked
 		    break;
 		}
 
+		BEENUKED_PROFILE_WRITE((0x100 | chip_address));
 		write_port1(chip_address, data);
 	    }
 	    break;
@@ -1062,14 +1065,19 @@ namespace beenuked
     void YM2612::clockchip()
     {
 	// TODO: Clock other components (i.e. LFO, AMS/PMS, etc.)
+	BEENUKED_PROFILE_START();
 	clock_timers(); // Clock timers
+	BEENUKED_PROFILE_LAP(ProfileTimers);
 	clock_lfo(); // Clock LFO
+	BEENUKED_PROFILE_LAP(ProfileLFO);
 
 	for (auto &channel : channels)
 	{
 	    clock_ssg_eg(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileSSGEG);
+
 	env_timer += 1;
 
 	// Update the envelope generator every 3 cycles
@@ -1078,6 +1086,7 @@ namespace beenuked
 	    env_timer = 0;
 	    env_clock += 1;
 	    clock_envelope_gen();
+	    BEENUKED_PROFILE_LAP(ProfileEnvelope);
 	}
 
 	// Clock the phase generator
@@ -1086,15 +1095,21 @@ namespace beenuked
 	    clock_phase(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfilePhase);
+
 	// Output audio
 	for (auto &channel : channels)
 	{
 	    channel_output(channel);
 	}
+
+	BEENUKED_PROFILE_LAP(ProfileOutput);
     }
 
-    vector<int32_t> YM2612::get_samples()
+    array<int32_t, 2> YM2612::mix_output()
     {
+	BEENUKED_PROFILE_START();
+
 	int32_t sample_zero = dac_discontinuity(0);
 
 	array<int32_t, 2> output = {sample_zero, sample_zero};
@@ -1134,6 +1149,14 @@ namespace beenuked
 	    }
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileMix);
+	return mixed_samples;
+    }
+
+    vector<int32_t> YM2612::get_samples()
+    {
+	array<int32_t, 2> mixed_samples = mix_output();
+
 	vector<int32_t> final_samples;
 
 	for (auto &sample : mixed_samples)
@@ -1144,4 +1167,122 @@ namespace beenuked
 	return final_samples;
     }
 
+    void YM2612::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	size_t start = buffer.size();
+	buffer.resize((start + (num_samples * 2)));
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    clockchip();
+	    array<int32_t, 2> output = mix_output();
+	    buffer[(start + (i * 2))] = output[0];
+	    buffer[(start + (i * 2) + 1)] = output[1];
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YM2612::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    template<typename Archive>
+    void YM2612::opn2_operator::serialize_state(Archive &state)
+    {
+	state.value(keycode, 0, 31);
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(multiply, 0, 15);
+	state.value(detune, 0, 7);
+	state.value(key_scaling, 0, 3);
+	state.value(ksr_val, 0, 31);
+	state.value(attack_rate, 0, 31);
+	state.value(decay_rate, 0, 31);
+	state.value(sustain_rate, 0, 31);
+	state.value(sustain_level, 0, 0x3FF);
+	state.value(release_rate, 0, 15);
+	state.value(total_level, 0, 0x3FF);
+	state.value(ssg_enable);
+	state.value(ssg_att);
+	state.value(ssg_alt);
+	state.value(ssg_hold);
+	state.value(ssg_inv);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(is_keyon);
+	state.value(lfo_enable);
+	state.value(lfo_pm_sens, 0, 7);
+	state.value(lfo_am_sens, 0, 3);
+	state.value(env_output, 0, 0x3FF);
+	state.value(env_rate, 0, 63);
+	state.value(env_state, Attack, Off);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YM2612::opn2_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 5);
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(ch_mode, 0, 3);
+	state.value(oper_fnums, 0, 0x7FF);
+	state.value(oper_block, 0, 7);
+	state.value(is_csm_keyon);
+	state.value(is_left_output);
+	state.value(is_right_output);
+	state.value(lfo_pm_sens, 0, 7);
+	state.value(lfo_am_sens, 0, 3);
+	state.value(feedback, 0, 7);
+	state.value(algorithm, 0, 7);
+	state.value(output);
+	state.value(opers);
+    }
+
+    template<typename Archive>
+    void YM2612::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(is_addr_a1);
+	state.value(is_dac_enabled);
+	state.value(dac_data);
+	state.value(env_timer);
+	state.value(env_clock);
+	state.value(lfo_counter);
+	state.value(lfo_am);
+	state.value(lfo_raw_pm);
+	state.value(is_lfo_enabled);
+	state.value(lfo_rate, 0, 7);
+	state.value(timera_freq, 0, 0x3FF);
+	state.value(timerb_freq, 0, 0xFF);
+	state.value(timera_counter);
+	state.value(timerb_counter);
+	state.value(is_timera_running);
+	state.value(is_timerb_running);
+	state.value(is_timera_enabled);
+	state.value(is_timerb_enabled);
+	state.value(opn2_status);
+	state.value(channels);
+    }
+
+    void YM2612::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYM2612, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YM2612::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYM2612, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 };
\ No newline at end of file
@@ -20,6 +20,10 @@
 #define BEENUKED_YM2612
 
 #include "utils.h"
+#include "trace.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -43,6 +47,39 @@ namespace beenuked
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    // Diagnostic events reported by this chip (see trace.h)
+	    BeeNukedTraceRing &get_trace_ring()
+	    {
+		return trace_ring;
+	    }
+#endif
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -50,6 +87,8 @@ namespace beenuked
 		return ((reg >> bit) & 1) ? true : false;
 	    }
 
+	    array<int32_t, 2> mix_output();
+
 	    void set_chip_type(OPN2Type type);
 	    void reset();
 
@@ -154,9 +193,12 @@ namespace beenuked
 
 		int32_t env_output = 0;
 		int env_rate = 0;
-		opn2_oper_state env_state;
+		opn2_oper_state env_state = opn2_oper_state::Off;
 
 		array<int32_t, 2> outputs = {0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    struct opn2_channel
@@ -178,6 +220,9 @@ namespace beenuked
 		int algorithm = 0;
 		int32_t output = 0;
 		array<opn2_operator, 4> opers;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    array<opn2_channel, 6> channels;
@@ -207,7 +252,23 @@ namespace beenuked
 
 	    void channel_output(opn2_channel &channel);
 
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
 	    #include "opn2_tables.inl"
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    BeeNukedTraceRing trace_ring;
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
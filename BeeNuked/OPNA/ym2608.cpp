@@ -26,23 +26,800 @@
 //
 // BueniaDev's Notes:
 //
-// This implementation is a huge WIP, and lots of features are currently unimplemented.
-// As such, expect a lot of things to not work correctly here.
-// However, work is being done to improve this core, so don't lose hope here!
+// The FM and ADPCM-B sections are adapted from the YM2612 and YM2610 cores respectively,
+// but the following features are still unimplemented:
+//
+// CSM mode
+// ADPCM-B A/D and D/A conversion modes, and memory reads through the data register
+// SSG register reads
+//
+// However, work is being done on those fronts, so don't lose hope here!
+
+#include "ym2608.h"
+using namespace beenuked;
+
+namespace beenuked
+{
+    YM2608::YM2608()
+    {
+
+    }
+
+    YM2608::~YM2608()
+    {
+
+    }
+
+    void YM2608::init_tables()
+    {
+	for (uint32_t index = 0; index < 256; index++)
+	{
+	    double phase_normalized = (static_cast<double>((index << 1) + 1) / 512.f);
+	    double sine_result_normalized = sin(phase_normalized * (M_PI / 2));
+
+	    double sine_result_as_attenuation = -log(sine_result_normalized) / log(2.0);
+
+	    uint32_t sine_result = static_cast<uint32_t>((sine_result_as_attenuation * 256.f) + 0.5);
+	    sine_table[index] = sine_result;
+	}
+
+	for (uint32_t index = 0; index < 256; index++)
+	{
+	    double entry_normalized = (static_cast<double>((index + 1)) / 256.f);
+	    double res_normalized = pow(2, -entry_normalized);
+
+	    uint32_t exp_result = static_cast<uint32_t>((res_normalized * 2048.f) + 0.5);
+	    exp_table[index] = exp_result;
+	}
+    }
+
+    int32_t YM2608::calc_output(uint32_t phase, int32_t mod, uint32_t env)
+    {
+	uint32_t atten = min<uint32_t>(0x3FF, env);
+
+	uint32_t combined_phase = ((phase + mod) & 0x3FF); 
+
+	bool sign_bit = testbit(combined_phase, 9);
+	bool mirror_bit = testbit(combined_phase, 8);
+	uint8_t quarter_phase = (combined_phase & 0xFF);
+
+	if (mirror_bit)
+	{
+	    quarter_phase = ~quarter_phase;
+	}
+
+	uint32_t sine_result = sine_table[quarter_phase];
+
+	uint32_t attenuation = (atten << 2);
+	uint32_t combined_atten = ((sine_result + attenuation) & 0x1FFF);
+
+	int shift_count = ((combined_atten >> 8) & 0x1F);
+	uint8_t exp_index = (combined_atten & 0xFF);
+	uint32_t exp_result = exp_table[exp_index];
+
+	uint32_t output_shifted = ((exp_result << 2) >> shift_count);
+
+	int32_t exp_output = int32_t(output_shifted);
+
+	if (sign_bit)
+	{
+	    exp_output = -exp_output;
+	}
+
+	return exp_output;
+    }
+
+    void YM2608::write_mode(uint8_t reg, uint8_t data)
+    {
+	switch (reg)
+	{
+	    case 0x21: break; // Test register
+	    case 0x22:
+	    {
+		is_lfo_enabled = testbit(data, 3);
+		lfo_rate = (data & 0x7);
+	    }
+	    break;
+	    case 0x24:
+	    {
+		timera_freq = ((timera_freq & 0x3) | (data << 2)); 
+	    }
+	    break;
+	    case 0x25:
+	    {
+		timera_freq = ((timera_freq & 0x3FC) | (data & 0x3));
+	    }
+	    break;
+	    case 0x26:
+	    {
+		timerb_freq = data;
+	    }
+	    break;
+	    case 0x27:
+	    {
+		int ch3_mode = ((data >> 6) & 0x3);
+		update_ch3_mode(ch3_mode);
+
+		if (testbit(data, 0) && !is_timera_running)
+		{
+		    timera_counter = timera_freq;
+		}
+
+		if (testbit(data, 1) && !is_timerb_running)
+		{
+		    timerb_counter = (timerb_freq << 4);
+		}
+
+		is_timera_running = testbit(data, 0);
+		is_timerb_running = testbit(data, 1);
+		is_timera_enabled = testbit(data, 2);
+		is_timerb_enabled = testbit(data, 3);
+
+		if (testbit(data, 4))
+		{
+		    reset_status_bit(0);
+		}
+
+		if (testbit(data, 5))
+		{
+		    reset_status_bit(1);
+		}
+	    }
+	    break;
+	    case 0x28:
+	    {
+		int ch_addr = (data & 0x7);
+
+		if ((ch_addr & 0x3) == 3)
+		{
+		    return;
+		}
+
+		int ch_num = (ch_addr < 3) ? ch_addr : (ch_addr - 1);
+
+		auto &channel = channels[ch_num];
+
+		for (int i = 0; i < 4; i++)
+		{
+		    if (testbit(data, (4 + i)))
+		    {
+			key_on(channel, channel.opers[i]);
+		    }
+		    else
+		    {
+			key_off(channel, channel.opers[i]);
+		    }
+		}
+	    }
+	    break;
+	    case 0x29:
+	    {
+		is_6ch_mode = testbit(data, 7);
+	    }
+	    break;
+	    default: break;
+	}
+    }
+
+    void YM2608::write_fmreg(bool is_port1, uint8_t reg, uint8_t data)
+    {
+	int reg_group = (reg & 0xF0);
+	int reg_addr = (reg & 0xF);
+
+	int ch_num = (reg_addr & 0x3);
+
+	if (ch_num == 3)
+	{
+	    return;
+	}
+
+	if (is_port1)
+	{
+	    ch_num += 3;
+	}
+
+	int oper_reg = ((reg_addr >> 2) & 0x3);
+	array<int, 4> oper_table = {0, 2, 1, 3};
+	int oper_num = oper_table[oper_reg];
+
+	auto &channel = channels[ch_num];
+	auto &ch_oper = channel.opers[oper_num];
+
+	switch (reg_group)
+	{
+	    case 0x30:
+	    {
+		ch_oper.detune = ((data >> 4) & 0x7);
+		ch_oper.multiply = (data & 0xF);
+		update_frequency(ch_oper);
+	    }
+	    break;
+	    case 0x40:
+	    {
+		ch_oper.total_level = ((data & 0x7F) << 3);
+	    }
+	    break;
+	    case 0x50:
+	    {
+		ch_oper.key_scaling = (3 - (data >> 6));
+		ch_oper.attack_rate = (data & 0x1F);
+		update_ksr(ch_oper);
+	    }
+	    break;
+	    case 0x60:
+	    {
+		ch_oper.lfo_enable = testbit(data, 7);
+		ch_oper.decay_rate = (data & 0x1F);
+	    }
+	    break;
+	    case 0x70:
+	    {
+		ch_oper.sustain_rate = (data & 0x1F);
+	    }
+	    break;
+	    case 0x80:
+	    {
+		int sl_val = (data >> 4);
+
+		// When all the bits of SL are set, SL is set to 93db
+		int sus_level = (sl_val == 15) ? 31 : sl_val;
+		ch_oper.sustain_level = (sus_level << 5);
+
+		ch_oper.release_rate = (data & 0xF);
+	    }
+	    break;
+	    case 0x90:
+	    {
+		ch_oper.ssg_hold = testbit(data, 0);
+		ch_oper.ssg_alt = testbit(data, 1);
+		ch_oper.ssg_att = testbit(data, 2);
+		ch_oper.ssg_enable = testbit(data, 3);
+	    }
+	    break;
+	    case 0xA0:
+	    {
+		switch (oper_reg)
+		{
+		    case 0:
+		    {
+			channel.freq_num = ((channel.freq_num & 0x700) | data);
+			update_frequency(channel);
+		    }
+		    break;
+		    case 1:
+		    {
+			channel.freq_num = ((channel.freq_num & 0xFF) | ((data & 0x7) << 8));
+			channel.block = ((data >> 3) & 0x7);
+		    }
+		    break;
+		    case 2:
+		    {
+			if (!is_port1)
+			{
+			    auto &channel3 = channels[2];
+			    channel3.oper_fnums[ch_num] = ((channel3.oper_fnums[ch_num] & 0x700) | data);
+			    if (channel3.ch_mode != 0)
+			    {
+				auto &oper = channel3.opers[ch_num];
+				oper.freq_num = channel3.oper_fnums[ch_num];
+				oper.block = channel3.oper_block[ch_num];
+				update_frequency(oper);
+			    }
+			}
+		    }
+		    break;
+		    case 3:
+		    {
+			if (!is_port1)
+			{
+			    auto &channel3 = channels[2];
+			    channel3.oper_fnums[ch_num] = ((channel3.oper_fnums[ch_num] & 0xFF) | ((data & 0x7) << 8));
+			    channel3.oper_block[ch_num] = ((data >> 3) & 0x7);
+			}
+		    }
+		    break;
+		}
+	    }
+	    break;
+	    case 0xB0:
+	    {
+		switch (oper_reg)
+		{
+		    case 0:
+		    {
+			channel.feedback = ((data >> 3) & 0x7);
+			channel.algorithm = (data & 0x7);
+		    }
+		    break;
+		    case 1:
+		    {
+			channel.is_left_output = testbit(data, 7);
+			channel.is_right_output = testbit(data, 6);
+			channel.lfo_am_sens = ((data >> 4) & 0x3);
+			channel.lfo_pm_sens = (data & 0x7);
+			update_lfo(channel);
+		    }
+		    break;
+		}
+	    }
+	    break;
+	}
+    }
+
+    void YM2608::update_frequency(opna_channel &channel)
+    {
+	if ((channel.number != 2) || (channel.ch_mode == 0))
+	{
+	    // Standard frequency update
+	    for (auto &oper : channel.opers)
+	    {
+		oper.freq_num = channel.freq_num;
+		oper.block = channel.block;
+		update_frequency(oper);
+	    }
+	}
+	else
+	{
+	    // NOTE: In this implementation, operators 1-3 have their frequencies updated seperately
+	    // in channel 3 special mode
+	    auto &oper = channel.opers[3];
+	    oper.freq_num = channel.freq_num;
+	    oper.block = channel.block;
+	    update_frequency(oper);
+	}
+    }
+
+    void YM2608::update_frequency(opna_operator &oper)
+    {
+	update_phase(oper);
+	update_ksr(oper);
+    }
+
+    void YM2608::update_lfo(opna_channel &channel)
+    {
+	for (auto &oper : channel.opers)
+	{
+	    oper.lfo_am_sens = channel.lfo_am_sens;
+	    oper.lfo_pm_sens = channel.lfo_pm_sens;
+	    update_frequency(oper);
+	}
+    }
+
+    int32_t YM2608::get_lfo_pm(opna_operator &oper)
+    {
+	int fnum_bits = (oper.freq_num >> 4);
+
+	int32_t abs_pm = lfo_raw_pm;
+
+	if (lfo_raw_pm < 0)
+	{
+	    abs_pm = -lfo_raw_pm;
+	}
+
+	uint32_t shifts = lfo_pm_shifts[oper.lfo_pm_sens][(abs_pm & 0x7)];
+
+	int32_t adjust = (fnum_bits >> (shifts & 0xF)) + (fnum_bits >> (shifts >> 4));
+
+	if (oper.lfo_pm_sens > 5)
+	{
+	    adjust <<= (oper.lfo_pm_sens - 5);
+	}
+
+	adjust >>= 2;
+
+	int32_t lfo_value = adjust;
+
+	if (lfo_raw_pm < 0)
+	{
+	    lfo_value = -lfo_value;
+	}
+
+	return lfo_value;
+    }
+
+    uint32_t YM2608::get_lfo_am(opna_channel &channel)
+    {
+	uint32_t am_shift = ((1 << (channel.lfo_am_sens ^ 3)) - 1);
+
+	return ((lfo_am << 1) >> am_shift);
+    }
+
+    void YM2608::update_phase(opna_operator &oper)
+    {
+	oper.keycode = ((oper.block << 2) | fnum_to_keycode[(oper.freq_num >> 7)]);
+	uint32_t phase_result = (oper.freq_num << 1);
+
+	if (oper.lfo_pm_sens != 0)
+	{
+	    phase_result += get_lfo_pm(oper);
+	    phase_result &= 0xFFF;
+	}
+
+	uint32_t phase_shifted = ((phase_result << oper.block) >> 2);
+
+	int detune_index = (oper.detune & 0x3);
+	bool detune_sign = testbit(oper.detune, 2);
+	uint32_t detune_increment = detune_table[oper.keycode][detune_index];
+
+	if (detune_sign)
+	{
+	    phase_shifted -= detune_increment;
+	    // The detune increment can cause the phase value
+	    // to underflow, so we mask the phase value to 17 bits
+	    phase_shifted &= 0x1FFFF;
+	}
+	else
+	{
+	    phase_shifted += detune_increment;
+	}
+
+	// Add in the multiply
+	if (oper.multiply == 0)
+	{
+	    phase_shifted >>= 1;
+	}
+	else
+	{
+	    phase_shifted *= oper.multiply;
+	    phase_shifted &= 0xFFFFF;
+	}
+
+	oper.phase_freq = phase_shifted;
+    }
+
+    void YM2608::update_ksr(opna_operator &oper)
+    {
+	oper.ksr_val = (oper.keycode >> oper.key_scaling);
+	calc_oper_rate(oper);
+    }
+
+    void YM2608::start_envelope(opna_operator &oper)
+    {
+	int att_rate = oper.attack_rate;
+	int env_rate = 0;
+
+	if (att_rate != 0)
+	{
+	    int calc_rate = ((att_rate * 2) + oper.ksr_val);
+	    env_rate = min(63, calc_rate);
+	}
+
+	if (env_rate >= 62)
+	{
+	    oper.env_output = 0;
+	    oper.env_state = (oper.sustain_level == 0) ? opna_oper_state::Sustain : opna_oper_state::Decay;
+	}
+	else
+	{
+	    if (oper.env_output > 0)
+	    {
+		oper.env_state = opna_oper_state::Attack;
+	    }
+	    else
+	    {
+		oper.env_state = (oper.sustain_level == 0) ? opna_oper_state::Sustain : opna_oper_state::Decay;
+	    }
+	}
+
+	calc_oper_rate(oper);
+    }
+
+    void YM2608::key_on(opna_channel &chan, opna_operator &oper)
+    {
+	if (!oper.is_keyon && (!chan.is_csm_keyon || (chan.number != 2)))
+	{
+	    oper.is_keyon = true;
+	    BEENUKED_PROFILE_KEY_ON();
+
+	    start_envelope(oper);
+	    oper.phase_counter = 0;
+	    oper.ssg_inv = false;
+	}
+    }
+
+    void YM2608::key_off(opna_channel &chan, opna_operator &oper)
+    {
+	// TODO: Implement CSM mode
+	if (oper.is_keyon && (!chan.is_csm_keyon || (chan.number != 2)))
+	{
+	    if (oper.env_state < opna_oper_state::Release)
+	    {
+		if (oper.ssg_enable && (oper.ssg_inv ^ oper.ssg_att))
+		{
+		    oper.env_output = ((0x200 - oper.env_output) & 0x3FF);
+		}
+
+		oper.env_state = opna_oper_state::Release;
+		calc_oper_rate(oper);
+	    }
+
+	    oper.is_keyon = false;
+	}
+    }
+
+    void YM2608::calc_oper_rate(opna_operator &oper)
+    {
+	int p_rate = 0;
+
+	switch (oper.env_state)
+	{
+	    case opna_oper_state::Attack: p_rate = oper.attack_rate; break;
+	    case opna_oper_state::Decay: p_rate = oper.decay_rate; break;
+	    case opna_oper_state::Sustain: p_rate = oper.sustain_rate; break;
+	    // Extend 4-bit release rate to 5 bits
+	    case opna_oper_state::Release: p_rate = ((oper.release_rate << 1) | 1); break;
+	    default: p_rate = 0; break;
+	}
+
+	if (p_rate == 0)
+	{
+	    oper.env_rate = 0;
+	}
+	else
+	{
+	    int env_rate = ((p_rate * 2) + oper.ksr_val);
+	    oper.env_rate = min(63, env_rate);
+	}
+    }
+
+    void YM2608::set_status_bit(int bit)
+    {
+	if (testbit(status_mask, bit))
+	{
+	    return;
+	}
+
+	opna_status |= (1 << bit);
+
+	if (inter != NULL)
+	{
+	    inter->fireInterrupt(true);
+	}
+    }
+
+    void YM2608::reset_status_bit(int bit)
+    {
+	opna_status &= ~(1 << bit);
+
+	if (inter != NULL)
+	{
+	    inter->fireInterrupt(false);
+	}
+    }
+
+    void YM2608::clock_timers()
+    {
+	// TODO: Implement CSM mode
+	if (is_timera_running)
+	{
+	    if (timera_counter != 1023)
+	    {
+		timera_counter += 1;
+	    }
+	    else if (is_timera_enabled)
+	    {
+		set_status_bit(0);
+		timera_counter = timera_freq;
+	    }
+	}
+
+	if (is_timerb_running)
+	{
+	    if (timerb_counter != 4095)
+	    {
+		timerb_counter += 1;
+	    }
+	    else if (is_timerb_enabled)
+	    {
+		set_status_bit(1);
+		timerb_counter = (timerb_freq << 4);
+	    }
+	}
+    }
+
+    void YM2608::clock_lfo()
+    {
+	if (!is_lfo_enabled)
+	{
+	    lfo_counter = 0;
+	    lfo_am = 0x3F;
+	    lfo_raw_pm = 0;
+	    return;
+	}
+
+	uint32_t sub_count = uint8_t(lfo_counter++);
+
+	if (sub_count >= lfo_max_count[lfo_rate])
+	{
+	    lfo_counter += (0x101 - sub_count);
+	}
+
+	lfo_am = ((lfo_counter >> 8) & 0x3F);
+
+	if (!testbit(lfo_counter, 14))
+	{
+	    lfo_am ^= 0x3F;
+	}
+
+	int32_t pm_val = ((lfo_counter >> 10) & 0x7);
+
+	if (testbit(lfo_counter, 13))
+	{
+	    pm_val ^= 7;
+	}
+
+	lfo_raw_pm = pm_val;
+
+	if (testbit(lfo_counter, 14))
+	{
+	    lfo_raw_pm = -lfo_raw_pm;
+	}
+    }
+
+    void YM2608::clock_phase(opna_channel &channel)
+    {
+	for (auto &oper : channel.opers)
+	{
+	    update_frequency(oper);
+	    oper.phase_counter = ((oper.phase_counter + oper.phase_freq) & 0xFFFFF);
+	    oper.phase_output = (oper.phase_counter >> 10);
+	}
+    }
+
+    void YM2608::clock_ssg_eg(opna_channel &channel)
+    {
+	for (auto &oper : channel.opers)
+	{
+	    if (oper.ssg_enable && (oper.env_output >= 0x200))
+	    {
+		if (oper.ssg_alt && (!oper.ssg_hold || !oper.ssg_inv))
+		{
+		    oper.ssg_inv = !oper.ssg_inv;
+		}
+
+		if (!oper.ssg_alt && !oper.ssg_hold)
+		{
+		    oper.phase_counter = 0;
+		}
 
-#include "ym2608.h"
-using namespace beenuked;
+		if (oper.env_state != opna_oper_state::Attack)
+		{
+		    if ((oper.env_state != opna_oper_state::Release) && !oper.ssg_hold)
+		    {
+			start_envelope(oper);
+		    }
+		    else if ((oper.env_state == opna_oper_state::Release) || !(oper.ssg_inv ^ oper.ssg_att))
+		    {
+			oper.env_output = 0x3FF;
+		    }
+		}
+	    }
+	}
+    }
 
-namespace beenuked
-{
-    YM2608::YM2608()
+    void YM2608::clock_envelope_gen()
+    {
+	for (auto &channel : channels)
+	{
+	    clock_envelope(channel);
+	}
+    }
+
+    void YM2608::clock_envelope(opna_channel &channel)
+    {
+	for (auto &oper : channel.opers)
+	{
+	    uint32_t counter_shift_val = counter_shift_table[oper.env_rate];
+
+	    if ((env_clock % (1 << counter_shift_val)) == 0)
+	    {
+		int update_cycle = ((env_clock >> counter_shift_val) & 0x7);
+		auto atten_inc = att_inc_table[oper.env_rate][update_cycle];
+
+		switch (oper.env_state)
+		{
+		    case opna_oper_state::Attack:
+		    {
+			oper.env_output += ((~oper.env_output * atten_inc) >> 4);
+
+			if (oper.env_output <= 0)
+			{
+			    oper.env_output = 0;
+			    oper.env_state = (oper.sustain_level == 0) ? opna_oper_state::Sustain : opna_oper_state::Decay;
+			    calc_oper_rate(oper);
+			}
+		    }
+		    break;
+		    case opna_oper_state::Decay:
+		    {
+			if (oper.ssg_enable)
+			{
+			    if (oper.env_output < 0x200)
+			    {
+				oper.env_output += (4 * atten_inc);
+			    }
+			}
+			else
+			{
+			    oper.env_output += atten_inc;
+			}
+
+			if (oper.env_output >= oper.sustain_level)
+			{
+			    oper.env_state = opna_oper_state::Sustain;
+			    calc_oper_rate(oper);
+			}
+		    }
+		    break;
+		    case opna_oper_state::Sustain:
+		    {
+			if (oper.ssg_enable)
+			{
+			    if (oper.env_output < 0x200)
+			    {
+				oper.env_output += (4 * atten_inc);
+			    }
+			}
+			else
+			{
+			    oper.env_output += atten_inc;
+			    if (oper.env_output >= 0x3FF)
+			    {
+				oper.env_output = 0x3FF;
+			    }
+			}
+		    }
+		    break;
+		    case opna_oper_state::Release:
+		    {
+			if (oper.ssg_enable)
+			{
+			    if (oper.env_output < 0x200)
+			    {
+				oper.env_output += (4 * atten_inc);
+			    }
+			}
+			else
+			{
+			    oper.env_output += atten_inc;
+
+			    if (oper.env_output >= 0x3FF)
+			    {
+				oper.env_output = 0x3FF;
+				oper.env_state = opna_oper_state::Off;
+			    }
+			}
+		    }
+		    break;
+		    default: break;
+		}
+	    }
+	}
+    }
+
+    void YM2608::update_ch3_mode(int val)
     {
+	auto &channel = channels[2];
+	channel.ch_mode = val;
 
+	for (auto &oper : channel.opers)
+	{
+	    oper.freq_num = channel.freq_num;
+	    oper.block = channel.block;
+	    update_frequency(oper);
+	}
     }
 
-    YM2608::~YM2608()
+    int32_t YM2608::get_env_output(opna_operator &oper)
     {
+	int32_t env_output = oper.env_output;
+
+	if (oper.ssg_enable && (oper.env_state != opna_oper_state::Release) && (oper.ssg_inv ^ oper.ssg_att))
+	{
+	    env_output = ((0x200 - env_output) & 0x3FF);
+	}
 
+	return env_output;
     }
 
     void YM2608::update_prescaler()
@@ -67,13 +844,17 @@ namespace beenuked
     {
 	prescaler_val = value;
 
+	// The resampler phases (and the FM clock) follow the total output sample count,
+	// so that changing the prescaler mid-stream lines up the same way it always has
 	switch (value)
 	{
-	    case prescaler_six: fm_samples_per_output = 6; configure_ssg_resampler(4, 3); break;
-	    case prescaler_three: fm_samples_per_output = 3; configure_ssg_resampler(2, 3); break;
-	    case prescaler_two: fm_samples_per_output = 2; configure_ssg_resampler(1, 3); break;
-	    default: fm_samples_per_output = 6; configure_ssg_resampler(4, 3); break;
+	    case prescaler_six: fm_samples_per_output = 6; ssg_resampler.configure(4, 3, int(ssg_sample_index & 0x3)); break;
+	    case prescaler_three: fm_samples_per_output = 3; ssg_resampler.configure(2, 3, int((ssg_sample_index & 0x1) ^ 1)); break;
+	    case prescaler_two: fm_samples_per_output = 2; ssg_resampler.configure(1, 3); break;
+	    default: fm_samples_per_output = 6; ssg_resampler.configure(4, 3, int(ssg_sample_index & 0x3)); break;
 	}
+
+	fm_clock_countdown = int((fm_samples_per_output - (ssg_sample_index % fm_samples_per_output)) % fm_samples_per_output);
     }
 
     void YM2608::write_adpcm(uint8_t reg, uint8_t data)
@@ -95,147 +876,571 @@ namespace beenuked
 		}
 		else
 		{
-		    for (int ch = 0; ch < 6; ch++)
+		    for (int ch = 0; ch < 6; ch++)
+		    {
+			if (testbit(data, ch))
+			{
+			    adpcm_channels[ch].is_keyon = false;
+			}
+		    }
+		}
+	    }
+	    break;
+	    case 0x11:
+	    {
+		adpcm_total_level = (data & 0x3F);
+	    }
+	    break;
+	    default:
+	    {
+		if ((reg >= 0x18) && (reg <= 0x1D))
+		{
+		    int ch_num = (reg - 0x18);
+		    adpcm_channels[ch_num].is_pan_left = testbit(data, 7);
+		    adpcm_channels[ch_num].is_pan_right = testbit(data, 6);
+		    adpcm_channels[ch_num].total_level = (data & 0x1F);
+		}
+	    }
+	    break;
+	}
+    }
+
+    void YM2608::adpcm_key_on(opna_adpcm &channel)
+    {
+	BEENUKED_PROFILE_KEY_ON();
+	channel.sample_pos = 0;
+	channel.reg_accum = 0;
+    }
+
+    void YM2608::clock_adpcm()
+    {
+	int num_adpcm_channels = 4;
+	adpcm_ch_clock += 1;
+
+	if (adpcm_ch_clock == 2)
+	{
+	    adpcm_ch_clock = 0;
+	    num_adpcm_channels = 6;
+	}
+
+	for (int ch = 0; ch < num_adpcm_channels; ch++)
+	{
+	    clock_adpcm(adpcm_channels[ch]);
+	}
+    }
+
+    uint8_t YM2608::fetchADPCMROM(uint32_t address)
+    {
+	return (address < opna_adpcm_rom.size()) ? opna_adpcm_rom[address] : 0;
+    }
+
+    vector<uint16_t> YM2608::decode_rhythm_sample(uint32_t start_addr, uint32_t end_addr)
+    {
+	vector<uint16_t> samples;
+	int32_t accum = 0;
+	int32_t step = 0;
+
+	for (uint32_t addr = start_addr; addr <= end_addr; addr++)
+	{
+	    uint8_t current_byte = fetchADPCMROM(addr);
+
+	    for (int shift = 4; shift >= 0; shift -= 4)
+	    {
+		int adpcm_data = ((current_byte >> shift) & 0xF);
+
+		int32_t delta = (2 * (adpcm_data & 0x7) + 1) * adpcm_steps[step] / 8;
+
+		if (testbit(adpcm_data, 3))
+		{
+		    delta = -delta;
+		}
+
+		accum = ((accum + delta) & 0xFFF);
+		int8_t step_inc = adpcm_steps_inc[(adpcm_data & 0x7)];
+		step = clamp<int32_t>((step + step_inc), 0, 48);
+		samples.push_back(accum);
+	    }
+	}
+
+	return samples;
+    }
+
+    const YM2608::opna_rhythm_samples &YM2608::get_rhythm_samples()
+    {
+	static const opna_rhythm_samples rhythm_samples = [&]()
+	{
+	    opna_rhythm_samples decoded;
+
+	    for (int ch = 0; ch < 6; ch++)
+	    {
+		auto &addresses = adpcm_rhythm_addresses[ch];
+		decoded[ch] = decode_rhythm_sample(addresses[0], addresses[1]);
+	    }
+
+	    return decoded;
+	}();
+
+	return rhythm_samples;
+    }
+
+    void YM2608::clock_adpcm(opna_adpcm &channel)
+    {
+	if (!channel.is_keyon)
+	{
+	    channel.reg_accum = 0;
+	    return;
+	}
+
+	if ((channel.samples == NULL) || (channel.sample_pos >= channel.samples->size()))
+	{
+	    channel.is_keyon = false;
+	    channel.reg_accum = 0;
+	    return;
+	}
+
+	channel.reg_accum = (*channel.samples)[channel.sample_pos++];
+    }
+
+    void YM2608::output_adpcm(opna_adpcm &channel)
+    {
+	int vol = ((channel.total_level ^ 0x1F) + (adpcm_total_level ^ 0x3F));
+
+	if (vol >= 63)
+	{
+	    return;
+	}
+
+	int8_t mul = (15 - (vol & 0x7));
+	uint8_t shift = (5 + (vol >> 3));
+
+	int16_t value = (((int16_t(channel.reg_accum << 4) * mul) >> shift) & ~3);
+
+	channel.output[0] = (channel.is_pan_left) ? value : 0;
+	channel.output[1] = (channel.is_pan_right) ? value : 0;
+    }
+
+    void YM2608::channel_output(opna_channel &channel)
+    {
+	auto &oper_one = channel.opers[0];
+	auto &oper_two = channel.opers[1];
+	auto &oper_three = channel.opers[2];
+	auto &oper_four = channel.opers[3];
+
+	int32_t feedback = 0;
+
+	if (channel.feedback != 0)
+	{
+	    feedback = ((oper_one.outputs[0] + oper_one.outputs[1]) >> (10 - channel.feedback));
+	}
+
+	uint32_t oper1_am = 0;
+
+	if (oper_one.lfo_enable)
+	{
+	    oper1_am += get_lfo_am(channel);
+	}
+
+	uint32_t oper1_atten = (get_env_output(oper_one) + oper1_am + oper_one.total_level);
+
+	oper_one.outputs[1] = oper_one.outputs[0];
+	oper_one.outputs[0] = calc_output(oper_one.phase_output, feedback, oper1_atten);
+
+	uint32_t algorithm_combo = algorithm_combinations[channel.algorithm];
+
+	array<int16_t, 8> opout;
+	opout[0] = 0;
+	opout[1] = oper_one.outputs[0];
+
+	uint32_t oper2_am = 0;
+
+	if (oper_two.lfo_enable)
+	{
+	    oper2_am += get_lfo_am(channel);
+	}
+
+	uint32_t oper2_atten = (get_env_output(oper_two) + oper2_am + oper_two.total_level);
+
+	int32_t oper2_mod = ((opout[(algorithm_combo & 1)] >> 1) & 0x3FF);
+	opout[2] = calc_output(oper_two.phase_output, oper2_mod, oper2_atten);
+	opout[5] = (opout[1] + opout[2]);
+
+	uint32_t oper3_am = 0;
+
+	if (oper_three.lfo_enable)
+	{
+	    oper3_am += get_lfo_am(channel);
+	}
+
+	uint32_t oper3_atten = (get_env_output(oper_three) + oper3_am + oper_three.total_level);
+
+	int32_t oper3_mod = ((opout[((algorithm_combo >> 1) & 0x7)] >> 1) & 0x3FF);
+	opout[3] = calc_output(oper_three.phase_output, oper3_mod, oper3_atten);
+	opout[6] = (opout[1] + opout[3]);
+	opout[7] = (opout[2] + opout[3]);
+
+	uint32_t oper4_am = 0;
+
+	if (oper_four.lfo_enable)
+	{
+	    oper4_am += get_lfo_am(channel);
+	}
+
+	uint32_t oper4_atten = (get_env_output(oper_four) + oper4_am + oper_four.total_level);
+
+	int32_t phase_mod = ((opout[((algorithm_combo >> 4) & 0x7)] >> 1) & 0x3FF);
+	int32_t ch_output = calc_output(oper_four.phase_output, phase_mod, oper4_atten);
+
+	// Like the YM2203, the YM2608 is full 14-bit with no intermediate clipping
+	if (testbit(algorithm_combo, 7))
+	{
+	    ch_output = clamp((ch_output + opout[1]), -32768, 32767);
+	}
+
+	if (testbit(algorithm_combo, 8))
+	{
+	    ch_output = clamp((ch_output + opout[2]), -32768, 32767);
+	}
+
+	if (testbit(algorithm_combo, 9))
+	{
+	    ch_output = clamp((ch_output + opout[3]), -32768, 32767);
+	}
+
+	channel.output = ch_output;
+    }
+
+    array<int32_t, 2> YM2608::output_fm()
+    {
+	array<int32_t, 2> output = {0, 0};
+
+	int num_channels = (is_6ch_mode) ? 6 : 3;
+
+	for (int ch = 0; ch < num_channels; ch++)
+	{
+	    auto &channel = channels[ch];
+
+	    // FM channels are mixed in at half of their 14-bit output
+	    int32_t fm_sample = (channel.output >> 1);
+
+	    if (channel.is_left_output)
+	    {
+		output[0] = clamp((output[0] + fm_sample), -32768, 32767);
+	    }
+
+	    if (channel.is_right_output)
+	    {
+		output[1] = clamp((output[1] + fm_sample), -32768, 32767);
+	    }
+	}
+
+	return output;
+    }
+
+    void YM2608::write_delta_t(uint8_t reg, uint8_t data)
+    {
+	switch (reg)
+	{
+	    case 0x00:
+	    {
+		delta_t_channel.is_record = testbit(data, 6);
+		delta_t_channel.is_external = testbit(data, 5);
+		delta_t_channel.is_repeat = testbit(data, 4);
+		delta_t_channel.is_keyon = false;
+
+		if (testbit(data, 0))
+		{
+		    restart_delta_t();
+		    delta_t_channel.current_addr = 0;
+		}
+		else if (testbit(data, 7) || delta_t_channel.is_record)
+		{
+		    // Both playback and memory writes start from the start address
+		    restart_delta_t();
+		    delta_t_channel.is_keyon = (testbit(data, 7) && delta_t_channel.is_external && !delta_t_channel.is_record);
+		}
+	    }
+	    break;
+	    case 0x01:
+	    {
+		delta_t_channel.is_pan_left = testbit(data, 7);
+		delta_t_channel.is_pan_right = testbit(data, 6);
+		delta_t_channel.is_dram_8bit = testbit(data, 1);
+		delta_t_channel.is_rom = testbit(data, 0);
+	    }
+	    break;
+	    case 0x02:
+	    {
+		delta_t_channel.start_addr = ((delta_t_channel.start_addr & 0xFF00) | data);
+	    }
+	    break;
+	    case 0x03:
+	    {
+		delta_t_channel.start_addr = ((delta_t_channel.start_addr & 0xFF) | (data << 8));
+	    }
+	    break;
+	    case 0x04:
+	    {
+		delta_t_channel.end_addr = ((delta_t_channel.end_addr & 0xFF00) | data);
+	    }
+	    break;
+	    case 0x05:
+	    {
+		delta_t_channel.end_addr = ((delta_t_channel.end_addr & 0xFF) | (data << 8));
+	    }
+	    break;
+	    case 0x08:
+	    {
+		// In memory write mode, each byte written here is stored to sample memory
+		if (delta_t_channel.is_record && delta_t_channel.is_external)
+		{
+		    writeRAM(delta_t_channel.current_addr, data);
+		    advance_delta_t_address();
+
+		    if ((delta_t_channel.current_addr >> get_delta_t_shift()) > delta_t_channel.end_addr)
 		    {
-			if (testbit(data, ch))
-			{
-			    adpcm_channels[ch].is_keyon = false;
-			}
+			set_status_bit(2);
+			delta_t_channel.current_addr = (delta_t_channel.start_addr << get_delta_t_shift());
 		    }
+
+		    set_status_bit(3);
 		}
 	    }
 	    break;
-	    case 0x11:
+	    case 0x09:
 	    {
-		adpcm_total_level = (data & 0x3F);
+		delta_t_channel.delta_n = ((delta_t_channel.delta_n & 0xFF00) | data);
 	    }
 	    break;
-	    default:
+	    case 0x0A:
 	    {
-		if ((reg >= 0x18) && (reg <= 0x1D))
+		delta_t_channel.delta_n = ((delta_t_channel.delta_n & 0xFF) | (data << 8));
+	    }
+	    break;
+	    case 0x0B:
+	    {
+		delta_t_channel.ch_volume = data;
+	    }
+	    break;
+	    case 0x0C:
+	    {
+		delta_t_channel.limit_addr = ((delta_t_channel.limit_addr & 0xFF00) | data);
+	    }
+	    break;
+	    case 0x0D:
+	    {
+		delta_t_channel.limit_addr = ((delta_t_channel.limit_addr & 0xFF) | (data << 8));
+	    }
+	    break;
+	    case 0x10:
+	    {
+		if (testbit(data, 7))
 		{
-		    int ch_num = (reg - 0x18);
-		    adpcm_channels[ch_num].is_pan_left = testbit(data, 7);
-		    adpcm_channels[ch_num].is_pan_right = testbit(data, 6);
-		    adpcm_channels[ch_num].total_level = (data & 0x1F);
+		    // IRQ reset
+		    opna_status = 0;
+
+		    if (inter != NULL)
+		    {
+			inter->fireInterrupt(false);
+		    }
+		}
+		else
+		{
+		    status_mask = (data & 0x1F);
+		    opna_status &= ~status_mask;
 		}
 	    }
 	    break;
+	    // Prescale (0x06-0x07) and DAC data (0x0E) registers are only used by the unemulated A/D and D/A modes
+	    default: break;
 	}
     }
 
-    void YM2608::adpcm_key_on(opna_adpcm &channel)
+    void YM2608::restart_delta_t()
     {
-	channel.current_address = channel.start_address;
-	channel.is_high_nibble = false;
-	channel.current_byte = 0;
-	channel.reg_accum = 0;
-	channel.current_step = 0;
+	delta_t_channel.current_addr = (delta_t_channel.start_addr << get_delta_t_shift());
+	delta_t_channel.is_high_nibble = false;
+	delta_t_channel.current_byte = 0;
+	delta_t_channel.delta_t_pos = 0;
+	delta_t_channel.delta_t_accum = 0;
+	delta_t_channel.prev_accum = 0;
+	delta_t_channel.current_step = 127;
     }
 
-    void YM2608::clock_adpcm()
+    void YM2608::advance_delta_t_address()
     {
-	int num_adpcm_channels = 4;
-	adpcm_ch_clock += 1;
+	delta_t_channel.current_addr = ((delta_t_channel.current_addr + 1) & 0xFFFFFF);
 
-	if (adpcm_ch_clock == 2)
+	// Past the limit address, the address wraps back around to the start of memory
+	if ((delta_t_channel.current_addr >> get_delta_t_shift()) > delta_t_channel.limit_addr)
 	{
-	    adpcm_ch_clock = 0;
-	    num_adpcm_channels = 6;
+	    delta_t_channel.current_addr = 0;
 	}
+    }
 
-	for (int ch = 0; ch < num_adpcm_channels; ch++)
+    uint8_t YM2608::readROM(uint32_t address)
+    {
+	if (delta_mem != NULL)
 	{
-	    clock_adpcm(adpcm_channels[ch]);
+	    return (address < delta_mem_size) ? delta_mem[address] : 0;
 	}
+
+	if (inter == NULL)
+	{
+	    return 0;
+	}
+
+	return inter->readMemory(BeeNukedAccessType::DeltaT, address);
     }
 
-    uint8_t YM2608::fetchADPCMROM(uint32_t address)
+    void YM2608::writeRAM(uint32_t address, uint8_t data)
     {
-	return (address < opna_adpcm_rom.size()) ? opna_adpcm_rom.at(address) : 0;
+	if (delta_mem != NULL)
+	{
+	    if ((delta_ram != NULL) && (address < delta_mem_size))
+	    {
+		delta_ram[address] = data;
+	    }
+
+	    return;
+	}
+
+	if (inter == NULL)
+	{
+	    return;
+	}
+
+	inter->writeMemory(BeeNukedAccessType::DeltaT, address, data);
     }
 
-    void YM2608::clock_adpcm(opna_adpcm &channel)
+    void YM2608::clock_delta_t()
     {
-	if (!channel.is_keyon)
+	if (!delta_t_channel.is_keyon)
 	{
-	    channel.reg_accum = 0;
 	    return;
 	}
 
-	int adpcm_data = 0;
+	uint32_t position = (delta_t_channel.delta_t_pos + delta_t_channel.delta_n);
+	delta_t_channel.delta_t_pos = (position & 0xFFFF);
+
+	if (position < 0x10000)
+	{
+	    return;
+	}
 
-	if (!channel.is_high_nibble)
+	if ((delta_t_channel.current_addr >> get_delta_t_shift()) > delta_t_channel.end_addr)
 	{
-	    uint32_t end = (channel.end_address + 1);
+	    set_status_bit(2);
 
-	    if (((channel.current_address ^ end) & 0xFFFFF) == 0)
+	    if (delta_t_channel.is_repeat)
+	    {
+		restart_delta_t();
+	    }
+	    else
 	    {
-		channel.is_keyon = false;
-		channel.reg_accum = 0;
+		delta_t_channel.is_keyon = false;
+		delta_t_channel.delta_t_accum = 0;
+		delta_t_channel.prev_accum = 0;
 		return;
 	    }
-
-	    channel.current_byte = fetchADPCMROM(channel.current_address++);
-	    adpcm_data = (channel.current_byte >> 4);
 	}
-	else
+
+	if (!delta_t_channel.is_high_nibble)
 	{
-	    adpcm_data = (channel.current_byte & 0xF);
+	    delta_t_channel.current_byte = readROM(delta_t_channel.current_addr);
+	    advance_delta_t_address();
 	}
 
-	channel.is_high_nibble = !channel.is_high_nibble;
+	uint8_t data = (uint8_t(delta_t_channel.current_byte << (4 * delta_t_channel.is_high_nibble)) >> 4);
+	delta_t_channel.is_high_nibble = !delta_t_channel.is_high_nibble;
 
-	int32_t delta = (2 * (adpcm_data & 0x7) + 1) * adpcm_steps[channel.current_step] / 8;
+	delta_t_channel.prev_accum = delta_t_channel.delta_t_accum;
 
-	if (testbit(adpcm_data, 3))
+	int32_t delta = (2 * (data & 0x7) + 1) * delta_t_channel.current_step / 8;
+
+	if (testbit(data, 3))
 	{
 	    delta = -delta;
 	}
 
-	channel.reg_accum = ((channel.reg_accum + delta) & 0xFFF);
-	int8_t step_inc = adpcm_steps_inc[(adpcm_data & 0x7)];
-	channel.current_step = clamp<int32_t>((channel.current_step + step_inc), 0, 48);
-    }
+	delta_t_channel.delta_t_accum = clamp((delta_t_channel.delta_t_accum + delta), -32768, 32767);
 
-    void YM2608::output_adpcm(opna_adpcm &channel)
-    {
-	int vol = ((channel.total_level ^ 0x1F) + (adpcm_total_level ^ 0x3F));
+	uint8_t step_scale = delta_t_step_scale[(data & 0x7)];
 
-	if (vol >= 63)
-	{
-	    return;
-	}
+	delta_t_channel.current_step = clamp(((delta_t_channel.current_step * step_scale) / 64), 127, 24576);
+    }
 
-	int8_t mul = (15 - (vol & 0x7));
-	uint8_t shift = (5 + (vol >> 3));
+    void YM2608::delta_t_output()
+    {
+	auto m_prev_accum = delta_t_channel.prev_accum;
+	auto m_position = delta_t_channel.delta_t_pos;
+	auto m_accum = delta_t_channel.delta_t_accum;
 
-	int16_t value = (((int16_t(channel.reg_accum << 4) * mul) >> shift) & ~3);
+	int32_t result = ((m_prev_accum * int32_t((m_position ^ 0xFFFF) + 1) + m_accum * int32_t(m_position)) >> 16);
 
-	channel.output[0] = (channel.is_pan_left) ? value : 0;
-	channel.output[1] = (channel.is_pan_right) ? value : 0;
+	result = ((result * int32_t(delta_t_channel.ch_volume)) >> 9);
+	delta_t_channel.delta_t_output = result;
     }
 
     void YM2608::clock_fm_and_adpcm()
     {
+	BEENUKED_PROFILE_START();
+	clock_timers();
+	BEENUKED_PROFILE_LAP(ProfileTimers);
+	clock_lfo();
+	BEENUKED_PROFILE_LAP(ProfileLFO);
+
+	for (auto &channel : channels)
+	{
+	    clock_ssg_eg(channel);
+	}
+
+	BEENUKED_PROFILE_LAP(ProfileSSGEG);
+
 	env_timer += 1;
 
+	// Update the envelope generator and the rhythm channels every 3 cycles
 	if (env_timer == 3)
 	{
 	    env_timer = 0;
 	    env_clock += 1;
+	    clock_envelope_gen();
+	    BEENUKED_PROFILE_LAP(ProfileEnvelope);
 	    clock_adpcm();
+	    BEENUKED_PROFILE_LAP(ProfileRhythm);
+	}
+
+	// Clock the phase generator
+	for (auto &channel : channels)
+	{
+	    clock_phase(channel);
+	}
+
+	BEENUKED_PROFILE_LAP(ProfilePhase);
+
+	// Generate channel output
+	for (auto &channel : channels)
+	{
+	    channel_output(channel);
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileOutput);
+
 	for (auto &channel : adpcm_channels)
 	{
 	    output_adpcm(channel);
 	}
+
+	BEENUKED_PROFILE_LAP(ProfileRhythm);
+
+	clock_delta_t();
+	delta_t_output();
+	BEENUKED_PROFILE_LAP(ProfileADPCM);
     }
 
     void YM2608::output_fm_and_adpcm()
     {
-	array<int32_t, 2> mixed_samples = {0, 0};
+	array<int32_t, 2> mixed_samples = output_fm();
+
 	for (auto &channel : adpcm_channels)
 	{
 	    for (int i = 0; i < 2; i++)
@@ -244,147 +1449,79 @@ namespace beenuked
 	    }
 	}
 
+	mixed_samples[0] += (delta_t_channel.is_pan_left) ? delta_t_channel.delta_t_output : 0;
+	mixed_samples[1] += (delta_t_channel.is_pan_right) ? delta_t_channel.delta_t_output : 0;
+
 	mixed_samples[0] = clamp<int32_t>(mixed_samples[0], -32768, 32767);
 	mixed_samples[1] = clamp<int32_t>(mixed_samples[1], -32768, 32767);
 
 	copy(mixed_samples.begin(), mixed_samples.end(), (last_samples.begin() + 1));
+	BEENUKED_PROFILE_LAP(ProfileMix);
+    }
+
+    int32_t YM2608::clock_ssg()
+    {
+	BEENUKED_PROFILE_START();
+
+	BeeNukedSSGResampler::ssg_frame sum;
+	ssg_resampler.resample(&sum, 1, [&](BeeNukedSSGResampler::ssg_frame &sample) {
+	    if (inter != NULL)
+	    {
+		inter->clockSSG();
+		sample = inter->getSSGSamples();
+	    }
+	});
+
+	ssg_sample_index += 1;
+	BEENUKED_PROFILE_LAP(ProfileSSG);
+	return ((sum[0] + sum[1] + sum[2]) * 2 / (3 * ssg_resampler.get_divisor()));
     }
 
-    void YM2608::configure_ssg_resampler(uint8_t out_samples, uint8_t src_samples)
+    void YM2608::write_port0(uint8_t reg, uint8_t data)
     {
-	switch ((out_samples * 10) + src_samples)
+	switch ((reg & 0xF0))
 	{
-	    case 43:
+	    case 0x00:
 	    {
-		resample = [&]() {
-		    resample_4_3();
-		};
+		if (inter != NULL)
+		{
+		    inter->writeSSG(1, data);
+		}
 	    }
 	    break;
-	    case 23:
+	    case 0x10:
 	    {
-		resample = [&]() {
-		    resample_2_3();
-		};
+		write_adpcm(reg, data);
 	    }
 	    break;
-	    case 13:
+	    case 0x20:
 	    {
-		resample = [&]() {
-		    resample_1_3();
-		};
+		write_mode(reg, data);
 	    }
 	    break;
 	    default:
 	    {
-		resample = [&]() {
-		    resample_nop();
-		};
+		write_fmreg(false, reg, data);
 	    }
 	    break;
 	}
     }
 
-    void YM2608::add_last(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale)
-    {
-	sum0 += (last_ssg_samples[0] * scale);
-	sum1 += (last_ssg_samples[1] * scale);
-	sum2 += (last_ssg_samples[2] * scale);
-    }
-
-    void YM2608::clock_and_add(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale)
-    {
-	if (inter != NULL)
-	{
-	    inter->clockSSG();
-	    last_ssg_samples = inter->getSSGSamples();
-	}
-
-	add_last(sum0, sum1, sum2, scale);
-    }
-
-    void YM2608::write_to_output(int32_t sum0, int32_t sum1, int32_t sum2, int divisor)
-    {
-	last_samples[0] = ((sum0 + sum1 + sum2) * 2 / (3 * divisor));
-	ssg_sample_index += 1;
-    }
-
-    void YM2608::resample_4_3()
-    {
-	int32_t sum0 = 0;
-	int32_t sum1 = 0;
-	int32_t sum2 = 0;
-	int step = (ssg_sample_index & 0x3);
-
-	add_last(sum0, sum1, sum2, step);
-
-	if (step != 3)
-	{
-	    clock_and_add(sum0, sum1, sum2, (3 - step));
-	}
-
-	write_to_output(sum0, sum1, sum2, 3);
-    }
-
-    void YM2608::resample_2_3()
-    {
-	int32_t sum0 = 0;
-	int32_t sum1 = 0;
-	int32_t sum2 = 0;
-
-	if (testbit(ssg_sample_index, 0))
-	{
-	    clock_and_add(sum0, sum1, sum2, 2);
-	    clock_and_add(sum0, sum1, sum2, 1);
-	}
-	else
-	{
-	    add_last(sum0, sum1, sum2, 1);
-	    clock_and_add(sum0, sum1, sum2, 2);
-	}
-
-	write_to_output(sum0, sum1, sum2, 3);
-    }
-
-    void YM2608::resample_1_3()
-    {
-	int32_t sum0 = 0;
-	int32_t sum1 = 0;
-	int32_t sum2 = 0;
-
-	for (int rep = 0; rep < 3; rep++)
-	{
-	    clock_and_add(sum0, sum1, sum2);
-	}
-
-	write_to_output(sum0, sum1, sum2, 3);
-    }
-
-    void YM2608::resample_nop()
-    {
-	ssg_sample_index += 1;
-    }
-
-    void YM2608::write_port0(uint8_t reg, uint8_t data)
+    void YM2608::write_port1(uint8_t reg, uint8_t data)
     {
 	switch ((reg & 0xF0))
 	{
 	    case 0x00:
-	    {
-		if (inter != NULL)
-		{
-		    inter->writeSSG(1, data);
-		}
-	    }
-	    break;
 	    case 0x10:
 	    {
-		write_adpcm(reg, data);
+		write_delta_t(reg, data);
 	    }
 	    break;
+	    // 0x20-0x2F are unused on port 1
+	    case 0x20: break;
 	    default:
 	    {
-		cout << "Writing value of " << hex << int(data) << " to YM2608 FM register of " << hex << int(reg) << endl;
+		write_fmreg(true, reg, data);
 	    }
 	    break;
 	}
@@ -398,18 +1535,15 @@ namespace beenuked
     void YM2608::init()
     {
 	// Configure ADPCM percussion sounds
-	adpcm_channels[0].start_address = 0x0000;
-	adpcm_channels[0].end_address = 0x01BF;
-	adpcm_channels[1].start_address = 0x01C0;
-	adpcm_channels[1].end_address = 0x043F;
-	adpcm_channels[2].start_address = 0x0440;
-	adpcm_channels[2].end_address = 0x1B7F;
-	adpcm_channels[3].start_address = 0x1B80;
-	adpcm_channels[3].end_address = 0x1CFF;
-	adpcm_channels[4].start_address = 0x1D00;
-	adpcm_channels[4].end_address = 0x1F7F;
-	adpcm_channels[5].start_address = 0x1F80;
-	adpcm_channels[5].end_address = 0x1FFF;
+	auto &rhythm_samples = get_rhythm_samples();
+
+	for (int ch = 0; ch < 6; ch++)
+	{
+	    adpcm_channels[ch].start_address = adpcm_rhythm_addresses[ch][0];
+	    adpcm_channels[ch].end_address = adpcm_rhythm_addresses[ch][1];
+	    adpcm_channels[ch].samples = &rhythm_samples[ch];
+	}
+
 	reset();
     }
 
@@ -417,6 +1551,31 @@ namespace beenuked
     {
 	set_prescaler(prescaler_six);
 	last_samples.fill(0);
+
+	init_tables();
+
+	for (int ch = 0; ch < 6; ch++)
+	{
+	    channels[ch].number = ch;
+	}
+
+	for (auto &channel : channels)
+	{
+	    // Both outputs are enabled on reset
+	    channel.is_left_output = true;
+	    channel.is_right_output = true;
+
+	    for (auto &oper : channel.opers)
+	    {
+		oper.env_output = 0x3FF;
+		oper.env_state = opna_oper_state::Off;
+	    }
+	}
+
+	delta_t_channel.limit_addr = 0xFFFF;
+
+	timera_counter = 1023;
+	timerb_counter = 255;
     }
 
     void YM2608::setInterface(BeeNukedInterface *cb)
@@ -426,7 +1585,27 @@ namespace beenuked
 
     uint8_t YM2608::readIO(int port)
     {
-	return 0;
+	uint8_t data = 0;
+
+	switch ((port & 3))
+	{
+	    // Status 0 register (YM2203 compatible)
+	    case 0: data = (opna_status & 0x3); break;
+	    case 1:
+	    {
+		// FF: ID code
+		if (chip_address == 0xFF)
+		{
+		    data = 0x01;
+		}
+	    }
+	    break;
+	    // Status 1 register
+	    case 2: data = opna_status; break;
+	    default: data = 0; break;
+	}
+
+	return data;
     }
 
     void YM2608::writeIO(int port, uint8_t data)
@@ -460,6 +1639,7 @@ namespace beenuked
 		    return; // Verified on real YM2608
 		}
 
+		BEENUKED_PROFILE_WRITE(chip_address);
 		write_port0(chip_address, data);
 	    }
 	    break;
@@ -476,7 +1656,8 @@ namespace beenuked
 		    return; // Verified on real YM2608
 		}
 
-		cout << "Writing value of " << hex << int(data) << " to YM2608 port 1 register of " << hex << int(chip_address) << endl;
+		BEENUKED_PROFILE_WRITE((0x100 | chip_address));
+		write_port1(chip_address, data);
 	    }
 	    break;
 	}
@@ -484,16 +1665,15 @@ namespace beenuked
 
     void YM2608::clockchip()
     {
-	if ((ssg_sample_index % fm_samples_per_output) == 0)
+	if (fm_clock_countdown == 0)
 	{
 	    clock_fm_and_adpcm();
 	    output_fm_and_adpcm();
+	    fm_clock_countdown = fm_samples_per_output;
 	}
 
-	if (resample)
-	{
-	    resample();
-	}
+	fm_clock_countdown -= 1;
+	last_samples[0] = clock_ssg();
     }
 
     vector<int32_t> YM2608::get_samples()
@@ -505,4 +1685,190 @@ namespace beenuked
 	}
 	return final_samples;
     }
+
+    void YM2608::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	buffer.reserve((buffer.size() + (num_samples * last_samples.size())));
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    clockchip();
+	    buffer.insert(buffer.end(), last_samples.begin(), last_samples.end());
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YM2608::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    void YM2608::set_ssg_band_limited(bool val)
+    {
+	ssg_resampler.set_band_limited(val);
+    }
+
+    void YM2608::attachDelta_RAM(uint8_t *ram_data, uint32_t ram_size)
+    {
+	delta_mem = ram_data;
+	delta_ram = ram_data;
+	delta_mem_size = ram_size;
+    }
+
+    void YM2608::attachDelta_ROM(const uint8_t *rom_data, uint32_t rom_size)
+    {
+	delta_mem = rom_data;
+	delta_ram = NULL;
+	delta_mem_size = rom_size;
+    }
+
+    template<typename Archive>
+    void YM2608::opna_delta_t::serialize_state(Archive &state)
+    {
+	state.value(is_keyon);
+	state.value(is_record);
+	state.value(is_external);
+	state.value(is_repeat);
+	state.value(is_rom);
+	state.value(is_dram_8bit);
+	state.value(is_pan_left);
+	state.value(is_pan_right);
+	state.value(start_addr);
+	state.value(end_addr);
+	state.value(limit_addr);
+	state.value(current_addr);
+	state.value(is_high_nibble);
+	state.value(current_byte);
+	state.value(delta_t_pos);
+	state.value(delta_t_accum);
+	state.value(prev_accum);
+	state.value(current_step, 0, 24576);
+	state.value(delta_n);
+	state.value(ch_volume, 0, 0xFF);
+	state.value(delta_t_output);
+    }
+
+    template<typename Archive>
+    void YM2608::opna_operator::serialize_state(Archive &state)
+    {
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(multiply, 0, 15);
+	state.value(detune, 0, 7);
+	state.value(total_level, 0, 0x3FF);
+	state.value(keycode, 0, 31);
+	state.value(key_scaling, 0, 3);
+	state.value(ksr_val, 0, 31);
+	state.value(attack_rate, 0, 31);
+	state.value(decay_rate, 0, 31);
+	state.value(sustain_rate, 0, 31);
+	state.value(sustain_level, 0, 0x3FF);
+	state.value(release_rate, 0, 15);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(is_keyon);
+	state.value(ssg_enable);
+	state.value(ssg_att);
+	state.value(ssg_alt);
+	state.value(ssg_hold);
+	state.value(ssg_inv);
+	state.value(lfo_enable);
+	state.value(lfo_pm_sens, 0, 7);
+	state.value(lfo_am_sens, 0, 3);
+	state.value(env_output, 0, 0x3FF);
+	state.value(env_rate, 0, 63);
+	state.value(env_state, Attack, Off);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YM2608::opna_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 5);
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(ch_mode, 0, 3);
+	state.value(oper_fnums, 0, 0x7FF);
+	state.value(oper_block, 0, 7);
+	state.value(is_csm_keyon);
+	state.value(is_left_output);
+	state.value(is_right_output);
+	state.value(lfo_pm_sens, 0, 7);
+	state.value(lfo_am_sens, 0, 3);
+	state.value(feedback, 0, 7);
+	state.value(algorithm, 0, 7);
+	state.value(output);
+	state.value(opers);
+    }
+
+    template<typename Archive>
+    void YM2608::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(is_addr_a1);
+	state.value(prescaler_val, prescaler_six, prescaler_two);
+	state.value(fm_samples_per_output, 2, 6);
+	state.value(fm_clock_countdown, 0, fm_samples_per_output);
+	state.value(ssg_sample_index);
+	state.value(last_samples);
+	state.value(env_timer);
+	state.value(env_clock);
+	state.value(adpcm_ch_clock);
+	state.value(adpcm_total_level, 0, 0x3F);
+
+	// The rhythm channels' sample pointers are set up by init(),
+	// so only their playback state is saved
+	for (auto &channel : adpcm_channels)
+	{
+	    state.value(channel.is_keyon);
+	    state.value(channel.is_pan_left);
+	    state.value(channel.is_pan_right);
+	    state.value(channel.total_level, 0, 0x1F);
+	    state.value(channel.start_address);
+	    state.value(channel.end_address);
+	    state.value(channel.sample_pos);
+	    state.value(channel.reg_accum);
+	    state.value(channel.output);
+	}
+
+	state.value(delta_t_channel);
+	state.value(timera_freq, 0, 0x3FF);
+	state.value(timerb_freq, 0, 0xFF);
+	state.value(timera_counter);
+	state.value(timerb_counter);
+	state.value(is_timera_running);
+	state.value(is_timerb_running);
+	state.value(is_timera_enabled);
+	state.value(is_timerb_enabled);
+	state.value(opna_status);
+	state.value(status_mask);
+	state.value(is_6ch_mode);
+	state.value(is_lfo_enabled);
+	state.value(lfo_rate, 0, 7);
+	state.value(lfo_counter);
+	state.value(lfo_am);
+	state.value(lfo_raw_pm);
+	state.value(channels);
+	ssg_resampler.serialize_state(state);
+    }
+
+    void YM2608::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYM2608, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YM2608::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYM2608, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 }
\ No newline at end of file
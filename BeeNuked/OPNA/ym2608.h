@@ -20,6 +20,10 @@
 #define BEENUKED_YM2608
 
 #include "utils.h"
+#include "ssg_resampler.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -39,6 +43,41 @@ namespace beenuked
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+	    // Attaches the ADPCM-B sample memory directly (no copy is made, so it must outlive the chip).
+	    // Sample RAM can also be written through the ADPCM-B data register,
+	    // while writes to sample ROM are ignored.
+	    // Without attached memory, samples are accessed through the interface instead.
+	    void attachDelta_RAM(uint8_t *ram_data, uint32_t ram_size);
+	    void attachDelta_ROM(const uint8_t *rom_data, uint32_t rom_size);
+
+	    // Switches the SSG resampler from the chip's box filter to a band-limited (windowed-sinc) filter
+	    void set_ssg_band_limited(bool val);
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -60,6 +99,7 @@ namespace beenuked
 	    int prescaler_val = 0;
 
 	    int fm_samples_per_output = 0;
+	    int fm_clock_countdown = 0;
 
 	    uint64_t ssg_sample_index = 0;
 
@@ -69,26 +109,13 @@ namespace beenuked
 	    array<int32_t, 3> last_samples = {0, 0, 0};
 
 	    void write_port0(uint8_t reg, uint8_t data);
+	    void write_port1(uint8_t reg, uint8_t data);
 
 	    void set_prescaler(int value);
 
-	    void configure_ssg_resampler(uint8_t out_samples, uint8_t src_samples);
-
-	    using resample_func = function<void()>;
-
-	    resample_func resample;
-
-	    void resample_4_3();
-	    void resample_2_3();
-	    void resample_1_3();
-	    void resample_nop();
-
-	    array<int32_t, 3> ssg_samples = {0, 0, 0};
-	    array<int32_t, 3> last_ssg_samples = {0, 0, 0};
+	    BeeNukedSSGResampler ssg_resampler;
 
-	    void add_last(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale = 1);
-	    void clock_and_add(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale = 1);
-	    void write_to_output(int32_t sum0, int32_t sum1, int32_t sum2, int divisor = 1);
+	    int32_t clock_ssg();
 
 	    void update_prescaler();
 
@@ -98,6 +125,9 @@ namespace beenuked
 	    void clock_adpcm();
 
 	    void write_adpcm(uint8_t reg, uint8_t data);
+	    void write_delta_t(uint8_t reg, uint8_t data);
+	    void write_mode(uint8_t reg, uint8_t data);
+	    void write_fmreg(bool is_port1, uint8_t reg, uint8_t data);
 
 	    struct opna_adpcm
 	    {
@@ -107,21 +137,81 @@ namespace beenuked
 		int total_level = 0;
 		uint32_t start_address = 0;
 		uint32_t end_address = 0;
-		uint32_t current_address = 0;
-		bool is_high_nibble = false;
-		uint8_t current_byte = 0;
+		const vector<uint16_t> *samples = NULL;
+		size_t sample_pos = 0;
 		int32_t reg_accum = 0;
-		int32_t current_step = 0;
 		array<int32_t, 2> output = {0, 0};
 	    };
 
 	    int adpcm_total_level = 0;
 	    array<opna_adpcm, 6> adpcm_channels;
 
+	    struct opna_delta_t
+	    {
+		bool is_keyon = false;
+		bool is_record = false;
+		bool is_external = false;
+		bool is_repeat = false;
+		bool is_rom = false;
+		bool is_dram_8bit = false;
+		bool is_pan_left = false;
+		bool is_pan_right = false;
+		uint32_t start_addr = 0;
+		uint32_t end_addr = 0;
+		uint32_t limit_addr = 0;
+		uint32_t current_addr = 0;
+		bool is_high_nibble = false;
+		uint8_t current_byte = 0;
+		uint32_t delta_t_pos = 0;
+		int32_t delta_t_accum = 0;
+		int32_t prev_accum = 0;
+		int32_t current_step = 0;
+		uint32_t delta_n = 0;
+		uint32_t ch_volume = 0;
+		int32_t delta_t_output = 0;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
+	    };
+
+	    opna_delta_t delta_t_channel;
+
+	    const uint8_t *delta_mem = NULL;
+	    uint8_t *delta_ram = NULL;
+	    uint32_t delta_mem_size = 0;
+
+	    // ROM and 8-bit DRAM are addressed in units of 32 bytes,
+	    // while 1-bit DRAM is addressed in units of 4 bytes
+	    int get_delta_t_shift()
+	    {
+		if (delta_t_channel.is_rom || delta_t_channel.is_dram_8bit)
+		{
+		    return 5;
+		}
+
+		return 2;
+	    }
+
+	    void restart_delta_t();
+	    void advance_delta_t_address();
+	    void clock_delta_t();
+	    void delta_t_output();
+
+	    uint8_t readROM(uint32_t address);
+	    void writeRAM(uint32_t address, uint8_t data);
+
 	    uint32_t env_timer = 0;
 	    uint32_t env_clock = 0;
 	    uint32_t adpcm_ch_clock = 0;
 
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
 	    #include "ym2608_adpcm_rom.inl"
 	    #include "opna_tables.inl"
 
@@ -131,6 +221,158 @@ namespace beenuked
 	    void output_adpcm(opna_adpcm &channel);
 
 	    uint8_t fetchADPCMROM(uint32_t address);
+
+	    // The rhythm sounds are decoded from the internal ROM on first use,
+	    // and are then shared by every YM2608 instance
+	    typedef array<vector<uint16_t>, 6> opna_rhythm_samples;
+
+	    const opna_rhythm_samples &get_rhythm_samples();
+	    vector<uint16_t> decode_rhythm_sample(uint32_t start_addr, uint32_t end_addr);
+
+	    uint16_t timera_freq = 0;
+	    uint16_t timerb_freq = 0;
+
+	    uint16_t timera_counter = 0;
+	    uint16_t timerb_counter = 0;
+
+	    bool is_timera_running = false;
+	    bool is_timerb_running = false;
+
+	    bool is_timera_enabled = false;
+	    bool is_timerb_enabled = false;
+
+	    // Bits 0-1 are the timer flags, and bits 2-3 are the ADPCM-B end of sample and buffer ready flags
+	    // (any of which can be masked through the ADPCM-B flag control register)
+	    uint8_t opna_status = 0;
+	    uint8_t status_mask = 0;
+
+	    void set_status_bit(int bit);
+	    void reset_status_bit(int bit);
+
+	    void clock_timers();
+
+	    // When this is cleared, only the first 3 FM channels are output (YM2203 compatible mode)
+	    bool is_6ch_mode = false;
+
+	    bool is_lfo_enabled = false;
+	    int lfo_rate = 0;
+	    uint32_t lfo_counter = 0;
+	    int lfo_am = 0;
+	    int32_t lfo_raw_pm = 0;
+
+	    enum opna_oper_state : int
+	    {
+		Attack = 0,
+		Decay = 1,
+		Sustain = 2,
+		Release = 3,
+		Off = 4,
+	    };
+
+	    struct opna_operator
+	    {
+		int freq_num = 0;
+		int block = 0;
+		int multiply = 0;
+		int detune = 0;
+		int total_level = 0;
+
+		int keycode = 0;
+		int key_scaling = 0;
+		int ksr_val = 0;
+		int attack_rate = 0;
+		int decay_rate = 0;
+		int sustain_rate = 0;
+		int sustain_level = 0;
+		int release_rate = 0;
+
+		uint32_t phase_counter = 0;
+		uint32_t phase_freq = 0;
+		uint32_t phase_output = 0;
+		bool is_keyon = false;
+
+		bool ssg_enable = false;
+		bool ssg_att = false;
+		bool ssg_alt = false;
+		bool ssg_hold = false;
+		bool ssg_inv = false;
+
+		bool lfo_enable = false;
+
+		int lfo_pm_sens = 0;
+		int lfo_am_sens = 0;
+
+		int32_t env_output = 0;
+		int env_rate = 0;
+		opna_oper_state env_state = opna_oper_state::Off;
+
+		array<int32_t, 2> outputs = {0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
+	    };
+
+	    struct opna_channel
+	    {
+		int number = 0;
+		int freq_num = 0;
+		int block = 0;
+		int ch_mode = 0;
+
+		array<int, 3> oper_fnums = {0, 0, 0};
+		array<int, 3> oper_block = {0, 0, 0};
+		bool is_csm_keyon = false;
+		bool is_left_output = true;
+		bool is_right_output = true;
+		int lfo_pm_sens = 0;
+		int lfo_am_sens = 0;
+
+		int feedback = 0;
+		int algorithm = 0;
+		int32_t output = 0;
+		array<opna_operator, 4> opers;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
+	    };
+
+	    array<opna_channel, 6> channels;
+
+	    void init_tables();
+
+	    array<uint32_t, 256> sine_table;
+	    array<uint32_t, 256> exp_table;
+
+	    int32_t calc_output(uint32_t phase, int32_t mod, uint32_t env);
+
+	    void update_frequency(opna_channel &channel);
+	    void update_lfo(opna_channel &channel);
+	    void update_frequency(opna_operator &oper);
+	    void update_phase(opna_operator &oper);
+	    void update_ksr(opna_operator &oper);
+	    void calc_oper_rate(opna_operator &oper);
+	    void start_envelope(opna_operator &oper);
+
+	    void key_on(opna_channel &chan, opna_operator &oper);
+	    void key_off(opna_channel &chan, opna_operator &oper);
+	    int32_t get_env_output(opna_operator &oper);
+	    int32_t get_lfo_pm(opna_operator &oper);
+	    uint32_t get_lfo_am(opna_channel &channel);
+
+	    void update_ch3_mode(int val);
+
+	    void clock_lfo();
+	    void clock_envelope_gen();
+	    void clock_phase(opna_channel &channel);
+	    void clock_ssg_eg(opna_channel &channel);
+	    void clock_envelope(opna_channel &channel);
+
+	    void channel_output(opna_channel &channel);
+	    array<int32_t, 2> output_fm();
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
@@ -41,61 +41,38 @@ namespace beenuked
 {
     YM2610::YM2610()
     {
-	fm_samples_per_output = 1;
-	reset();
-    }
-
-    YM2610::~YM2610()
-    {
-
-    }
-
-    void YM2610::add_last(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale)
-    {
-	sum0 += (last_ssg_samples[0] * scale);
-	sum1 += (last_ssg_samples[1] * scale);
-	sum2 += (last_ssg_samples[2] * scale);
-    }
+	// 2 output samples for every 9 SSG samples
+	ssg_resampler.configure(2, 9);
 
-    void YM2610::clock_and_add(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale)
-    {
-	if (inter != NULL)
+	for (int page = 0; page < 16; page++)
 	{
-	    inter->clockSSG();
-	    last_ssg_samples = inter->getSSGSamples();
+	    adpcm_mem.banks[page] = (page << 20);
+	    delta_t_mem.banks[page] = (page << 20);
 	}
 
-	add_last(sum0, sum1, sum2, scale);
+	reset();
     }
 
-    void YM2610::write_to_output(int32_t sum0, int32_t sum1, int32_t sum2, int divisor)
+    YM2610::~YM2610()
     {
-	ssg_sample = ((sum0 + sum1 + sum2) * 2 / (3 * divisor));
-	ssg_sample_index += 1;
+
     }
 
-    void YM2610::resample()
+    int32_t YM2610::clock_ssg()
     {
-	int32_t sum0 = 0;
-	int32_t sum1 = 0;
-	int32_t sum2 = 0;
-
-	if (testbit(ssg_sample_index, 0))
-	{
-	    add_last(sum0, sum1, sum2, 1);
-	}
-
-	clock_and_add(sum0, sum1, sum2, 2);
-	clock_and_add(sum0, sum1, sum2, 2);
-	clock_and_add(sum0, sum1, sum2, 2);
-	clock_and_add(sum0, sum1, sum2, 2);
+	BEENUKED_PROFILE_START();
 
-	if (!testbit(ssg_sample_index, 0))
-	{
-	    clock_and_add(sum0, sum1, sum2, 1);
-	}
+	BeeNukedSSGResampler::ssg_frame sum;
+	ssg_resampler.resample(&sum, 1, [&](BeeNukedSSGResampler::ssg_frame &sample) {
+	    if (inter != NULL)
+	    {
+		inter->clockSSG();
+		sample = inter->getSSGSamples();
+	    }
+	});
 
-	write_to_output(sum0, sum1, sum2, 9);
+	BEENUKED_PROFILE_LAP(ProfileSSG);
+	return ((sum[0] + sum[1] + sum[2]) * 2 / (3 * ssg_resampler.get_divisor()));
     }
 
     void YM2610::write_port0(uint8_t reg, uint8_t data)
@@ -146,14 +123,7 @@ namespace beenuked
 	    case 0x21: break;
 	    case 0x22:
 	    {
-		if (testbit(data, 3))
-		{
-		    cout << "LFO enabled" << endl;
-		}
-		else
-		{
-		    cout << "LFO disabled" << endl;
-		}
+		BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 	    }
 	    break;
 	    case 0x24:
@@ -173,8 +143,11 @@ namespace beenuked
 	    break;
 	    case 0x27:
 	    {
-		int ch3_mode = ((data >> 6) & 0x3);
-		cout << "Channel 3 mode: " << dec << ch3_mode << endl;
+		// Channel 3 mode is part of the FM section, which isn't emulated yet
+		if ((data & 0xC0) != 0)
+		{
+		    BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
+		}
 
 		if (testbit(data, 4))
 		{
@@ -204,19 +177,7 @@ namespace beenuked
 	    break;
 	    case 0x28:
 	    {
-		int ch_num = (data & 0x3);
-
-		if (ch_num == 3)
-		{
-		    return;
-		}
-
-		if (testbit(data, 2))
-		{
-		    ch_num += 4;
-		}
-
-		cout << "Key-on/off for channel number " << dec << ch_num << endl;
+		BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 	    }
 	    break;
 	}
@@ -278,21 +239,25 @@ namespace beenuked
 		    break;
 		    case 0x10:
 		    {
+			resync_adpcm_channel(channel);
 			channel.start_addr = ((channel.start_addr & 0xFF00) | data);
 		    }
 		    break;
 		    case 0x18:
 		    {
+			resync_adpcm_channel(channel);
 			channel.start_addr = ((channel.start_addr & 0x00FF) | (data << 8));
 		    }
 		    break;
 		    case 0x20:
 		    {
+			resync_adpcm_channel(channel);
 			channel.end_addr = ((channel.end_addr & 0xFF00) | data);
 		    }
 		    break;
 		    case 0x28:
 		    {
+			resync_adpcm_channel(channel);
 			channel.end_addr = ((channel.end_addr & 0x00FF) | (data << 8));
 		    }
 		    break;
@@ -305,6 +270,11 @@ namespace beenuked
 
     uint8_t YM2610::fetch_adpcm_rom(uint32_t address)
     {
+	if (adpcm_mem.data != NULL)
+	{
+	    return read_rom(adpcm_mem, address);
+	}
+
 	if (inter == NULL)
 	{
 	    return 0;
@@ -315,6 +285,11 @@ namespace beenuked
 
     uint8_t YM2610::fetch_delta_t_rom(uint32_t address)
     {
+	if (delta_t_mem.data != NULL)
+	{
+	    return read_rom(delta_t_mem, address);
+	}
+
 	if (inter == NULL)
 	{
 	    return 0;
@@ -323,6 +298,21 @@ namespace beenuked
 	return inter->readMemory(BeeNukedAccessType::DeltaT, address);
     }
 
+    void YM2610::decode_adpcm_nibble(int32_t &accum, int32_t &step, uint8_t data)
+    {
+	int32_t delta = (2 * (data & 0x7) + 1) * adpcm_steps[step] / 8;
+
+	if (testbit(data, 3))
+	{
+	    delta = -delta;
+	}
+
+	accum = ((accum + delta) & 0xFFF);
+
+	int8_t step_inc = adpcm_steps_inc[(data & 0x7)];
+	step = clamp((step + step_inc), 0, 48);
+    }
+
     void YM2610::clock_adpcm_channel(opnb_adpcm &channel)
     {
 	if (!channel.is_keyon)
@@ -331,6 +321,22 @@ namespace beenuked
 	    return;
 	}
 
+	if (channel.decoded_sample)
+	{
+	    auto &samples = *channel.decoded_sample;
+
+	    if (channel.decoded_pos >= samples.size())
+	    {
+		channel.is_keyon = false;
+		channel.adpcm_accum = 0;
+		channel.decoded_sample.reset();
+		return;
+	    }
+
+	    channel.adpcm_accum = (samples[channel.decoded_pos++] & 0xFFF);
+	    return;
+	}
+
 	uint8_t data = 0;
 
 	if (!channel.is_high_nibble)
@@ -353,18 +359,143 @@ namespace beenuked
 	}
 
 	channel.is_high_nibble = !channel.is_high_nibble;
+	decode_adpcm_nibble(channel.adpcm_accum, channel.adpcm_step, data);
+    }
 
-	int32_t delta = (2 * (data & 0x7) + 1) * adpcm_steps[channel.adpcm_step] / 8;
+    YM2610::opnb_decoded_ptr YM2610::fetch_decoded_sample(opnb_adpcm &channel)
+    {
+	// Only samples from an in-core ROM can be cached,
+	// as the interface gives no guarantee that its memory won't change
+	if ((adpcm_cache_limit == 0) || (adpcm_mem.data == NULL))
+	{
+	    return NULL;
+	}
 
-	if (testbit(data, 3))
+	uint32_t key = ((channel.start_addr << 16) | channel.end_addr);
+	auto iter = adpcm_cache_index.find(key);
+
+	if (iter != adpcm_cache_index.end())
 	{
-	    delta = -delta;
+	    adpcm_cache_hits += 1;
+	    adpcm_cache.splice(adpcm_cache.begin(), adpcm_cache, iter->second);
+	    return iter->second->samples;
 	}
 
-	channel.adpcm_accum = ((channel.adpcm_accum + delta) & 0xFFF);
+	adpcm_cache_misses += 1;
 
-	int8_t step_inc = adpcm_steps_inc[(data & 0x7)];
-	channel.adpcm_step = clamp((channel.adpcm_step + step_inc), 0, 48);
+	// Playback stops once the low 20 bits of the address reach the end address
+	uint32_t start = (channel.start_addr << 8);
+	uint32_t length = ((((channel.end_addr + 1) << 8) - start) & 0xFFFFF);
+	size_t num_bytes = (length * 2 * sizeof(uint16_t));
+
+	if (num_bytes > adpcm_cache_limit)
+	{
+	    return NULL;
+	}
+
+	auto samples = make_shared<vector<uint16_t>>();
+	samples->reserve((length * 2));
+
+	int32_t accum = 0;
+	int32_t step = 0;
+
+	for (uint32_t offset = 0; offset < length; offset++)
+	{
+	    uint8_t current_byte = fetch_adpcm_rom((start + offset));
+
+	    for (int shift = 4; shift >= 0; shift -= 4)
+	    {
+		uint8_t data = ((current_byte >> shift) & 0xF);
+		decode_adpcm_nibble(accum, step, data);
+		samples->push_back((accum | (data << 12)));
+	    }
+	}
+
+	while (!adpcm_cache.empty() && ((adpcm_cache_bytes + num_bytes) > adpcm_cache_limit))
+	{
+	    auto &oldest = adpcm_cache.back();
+	    adpcm_cache_bytes -= (oldest.samples->size() * sizeof(uint16_t));
+	    adpcm_cache_index.erase(oldest.key);
+	    adpcm_cache.pop_back();
+	}
+
+	opnb_cache_entry entry;
+	entry.key = key;
+	entry.samples = samples;
+	adpcm_cache.push_front(entry);
+	adpcm_cache_index[key] = adpcm_cache.begin();
+	adpcm_cache_bytes += num_bytes;
+	return samples;
+    }
+
+    // Switches a channel playing from a decoded buffer back to decoding from ROM,
+    // reconstructing the exact decoder state from the nibbles played so far
+    // (this must happen before the start or end address of a playing channel changes)
+    void YM2610::resync_adpcm_channel(opnb_adpcm &channel)
+    {
+	if (!channel.decoded_sample)
+	{
+	    return;
+	}
+
+	auto samples = channel.decoded_sample;
+	size_t pos = channel.decoded_pos;
+	channel.decoded_sample.reset();
+	channel.decoded_pos = 0;
+
+	// Key-on restarts the decoder anyways
+	if (!channel.is_keyon)
+	{
+	    return;
+	}
+
+	channel.current_addr = ((channel.start_addr << 8) + uint32_t((pos + 1) / 2));
+	channel.is_high_nibble = testbit(pos, 0);
+	channel.adpcm_accum = 0;
+	channel.adpcm_step = 0;
+
+	for (size_t i = 0; i < pos; i++)
+	{
+	    decode_adpcm_nibble(channel.adpcm_accum, channel.adpcm_step, ((*samples)[i] >> 12));
+	}
+
+	if (channel.is_high_nibble)
+	{
+	    channel.current_byte = ((((*samples)[pos - 1] >> 12) << 4) | ((*samples)[pos] >> 12));
+	}
+    }
+
+    void YM2610::invalidate_adpcm_cache()
+    {
+	for (auto &channel : adpcm_channels)
+	{
+	    resync_adpcm_channel(channel);
+	}
+
+	adpcm_cache.clear();
+	adpcm_cache_index.clear();
+	adpcm_cache_bytes = 0;
+    }
+
+    void YM2610::set_adpcm_cache_size(size_t max_bytes)
+    {
+	adpcm_cache_limit = max_bytes;
+	invalidate_adpcm_cache();
+    }
+
+    void YM2610::clear_adpcm_cache()
+    {
+	invalidate_adpcm_cache();
+    }
+
+    uint64_t YM2610::get_adpcm_cache_hits()
+    {
+	return adpcm_cache_hits;
+    }
+
+    uint64_t YM2610::get_adpcm_cache_misses()
+    {
+	return adpcm_cache_misses;
     }
 
     void YM2610::adpcm_channel_output(opnb_adpcm &channel)
@@ -461,7 +592,7 @@ namespace beenuked
 	    break;
 	    case 0x1C:
 	    {
-		cout << "Writing to Delta-T ADPCM flag control register" << endl;
+		BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 	    }
 	    break;
 	}
@@ -573,115 +704,12 @@ namespace beenuked
 	delta_t_output();
     }
 
+    // The FM section isn't emulated yet, so FM register writes are only traced
+    // (with port 1 registers reported as 0x1xx)
     void YM2610::write_fmreg(bool is_port1, uint8_t reg, uint8_t data)
     {
-	int reg_group = (reg & 0xF0);
-	int reg_addr = (reg & 0xF);
-
-	int ch_num = (reg_addr & 0x3);
-
-	if (ch_num == 3)
-	{
-	    return;
-	}
-
-	if (is_port1)
-	{
-	    ch_num += 3;
-	}
-
-	int oper_reg = ((reg_addr >> 2) & 0x3);
-	array<int, 4> oper_table = {0, 2, 1, 3};
-	int oper_num = oper_table[oper_reg];
-
-	switch (reg_group)
-	{
-	    case 0x30:
-	    {
-		cout << "Writing to detune/multiply register of channel " << dec << ch_num << ", operator " << dec << oper_num << endl;
-	    }
-	    break;
-	    case 0x40:
-	    {
-		cout << "Writing to total-level register of channel " << dec << ch_num << ", operator " << dec << oper_num << endl;
-	    }
-	    break;
-	    case 0x50:
-	    {
-		cout << "Writing to key-scaling/attack-rate register of channel " << dec << ch_num << ", operator " << dec << oper_num << endl;
-	    }
-	    break;
-	    case 0x60:
-	    {
-		cout << "Writing to lfo-enable/decay-rate register of channel " << dec << ch_num << ", operator " << dec << oper_num << endl;
-	    }
-	    break;
-	    case 0x70:
-	    {
-		cout << "Writing to sustain-rate register of channel " << dec << ch_num << ", operator " << dec << oper_num << endl;
-	    }
-	    break;
-	    case 0x80:
-	    {
-		cout << "Writing to sustain-level/release-rate register of channel " << dec << ch_num << ", operator " << dec << oper_num << endl;
-	    }
-	    break;
-	    case 0x90:
-	    {
-		cout << "Writing to SSG register of channel " << dec << ch_num << ", operator " << dec << oper_num << endl;
-	    }
-	    break;
-	    case 0xA0:
-	    {
-		switch (oper_reg)
-		{
-		    case 0:
-		    {
-			cout << "Writing to frequency LSB register of channel " << dec << ch_num << endl;
-		    }
-		    break;
-		    case 1:
-		    {
-			cout << "Writing to frequency MSB/block register of channel " << dec << ch_num << endl;
-		    }
-		    break;
-		    case 2:
-		    {
-			if (!is_port1)
-			{
-			    cout << "Writing to frequency LSB register of channel 3, operator " << dec << ch_num << endl;
-			}
-		    }
-		    break;
-		    case 3:
-		    {
-			if (!is_port1)
-			{
-			    cout << "Writing to frequency MSB/block register of channel 3, operator " << dec << ch_num << endl;
-			}
-		    }
-		    break;
-		}
-	    }
-	    break;
-	    case 0xB0:
-	    {
-		switch (oper_reg)
-		{
-		    case 0:
-		    {
-			cout << "Writing to feedback/algorithm register of channel " << dec << ch_num << endl;
-		    }
-		    break;
-		    case 1:
-		    {
-			cout << "Writing to panning/PMS/AMS register of channel " << dec << ch_num << endl;
-		    }
-		    break;
-		}
-	    }
-	    break;
-	}
+	uint16_t fm_reg = is_port1 ? (0x100 | reg) : reg;
+	BEENUKED_TRACE(TraceUnhandledWrite, fm_reg, data);
     }
 
     void YM2610::set_status_bit(int bit)
@@ -735,7 +763,9 @@ namespace beenuked
 
     void YM2610::clock_fm_and_adpcm()
     {
+	BEENUKED_PROFILE_START();
 	clock_timers();
+	BEENUKED_PROFILE_LAP(ProfileTimers);
 	env_timer += 1;
 
 	if (env_timer == 3)
@@ -747,6 +777,7 @@ namespace beenuked
 
 	clock_delta_t();
 	adpcm_output();
+	BEENUKED_PROFILE_LAP(ProfileADPCM);
     }
 
     void YM2610::output_fm_and_adpcm()
@@ -760,16 +791,20 @@ namespace beenuked
 	}
 
 	copy(mixed_samples.begin(), mixed_samples.end(), (last_samples.begin() + 1));
+	BEENUKED_PROFILE_LAP(ProfileMix);
     }
 
     void YM2610::adpcm_key_on(opnb_adpcm &channel)
     {
+	BEENUKED_PROFILE_KEY_ON();
 	channel.is_keyon = true;
 	channel.current_addr = (channel.start_addr << 8);
 	channel.is_high_nibble = false;
 	channel.current_byte = 0;
 	channel.adpcm_accum = 0;
 	channel.adpcm_step = 0;
+	channel.decoded_sample = fetch_decoded_sample(channel);
+	channel.decoded_pos = 0;
     }
 
     void YM2610::adpcm_key_off(opnb_adpcm &channel)
@@ -796,6 +831,8 @@ namespace beenuked
 	    channel.adpcm_accum = 0;
 	    channel.adpcm_step = 0;
 	    channel.adpcm_output = 0;
+	    channel.decoded_sample.reset();
+	    channel.decoded_pos = 0;
 	}
 
 	last_samples.fill(0);
@@ -820,7 +857,7 @@ namespace beenuked
 	    {
 		if (chip_address < 0x0E)
 		{
-		    cout << "Reading from YM2610 on-board PSG chip" << endl;
+		    BEENUKED_TRACE(TraceUnhandledRead, chip_address, 0);
 		    temp = 0x00;
 		}
 		else if (chip_address < 0x10)
@@ -874,6 +911,7 @@ namespace beenuked
 		    return; // Verified on real YM2608
 		}
 
+		BEENUKED_PROFILE_WRITE(chip_address);
 		write_port0(chip_address, data);
 	    }
 	    break;
@@ -890,13 +928,14 @@ namespace beenuked
 		    return; // Verified on real YM2608
 		}
 
+		BEENUKED_PROFILE_WRITE((0x100 | chip_address));
 		write_port1(chip_address, data);
 	    }
 	    break;
 	}
     }
 
-    void YM2610::writeADPCM_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, vector<uint8_t> rom_data)
+    void YM2610::writeADPCM_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, const vector<uint8_t> &rom_data)
     {
 	adpcm_rom.resize(rom_size, 0xFF);
 
@@ -914,9 +953,11 @@ namespace beenuked
 	}
 
 	copy(rom_data.begin(), (rom_data.begin() + data_length), (adpcm_rom.begin() + data_start));
+	set_rom_data(adpcm_mem, adpcm_rom.data(), adpcm_rom.size());
+	invalidate_adpcm_cache();
     }
 
-    void YM2610::writeDelta_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, vector<uint8_t> rom_data)
+    void YM2610::writeDelta_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, const vector<uint8_t> &rom_data)
     {
 	delta_t_rom.resize(rom_size, 0xFF);
 
@@ -934,18 +975,86 @@ namespace beenuked
 	}
 
 	copy(rom_data.begin(), (rom_data.begin() + data_length), (delta_t_rom.begin() + data_start));
+	set_rom_data(delta_t_mem, delta_t_rom.data(), delta_t_rom.size());
     }
 
-    void YM2610::clockchip()
+    void YM2610::set_rom_data(opnb_rom &rom, const uint8_t *data, uint32_t size)
     {
-	if ((ssg_sample_index % fm_samples_per_output) == 0)
+	uint32_t mask = 0;
+
+	while (mask < (size - 1))
 	{
-	    clock_fm_and_adpcm();
-	    output_fm_and_adpcm();
+	    mask = ((mask << 1) | 1);
 	}
 
-	resample();
-	last_samples[0] = ssg_sample;
+	rom.data = (size != 0) ? data : NULL;
+	rom.size = size;
+	rom.mask = mask;
+	rom.owner.reset();
+    }
+
+    void YM2610::attach_rom(opnb_rom &rom, vector<uint8_t> &rom_copy, const uint8_t *data, uint32_t size)
+    {
+	// Free up any ROM data previously copied in through writeADPCM_ROM/writeDelta_ROM
+	vector<uint8_t>().swap(rom_copy);
+	set_rom_data(rom, data, size);
+    }
+
+    void YM2610::attachADPCM_ROM(const uint8_t *rom_data, uint32_t rom_size)
+    {
+	attach_rom(adpcm_mem, adpcm_rom, rom_data, rom_size);
+	invalidate_adpcm_cache();
+    }
+
+    void YM2610::attachDelta_ROM(const uint8_t *rom_data, uint32_t rom_size)
+    {
+	attach_rom(delta_t_mem, delta_t_rom, rom_data, rom_size);
+    }
+
+    void YM2610::attachADPCM_ROM(shared_ptr<const uint8_t> rom_data, uint32_t rom_size)
+    {
+	attach_rom(adpcm_mem, adpcm_rom, rom_data.get(), rom_size);
+	adpcm_mem.owner = rom_data;
+	invalidate_adpcm_cache();
+    }
+
+    void YM2610::attachDelta_ROM(shared_ptr<const uint8_t> rom_data, uint32_t rom_size)
+    {
+	attach_rom(delta_t_mem, delta_t_rom, rom_data.get(), rom_size);
+	delta_t_mem.owner = rom_data;
+    }
+
+    void YM2610::set_rom_bank(opnb_rom &rom, int page, uint32_t rom_offset)
+    {
+	if ((page < 0) || (page >= 16))
+	{
+	    throw out_of_range("Invalid bank page number");
+	}
+
+	rom.banks[page] = rom_offset;
+    }
+
+    void YM2610::setADPCM_Bank(int page, uint32_t rom_offset)
+    {
+	set_rom_bank(adpcm_mem, page, rom_offset);
+	invalidate_adpcm_cache();
+    }
+
+    void YM2610::setDelta_Bank(int page, uint32_t rom_offset)
+    {
+	set_rom_bank(delta_t_mem, page, rom_offset);
+    }
+
+    void YM2610::set_ssg_band_limited(bool val)
+    {
+	ssg_resampler.set_band_limited(val);
+    }
+
+    void YM2610::clockchip()
+    {
+	clock_fm_and_adpcm();
+	output_fm_and_adpcm();
+	last_samples[0] = clock_ssg();
     }
 
     vector<int32_t> YM2610::get_samples()
@@ -959,4 +1068,210 @@ namespace beenuked
 
 	return mixed_samples;
     }
+
+    void YM2610::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	buffer.reserve((buffer.size() + (num_samples * last_samples.size())));
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+	    clockchip();
+	    buffer.insert(buffer.end(), last_samples.begin(), last_samples.end());
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YM2610::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    // Restores a channel that was playing from a decoded buffer when its state was saved,
+    // either from the same buffer (if it can be cached), or by replaying the nibbles it played from ROM
+    void YM2610::restore_decoded_channel(opnb_adpcm &channel)
+    {
+	size_t pos = channel.decoded_pos;
+	channel.decoded_sample = fetch_decoded_sample(channel);
+
+	if (channel.decoded_sample)
+	{
+	    return;
+	}
+
+	channel.decoded_pos = 0;
+	channel.current_addr = (channel.start_addr << 8);
+	channel.is_high_nibble = false;
+	channel.current_byte = 0;
+	channel.adpcm_accum = 0;
+	channel.adpcm_step = 0;
+
+	for (size_t i = 0; i < pos; i++)
+	{
+	    uint8_t data = 0;
+
+	    if (!channel.is_high_nibble)
+	    {
+		channel.current_byte = fetch_adpcm_rom(channel.current_addr++);
+		data = (channel.current_byte >> 4);
+	    }
+	    else
+	    {
+		data = (channel.current_byte & 0xF);
+	    }
+
+	    channel.is_high_nibble = !channel.is_high_nibble;
+	    decode_adpcm_nibble(channel.adpcm_accum, channel.adpcm_step, data);
+	}
+    }
+
+    template<typename Archive>
+    void YM2610::opnb_delta_t::serialize_state(Archive &state)
+    {
+	state.value(is_repeat);
+	state.value(is_keyon);
+	state.value(is_pan_left);
+	state.value(is_pan_right);
+	state.value(start_addr);
+	state.value(end_addr);
+	state.value(current_addr);
+	state.value(is_high_nibble);
+	state.value(current_byte);
+	state.value(delta_t_pos);
+	state.value(delta_t_accum);
+	state.value(prev_accum);
+	state.value(current_step, 0, 24576);
+	state.value(delta_n);
+	state.value(ch_volume, 0, 0xFF);
+	state.value(delta_t_output);
+    }
+
+    template<typename Archive>
+    void YM2610::opnb_operator::serialize_state(Archive &state)
+    {
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(multiply, 0, 15);
+	state.value(detune, 0, 7);
+	state.value(total_level, 0, 0x3FF);
+	state.value(keycode, 0, 31);
+	state.value(key_scaling, 0, 3);
+	state.value(ksr_val, 0, 31);
+	state.value(attack_rate, 0, 31);
+	state.value(decay_rate, 0, 31);
+	state.value(sustain_rate, 0, 31);
+	state.value(sustain_level, 0, 0x3FF);
+	state.value(release_rate, 0, 15);
+	state.value(phase_counter);
+	state.value(phase_freq);
+	state.value(phase_output);
+	state.value(is_keyon);
+	state.value(ssg_enable);
+	state.value(ssg_att);
+	state.value(ssg_alt);
+	state.value(ssg_hold);
+	state.value(ssg_inv);
+	state.value(env_output, 0, 0x3FF);
+	state.value(env_rate, 0, 63);
+	state.value(env_state, Attack, Off);
+	state.value(outputs);
+    }
+
+    template<typename Archive>
+    void YM2610::opnb_channel::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 5);
+	state.value(freq_num, 0, 0x7FF);
+	state.value(block, 0, 7);
+	state.value(ch_mode, 0, 3);
+	state.value(oper_fnums, 0, 0x7FF);
+	state.value(oper_block, 0, 7);
+	state.value(is_csm_keyon);
+	state.value(feedback, 0, 7);
+	state.value(algorithm, 0, 7);
+	state.value(output);
+	state.value(opers);
+    }
+
+    template<typename Archive>
+    void YM2610::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+	state.value(is_addr_a1);
+	state.value(last_samples);
+	state.value(adpcm_tl_val, 0, 0x3F);
+
+	// Decoded sample buffers aren't saved, just whether the channel was playing from one
+	// (the buffer is fetched again, or the channel is switched back to the ROM, on load).
+	// Keyed off channels fetch a new buffer on key-on, so whatever buffer they still hold doesn't count.
+	for (auto &channel : adpcm_channels)
+	{
+	    bool is_decoded = (channel.is_keyon && (channel.decoded_sample != NULL));
+	    state.value(channel.is_keyon);
+	    state.value(channel.is_pan_left);
+	    state.value(channel.is_pan_right);
+	    state.value(channel.ch_level, 0, 0x1F);
+	    state.value(channel.is_high_nibble);
+	    state.value(channel.current_byte);
+	    state.value(channel.start_addr, 0, 0xFFFF);
+	    state.value(channel.end_addr, 0, 0xFFFF);
+	    state.value(channel.current_addr);
+	    state.value(channel.adpcm_accum);
+	    state.value(channel.adpcm_step, 0, 48);
+	    state.value(channel.adpcm_output);
+
+	    // A sample is at most 1 MB long, or 2M nibbles
+	    state.value(channel.decoded_pos, 0, 0x200000);
+	    state.value(is_decoded);
+
+	    if (state.is_loading())
+	    {
+		channel.decoded_sample.reset();
+
+		if (is_decoded && channel.is_keyon)
+		{
+		    restore_decoded_channel(channel);
+		}
+
+		if (channel.decoded_sample && (channel.decoded_pos > channel.decoded_sample->size()))
+		{
+		    throw out_of_range("Invalid save state value");
+		}
+	    }
+	}
+
+	state.value(delta_t_channel);
+	state.value(env_timer);
+	state.value(env_clock);
+	state.value(channels);
+	state.value(timera_freq, 0, 0x3FF);
+	state.value(timerb_freq, 0, 0xFF);
+	state.value(timera_counter);
+	state.value(timerb_counter);
+	state.value(is_timera_running);
+	state.value(is_timerb_running);
+	state.value(is_timera_enabled);
+	state.value(is_timerb_enabled);
+	state.value(opnb_status);
+	state.value(opnb_irq);
+	ssg_resampler.serialize_state(state);
+    }
+
+    void YM2610::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYM2610, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YM2610::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYM2610, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 }
\ No newline at end of file
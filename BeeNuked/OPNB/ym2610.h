@@ -19,7 +19,15 @@
 #ifndef BEENUKED_YM2610
 #define BEENUKED_YM2610
 
+#include <memory>
+#include <list>
+#include <unordered_map>
 #include "utils.h"
+#include "ssg_resampler.h"
+#include "trace.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -29,26 +37,92 @@ namespace beenuked
 	    YM2610();
 	    ~YM2610();
 
+	    // Sample fetches go through pointers into the chip's own copy of the ROMs,
+	    // which a copy of the chip would leave pointing at the original's
+	    YM2610(const YM2610&) = delete;
+	    YM2610 &operator=(const YM2610&) = delete;
+
 	    uint32_t get_sample_rate(uint32_t clock_rate);
 	    void setInterface(BeeNukedInterface *inter);
 	    void reset();
 	    uint8_t readIO(int port);
 	    void writeIO(int port, uint8_t data);
-	    void writeADPCM_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, vector<uint8_t> rom_data);
-	    void writeDelta_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, vector<uint8_t> rom_data);
+	    void writeADPCM_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, const vector<uint8_t> &rom_data);
+	    void writeDelta_ROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, const vector<uint8_t> &rom_data);
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
-	    void writeADPCM_ROM(vector<uint8_t> rom_data)
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+	    void writeADPCM_ROM(const vector<uint8_t> &rom_data)
 	    {
 		writeADPCM_ROM(rom_data.size(), 0, rom_data.size(), rom_data);
 	    }
 
-	    void writeDelta_ROM(vector<uint8_t> rom_data)
+	    void writeDelta_ROM(const vector<uint8_t> &rom_data)
 	    {
 		writeDelta_ROM(rom_data.size(), 0, rom_data.size(), rom_data);
 	    }
 
+	    // Attaches externally owned sample ROM without copying it,
+	    // so the same ROM can be shared by any number of chips.
+	    // The raw pointer versions require the data to outlive the chip,
+	    // while the shared_ptr versions (i.e. for a memory-mapped file) keep it alive.
+	    void attachADPCM_ROM(const uint8_t *rom_data, uint32_t rom_size);
+	    void attachDelta_ROM(const uint8_t *rom_data, uint32_t rom_size);
+	    void attachADPCM_ROM(shared_ptr<const uint8_t> rom_data, uint32_t rom_size);
+	    void attachDelta_ROM(shared_ptr<const uint8_t> rom_data, uint32_t rom_size);
+
+	    // Banking hooks (i.e. for Neo Geo V-ROM layouts):
+	    // maps 1 MB page 'page' (0-15) of the chip's sample address space
+	    // to 'rom_offset' in the ADPCM-A or ADPCM-B ROM
+	    void setADPCM_Bank(int page, uint32_t rom_offset);
+	    void setDelta_Bank(int page, uint32_t rom_offset);
+
+	    // Optional cache of decoded ADPCM-A samples, keyed by start/end address.
+	    // ADPCM-A decoding always restarts from the same state on key-on,
+	    // so repeated key-ons of the same sample can replay a previously decoded buffer.
+	    // The least recently used samples are dropped once 'max_bytes' is exceeded,
+	    // and a size of 0 (the default) disables the cache entirely.
+	    void set_adpcm_cache_size(size_t max_bytes);
+	    void clear_adpcm_cache();
+	    uint64_t get_adpcm_cache_hits();
+	    uint64_t get_adpcm_cache_misses();
+
+	    // Switches the SSG resampler from the chip's box filter to a band-limited (windowed-sinc) filter
+	    void set_ssg_band_limited(bool val);
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    // Diagnostic events reported by this chip (see trace.h)
+	    BeeNukedTraceRing &get_trace_ring()
+	    {
+		return trace_ring;
+	    }
+#endif
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -70,10 +144,6 @@ namespace beenuked
 
 	    BeeNukedInterface *inter = NULL;
 
-	    uint32_t ssg_sample_index = 0;
-
-	    int fm_samples_per_output = 1;
-
 	    array<int32_t, 3> last_samples = {0, 0, 0};
 
 	    uint8_t chip_address = 0;
@@ -84,6 +154,32 @@ namespace beenuked
 	    uint8_t fetch_adpcm_rom(uint32_t address);
 	    uint8_t fetch_delta_t_rom(uint32_t address);
 
+	    // Sample ROM as seen by the chip, with its 24-bit address space
+	    // split into 16 pages of 1 MB each
+	    struct opnb_rom
+	    {
+		const uint8_t *data = NULL;
+		uint32_t size = 0;
+		uint32_t mask = 0;
+		array<uint32_t, 16> banks;
+		shared_ptr<const uint8_t> owner;
+	    };
+
+	    opnb_rom adpcm_mem;
+	    opnb_rom delta_t_mem;
+
+	    void set_rom_data(opnb_rom &rom, const uint8_t *data, uint32_t size);
+	    void attach_rom(opnb_rom &rom, vector<uint8_t> &rom_copy, const uint8_t *data, uint32_t size);
+	    void set_rom_bank(opnb_rom &rom, int page, uint32_t rom_offset);
+
+	    uint8_t read_rom(const opnb_rom &rom, uint32_t address)
+	    {
+		// The mask is the ROM size rounded up to a power of two,
+		// so the bounds check only ever fails for odd-sized ROMs
+		uint32_t rom_addr = ((rom.banks[((address >> 20) & 0xF)] + (address & 0xFFFFF)) & rom.mask);
+		return (rom_addr < rom.size) ? rom.data[rom_addr] : 0xFF;
+	    }
+
 	    struct opnb_adpcm
 	    {
 		bool is_keyon = false;
@@ -98,6 +194,8 @@ namespace beenuked
 		int32_t adpcm_accum = 0;
 		int32_t adpcm_step = 0;
 		int32_t adpcm_output = 0;
+		shared_ptr<const vector<uint16_t>> decoded_sample;
+		size_t decoded_pos = 0;
 	    };
 
 	    struct opnb_delta_t
@@ -118,6 +216,9 @@ namespace beenuked
 		uint32_t delta_n = 0;
 		uint32_t ch_volume = 0;
 		int32_t delta_t_output = 0;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    int adpcm_tl_val = 0;
@@ -128,6 +229,29 @@ namespace beenuked
 	    void adpcm_key_on(opnb_adpcm &channel);
 	    void adpcm_key_off(opnb_adpcm &channel);
 
+	    // Each decoded entry holds the 12-bit accumulator in bits 0-11,
+	    // and the nibble that produced it in bits 12-15
+	    typedef shared_ptr<const vector<uint16_t>> opnb_decoded_ptr;
+
+	    struct opnb_cache_entry
+	    {
+		uint32_t key = 0;
+		opnb_decoded_ptr samples;
+	    };
+
+	    list<opnb_cache_entry> adpcm_cache;
+	    unordered_map<uint32_t, list<opnb_cache_entry>::iterator> adpcm_cache_index;
+	    size_t adpcm_cache_limit = 0;
+	    size_t adpcm_cache_bytes = 0;
+	    uint64_t adpcm_cache_hits = 0;
+	    uint64_t adpcm_cache_misses = 0;
+
+	    opnb_decoded_ptr fetch_decoded_sample(opnb_adpcm &channel);
+	    void resync_adpcm_channel(opnb_adpcm &channel);
+	    void restore_decoded_channel(opnb_adpcm &channel);
+	    void invalidate_adpcm_cache();
+	    void decode_adpcm_nibble(int32_t &accum, int32_t &step, uint8_t data);
+
 	    uint32_t env_timer = 0;
 	    uint32_t env_clock = 0;
 
@@ -183,9 +307,12 @@ namespace beenuked
 
 		int32_t env_output = 0;
 		int env_rate = 0;
-		opnb_oper_state env_state;
+		opnb_oper_state env_state = opnb_oper_state::Off;
 
 		array<int32_t, 2> outputs = {0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    struct opnb_channel
@@ -203,6 +330,9 @@ namespace beenuked
 		int algorithm = 0;
 		int32_t output = 0;
 		array<opnb_operator, 4> opers;
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
 	    };
 
 	    array<opnb_channel, 6> channels;
@@ -234,16 +364,27 @@ namespace beenuked
 	    void set_status_bit(int bit);
 	    void reset_status_bit(int bit);
 
-	    int32_t ssg_sample = 0;
-	    array<int32_t, 3> last_ssg_samples = {0, 0, 0};
+	    BeeNukedSSGResampler ssg_resampler;
 
-	    void add_last(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale = 1);
-	    void clock_and_add(int32_t &sum0, int32_t &sum1, int32_t &sum2, int scale = 1);
-	    void write_to_output(int32_t sum0, int32_t sum1, int32_t sum2, int divisor = 1);
+	    int32_t clock_ssg();
 
-	    void resample();
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
 
 	    #include "opnb_tables.inl"
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    BeeNukedTraceRing trace_ring;
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
     };
 };
 
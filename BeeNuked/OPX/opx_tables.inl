@@ -16,35 +16,83 @@
     along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-// Opout values (for 2-operator FM):
-// 0 = 0
-// 1 = Slot 1 output
+// Algorithm bits (for all FM connections):
+// Operators are evaluated in the order S1, S3, S2, S4,
+// and each one is modulated by the sum of the earlier operators in its input mask
+// ----------x: 1=Use slot 3 for feedback, 0=Use slot 1 for feedback
+// ---------x-: Slot 3 input (S1)
+// -------xx--: Slot 2 input (S1, S3)
+// ----xxx----: Slot 4 input (S1, S3, S2)
+// xxxx-------: Operators included in the final sum (S1, S3, S2, S4)
 
-// Algorithm op (for 2-operator FM):
-// --x: 1=Use slot 3 for feedback, 0=Use slot 1 for feedback
-// -x-: Use opout[x] as slot 3 input
-// x--: Include opout[1] in final sum
+#define opx_s1 1
+#define opx_s3 2
+#define opx_s2 4
+#define opx_s4 8
 
-#define create_algorithm_2op(feedback, op3in, op1out) \
-	(feedback | (op3in << 1) | (op1out << 2))
+#define create_opx_algorithm(feedback, s3in, s2in, s4in, outputs) \
+	(feedback | (s3in << 1) | (s2in << 2) | (s4in << 4) | (outputs << 7))
 
 array<uint16_t, 4> algorithm_2op_combinations = 
 {
     // <--------|
     // +--[S1]--|--+--[S3]-->
-    create_algorithm_2op(0, 1, 0),
+    create_opx_algorithm(0, opx_s1, 0, 0, opx_s3),
     // <-----------------|
     // +--[S1]--+--[S3]--|-->
-    create_algorithm_2op(1, 1, 0), 
+    create_opx_algorithm(1, opx_s1, 0, 0, opx_s3),
     //  --[S3]-----|
     // <--------|  |
     // +--[S1]--|--+-->
-    create_algorithm_2op(0, 0, 1),
+    create_opx_algorithm(0, 0, 0, 0, (opx_s1 | opx_s3)),
     // <--------|  +--[S3]--|
     // +--[S1]--|--|--------+-->
-    create_algorithm_2op(0, 1, 1)
+    create_opx_algorithm(0, opx_s1, 0, 0, (opx_s1 | opx_s3))
 };
 
+// Feedback is always available on S1
+array<uint16_t, 8> algorithm_3op_combinations =
+{
+    create_opx_algorithm(0, opx_s1, opx_s3, 0, opx_s2), // S1 -> S3 -> S2
+    create_opx_algorithm(1, opx_s1, opx_s3, 0, opx_s2), // S1 -> S3 -> S2 (S3 feeds back into S1)
+    create_opx_algorithm(0, 0, (opx_s1 | opx_s3), 0, opx_s2), // (S1 + S3) -> S2
+    create_opx_algorithm(0, opx_s1, 0, 0, (opx_s3 | opx_s2)), // S1 -> S3, S2
+    create_opx_algorithm(0, opx_s1, opx_s1, 0, (opx_s3 | opx_s2)), // S1 -> (S3, S2)
+    create_opx_algorithm(0, 0, opx_s3, 0, (opx_s1 | opx_s2)), // S1, S3 -> S2
+    create_opx_algorithm(0, 0, 0, 0, (opx_s1 | opx_s3 | opx_s2)), // S1, S3, S2
+    create_opx_algorithm(0, opx_s1, 0, 0, (opx_s1 | opx_s3 | opx_s2)) // S1 + (S1 -> S3), S2
+};
+
+array<uint16_t, 16> algorithm_4op_combinations =
+{
+    create_opx_algorithm(0, opx_s1, opx_s3, opx_s2, opx_s4), // S1 -> S3 -> S2 -> S4
+    create_opx_algorithm(1, opx_s1, opx_s3, opx_s2, opx_s4), // S1 -> S3 -> S2 -> S4 (S3 feeds back into S1)
+    create_opx_algorithm(0, 0, (opx_s1 | opx_s3), opx_s2, opx_s4), // (S1 + S3) -> S2 -> S4
+    create_opx_algorithm(0, 0, opx_s3, (opx_s1 | opx_s2), opx_s4), // (S1 + (S3 -> S2)) -> S4
+    create_opx_algorithm(0, opx_s1, opx_s1, (opx_s3 | opx_s2), opx_s4), // S1 -> (S3 + S2) -> S4
+    create_opx_algorithm(0, opx_s1, 0, opx_s2, (opx_s3 | opx_s4)), // S1 -> S3, S2 -> S4
+    create_opx_algorithm(0, opx_s1, opx_s3, 0, (opx_s2 | opx_s4)), // S1 -> S3 -> S2, S4
+    create_opx_algorithm(0, opx_s1, opx_s3, opx_s3, (opx_s2 | opx_s4)), // S1 -> S3 -> (S2, S4)
+    create_opx_algorithm(0, opx_s1, 0, (opx_s3 | opx_s2), opx_s4), // ((S1 -> S3) + S2) -> S4
+    create_opx_algorithm(0, 0, 0, (opx_s1 | opx_s3 | opx_s2), opx_s4), // (S1 + S3 + S2) -> S4
+    create_opx_algorithm(0, opx_s1, 0, 0, (opx_s3 | opx_s2 | opx_s4)), // S1 -> S3, S2, S4
+    create_opx_algorithm(0, 0, (opx_s1 | opx_s3), 0, (opx_s2 | opx_s4)), // (S1 + S3) -> S2, S4
+    create_opx_algorithm(0, opx_s1, opx_s1, opx_s1, (opx_s3 | opx_s2 | opx_s4)), // S1 -> (S3, S2, S4)
+    create_opx_algorithm(0, 0, opx_s1, 0, (opx_s3 | opx_s2 | opx_s4)), // S1 -> S2, S3, S4
+    create_opx_algorithm(0, opx_s1, 0, opx_s2, (opx_s1 | opx_s3 | opx_s4)), // S1 + (S1 -> S3), S2 -> S4
+    create_opx_algorithm(0, 0, 0, 0, (opx_s1 | opx_s3 | opx_s2 | opx_s4)) // S1, S3, S2, S4
+};
+
+// Modulation depth (for operator inputs) and feedback depth (for S1), for each feedback level
+array<int, 8> modulation_level =
+{
+    16, 8, 4, 2, 1, 32, 64, 128
+};
+
+array<int, 8> feedback_level =
+{
+    0, 1, 2, 4, 8, 16, 32, 64
+};
 
 array<int, 16> fm_table = 
 {
@@ -83,4 +131,28 @@ array<double, 16> channel_att_table =
 {
     0.0,  2.5,  6.0,  8.5, 12.0, 14.5, 18.1, 20.6,
    24.1, 26.6, 30.1, 32.6, 36.1, 96.1, 96.1, 96.1
+};
+
+// Attack and decay times (in milliseconds) for envelope rates 4-7
+// (every 4 rates after that take half as long, and rates 0-3 never change the envelope)
+array<double, 4> env_attack_times =
+{
+    6188.12, 4980.68, 4144.76, 3541.04
+};
+
+array<double, 4> env_decay_times =
+{
+    93599.64, 74837.91, 62392.02, 53475.56
+};
+
+// LFO phase modulation depths (in cents) for each PMS value
+array<double, 8> lfo_pms_cents =
+{
+    0.0, 3.378, 5.0646, 6.7495, 10.1143, 20.1699, 40.1076, 79.307
+};
+
+// LFO amplitude modulation depths (in dB) for each AMS value
+array<double, 4> lfo_ams_db =
+{
+    0.0, 5.90625, 11.8125, 23.625
 };
\ No newline at end of file
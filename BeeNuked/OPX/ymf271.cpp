@@ -38,7 +38,7 @@ namespace beenuked
 {
     YMF271::YMF271()
     {
-
+	pcm_stores = make_shared<opx_pcm_stores>();
     }
 
     YMF271::~YMF271()
@@ -70,17 +70,117 @@ namespace beenuked
 
 	    waveform_table[0][i] = int16_t(mod * 32767);
 	}
+
+	for (int i = 0; i < 64; i++)
+	{
+	    if (i < 4)
+	    {
+		env_ar_table[i] = 0.0;
+		env_dc_table[i] = 0.0;
+		continue;
+	    }
+
+	    // Rates are in milliseconds, at the chip's nominal output rate of 44100 Hz
+	    double rate_scale = (44.1 / double(1 << ((i >> 2) - 1)));
+	    env_ar_table[i] = (env_attack_times[(i & 3)] * rate_scale);
+	    env_dc_table[i] = (env_decay_times[(i & 3)] * rate_scale);
+	}
+
+	for (int keycode = 0; keycode < 32; keycode++)
+	{
+	    key_scale_table[keycode][0] = 0;
+	    key_scale_table[keycode][1] = (keycode >> 3);
+	    key_scale_table[keycode][2] = (keycode >> 2);
+	    key_scale_table[keycode][3] = (keycode >> 1);
+	    key_scale_table[keycode][4] = keycode;
+	    key_scale_table[keycode][5] = min((keycode + 2), 31);
+	    key_scale_table[keycode][6] = min((keycode + 4), 31);
+	    key_scale_table[keycode][7] = min((keycode + 8), 31);
+	}
+
+	// 256 steps of 0.375 dB each
+	for (int i = 0; i < 256; i++)
+	{
+	    env_volume_table[i] = int32_t(65536.0 / pow(10.0, ((i * 0.375) / 20.0)));
+	}
+
+	// The LFO frequencies span from 0.00066 Hz to 47.7 Hz, roughly exponentially
+	for (int i = 0; i < 256; i++)
+	{
+	    lfo_freq_table[i] = (0.00066 * pow((47.7 / 0.00066), (i / 255.0)));
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+	    lfo_ams_table[i] = int32_t(65536.0 * (1.0 - pow(10.0, (-lfo_ams_db[i] / 20.0))));
+	}
+
+	for (int i = 0; i < 256; i++)
+	{
+	    // Phase modulation waveforms (sawtooth, square and triangle), from -1.0 to 1.0
+	    array<double, 4> plfo;
+	    plfo[0] = 0.0;
+
+	    double saw_wave = ((i % 128) / 127.0);
+	    plfo[1] = (i < 128) ? saw_wave : (saw_wave - 1.0);
+	    plfo[2] = (i < 128) ? 1.0 : -1.0;
+
+	    double tri_wave = ((i % 64) / 64.0);
+
+	    switch (i / 64)
+	    {
+		case 0: plfo[3] = tri_wave; break;
+		case 1: plfo[3] = (1.0 - tri_wave); break;
+		case 2: plfo[3] = -tri_wave; break;
+		case 3: plfo[3] = -(1.0 - tri_wave); break;
+	    }
+
+	    for (int wave = 0; wave < 4; wave++)
+	    {
+		for (int pms = 0; pms < 8; pms++)
+		{
+		    double cents = (lfo_pms_cents[pms] * plfo[wave]);
+		    plfo_table[wave][pms][i] = int32_t(65536.0 * pow(2.0, (cents / 1200.0)));
+		}
+	    }
+
+	    for (int pms = 0; pms < 8; pms++)
+	    {
+		lfo_pms_max_table[pms] = int32_t(ceil(65536.0 * pow(2.0, (lfo_pms_cents[pms] / 1200.0))));
+	    }
+
+	    // Amplitude modulation waveforms, from 0 to 65536
+	    alfo_table[0][i] = 0;
+	    alfo_table[1][i] = (65536 - (i * 256));
+	    alfo_table[2][i] = (i < 128) ? 65536 : 0;
+
+	    int32_t alfo_tri = ((i % 128) * 512);
+	    alfo_table[3][i] = (i < 128) ? (65536 - alfo_tri) : alfo_tri;
+	}
     }
 
-    int64_t YMF271::calc_slot_volume(opx_slot &slot)
+    int64_t YMF271::calc_slot_volume(opx_slot &slot, size_t index)
     {
 	int64_t volume = 0;
 
-	int64_t env_volume = 65536;
+	int64_t env_volume = get_env_output(slot, index);
 	volume = ((env_volume * total_level_table[slot.total_level]) >> 16);
 	return volume;
     }
 
+    void YMF271::update_gains(opx_slot &slot)
+    {
+	// The envelope is applied separately in update_pcm
+	int64_t volume = total_level_table[slot.total_level];
+
+	for (int i = 0; i < 4; i++)
+	{
+	    int32_t ch_atten = attenutation_table[slot.ch_level[i]];
+	    slot.fm_gains[i] = ch_atten;
+	    slot.pcm_gains[i] = int32_t(min<int64_t>(((volume * ch_atten) >> 16), 65536));
+	}
+    }
+
     void YMF271::write_fm(int bank, uint8_t reg, uint8_t data)
     {
 	int group_num = fm_table[(reg & 0xF)];
@@ -130,8 +230,6 @@ namespace beenuked
 	    break;
 	    case 2:
 	    {
-		cout << "3-slot + 1-slot mode" << endl;
-
 		if (bank == 0)
 		{
 		    is_sync_mode = true;
@@ -181,7 +279,6 @@ namespace beenuked
 		    for (int i = 0; i < 3; i++)
 		    {
 			int slot_num = ((12 * i) + group_num);
-			cout << "Writing value of " << hex << int(data) << " to YMF271 slot " << dec << slot_num << " three-slot register of " << hex << int(reg_addr) << endl;
 			write_fm_reg(slot_num, reg_addr, data);
 		    }
 		}
@@ -197,10 +294,20 @@ namespace beenuked
 
     void YMF271::key_on(opx_slot &slot)
     {
+	BEENUKED_PROFILE_KEY_ON();
 	slot.step = 0;
 	slot.step_ptr = 0;
 	slot.is_key_on = true;
+	slot.feedback_mod0 = 0;
+	slot.feedback_mod1 = 0;
 	calculate_step(slot);
+
+	if (slot.waveform == 7)
+	{
+	    update_pcm_source(slot);
+	}
+	init_envelope(slot);
+	init_lfo(slot);
     }
 
     void YMF271::key_off(opx_slot &slot)
@@ -208,7 +315,130 @@ namespace beenuked
 	if (slot.is_key_on)
 	{
 	    slot.is_key_on = false;
+
+	    if (is_slot_active(slot))
+	    {
+		env_unit.state[slot.number] = EnvRelease;
+	    }
+	}
+    }
+
+    int32_t YMF271::calc_env_step(const array<double, 64> &times, int rate, int keycode, int key_scale, int distance)
+    {
+	rate = clamp((rate + key_scale_table[keycode][key_scale]), 0, 63);
+
+	if (rate < 4)
+	{
+	    return 0;
 	}
+
+	return int32_t((double(distance) / times[rate]) * 65536.0);
+    }
+
+    void YMF271::init_envelope(opx_slot &slot)
+    {
+	int num = slot.number;
+
+	// The key code is the block and the top 2 bits of the frequency,
+	// which are at different positions for the internal and external waveforms
+	int fnum = slot.freq_num;
+	int n43 = 0;
+
+	if (slot.waveform != 7)
+	{
+	    n43 = (fnum < 0x780) ? 0 : (fnum < 0x900) ? 1 : (fnum < 0xA80) ? 2 : 3;
+	}
+	else
+	{
+	    fnum &= 0x7FF;
+	    n43 = (fnum < 0x100) ? 0 : (fnum < 0x300) ? 1 : (fnum < 0x500) ? 2 : 3;
+	}
+
+	int keycode = (((slot.block & 0x7) * 4) + n43);
+	int decay_level = (255 - (slot.decay1_level << 4));
+
+	auto &steps = env_unit.steps;
+	steps[EnvAttack][num] = calc_env_step(env_ar_table, (slot.attack_rate * 2), keycode, slot.key_scale, 255);
+	steps[EnvDecay1][num] = calc_env_step(env_dc_table, (slot.decay1_rate * 2), keycode, slot.key_scale, (255 - decay_level));
+	steps[EnvDecay2][num] = calc_env_step(env_dc_table, (slot.decay2_rate * 2), keycode, slot.key_scale, 255);
+	steps[EnvRelease][num] = calc_env_step(env_ar_table, (slot.release_rate * 4), keycode, slot.key_scale, 255);
+
+	// Attacks start at -60 dB
+	env_unit.decay_level[num] = decay_level;
+	env_unit.volume[num] = ((255 - 160) << 16);
+	env_unit.state[num] = EnvAttack;
+	env_unit.active_mask |= (uint64_t(1) << num);
+    }
+
+    void YMF271::init_lfo(opx_slot &slot)
+    {
+	int num = slot.number;
+
+	// The LFO table has 256 entries, stepped in 24.8 fixed point
+	env_unit.lfo_phase[num] = 0;
+	env_unit.lfo_step[num] = uint32_t(((256.0 * lfo_freq_table[slot.lfo_freq]) / 44100.0) * 256.0);
+	env_unit.lfo_wave[num] = slot.lfo_wave;
+	env_unit.lfo_pms[num] = slot.pms;
+	env_unit.lfo_ams[num] = slot.ams;
+    }
+
+    void YMF271::clock_envelopes(size_t index)
+    {
+	for (int first = 0; first < 48; first += 8)
+	{
+	    // Batches of idle slots are skipped entirely
+	    if (((env_unit.active_mask >> first) & 0xFF) != 0)
+	    {
+		clock_env_batch(first, index);
+	    }
+	}
+    }
+
+    // Steps the envelopes and LFOs of 8 consecutive slots,
+    // storing their outputs for sample 'index' of the current block.
+    // Each state transition is a select rather than a branch,
+    // so the compiler can run all 8 slots side by side
+    void YMF271::clock_env_batch(int first, size_t index)
+    {
+	auto &eg = env_unit;
+	uint64_t ended_mask = 0;
+
+	for (int n = first; n < (first + 8); n++)
+	{
+	    bool is_active = testbit(eg.active_mask, n);
+	    int32_t state = eg.state[n];
+	    int32_t step = eg.steps[state][n];
+
+	    int32_t volume = (state == EnvAttack) ? (eg.volume[n] + step) : (eg.volume[n] - step);
+
+	    bool is_attack_done = ((state == EnvAttack) && (volume >= (255 << 16)));
+	    bool is_ended = ((state != EnvAttack) && (volume <= 0));
+	    bool is_decay_done = ((state == EnvDecay1) && !is_ended && ((volume >> 16) <= eg.decay_level[n]));
+
+	    volume = is_attack_done ? (255 << 16) : is_ended ? 0 : volume;
+	    state = is_attack_done ? EnvDecay1 : is_decay_done ? EnvDecay2 : state;
+
+	    uint32_t lfo_phase = (eg.lfo_phase[n] + eg.lfo_step[n]);
+	    int lfo_index = ((lfo_phase >> 8) & 0xFF);
+
+	    int64_t amplitude = alfo_table[eg.lfo_wave[n]][lfo_index];
+	    int64_t lfo_volume = (65536 - ((amplitude * lfo_ams_table[eg.lfo_ams[n]]) >> 16));
+	    int64_t env_volume = env_volume_table[(255 - (volume >> 16))];
+
+	    // Idle slots keep their current state
+	    eg.volume[n] = is_active ? volume : eg.volume[n];
+	    eg.state[n] = is_active ? state : eg.state[n];
+	    eg.lfo_phase[n] = is_active ? lfo_phase : eg.lfo_phase[n];
+	    eg.output[n] = is_active ? int32_t((env_volume * lfo_volume) >> 16) : eg.output[n];
+	    eg.phase_mod[n] = is_active ? plfo_table[eg.lfo_wave[n]][eg.lfo_pms[n]][lfo_index] : eg.phase_mod[n];
+	    ended_mask |= (uint64_t(is_active && is_ended) << n);
+
+	    eg.output_block[n][index] = eg.output[n];
+	    eg.phase_mod_block[n][index] = eg.phase_mod[n];
+	    eg.active_len[n] = (is_active && !is_ended) ? int32_t(index + 1) : eg.active_len[n];
+	}
+
+	eg.active_mask &= ~ended_mask;
     }
 
     void YMF271::calculate_step(opx_slot &slot)
@@ -235,6 +465,7 @@ namespace beenuked
 	}
     }
 
+    // Unhandled writes are traced with the slot number in bits 4-9 of the register
     void YMF271::write_fm_reg(int slot_num, int reg, uint8_t data)
     {
 	auto &slot = slots[slot_num];
@@ -258,49 +489,57 @@ namespace beenuked
 	    break;
 	    case 0x1:
 	    {
-		cout << "Setting lfo-frequency register of slot " << dec << int(slot_num) << endl;
+		slot.lfo_freq = data;
 	    }
 	    break;
 	    case 0x2:
 	    {
-		cout << "Setting lfo wave/PMS/AMS register of slot " << dec << int(slot_num) << endl;
+		slot.lfo_wave = (data & 0x3);
+		slot.pms = ((data >> 3) & 0x7);
+		slot.ams = ((data >> 6) & 0x3);
 	    }
 	    break;
 	    case 0x3:
 	    {
-		cout << "Setting detune register of slot " << dec << int(slot_num) << endl;
+		// Detune isn't emulated yet
+		BEENUKED_TRACE(TraceUnhandledWrite, ((slot_num << 4) | reg), data);
 		slot.multiply = (data & 0xF);
+		calculate_step(slot);
 	    }
 	    break;
 	    case 0x4:
 	    {
 		slot.total_level = (data & 0x7F);
+		update_gains(slot);
 	    }
 	    break;
 	    case 0x5:
 	    {
-		cout << "Setting attack rate/keyscale register of slot " << dec << int(slot_num) << endl;
+		slot.attack_rate = (data & 0x1F);
+		slot.key_scale = ((data >> 5) & 0x7);
 	    }
 	    break;
 	    case 0x6:
 	    {
-		cout << "Setting decay 1 rate register of slot " << dec << int(slot_num) << endl;
+		slot.decay1_rate = (data & 0x1F);
 	    }
 	    break;
 	    case 0x7:
 	    {
-		cout << "Setting decay 2 rate register of slot " << dec << int(slot_num) << endl;
+		slot.decay2_rate = (data & 0x1F);
 	    }
 	    break;
 	    case 0x8:
 	    {
-		cout << "Setting release rate/decay 1 level register of slot " << dec << int(slot_num) << endl;
+		slot.release_rate = (data & 0xF);
+		slot.decay1_level = ((data >> 4) & 0xF);
 	    }
 	    break;
 	    case 0x9:
 	    {
 		slot.freq_num = (((slot.freq_hi & 0xF) << 8) | data);
 		slot.block = (slot.freq_hi >> 4);
+		calculate_step(slot);
 	    }
 	    break;
 	    case 0xA:
@@ -310,13 +549,24 @@ namespace beenuked
 	    break;
 	    case 0xB:
 	    {
-		cout << "Setting feedback/accumulator-on register of slot " << dec << int(slot_num) << endl;
 		slot.waveform = (data & 0x7);
+		slot.feedback = ((data >> 4) & 0x7);
+		slot.is_accon = testbit(data, 7);
+
+		// ACC-ON bit is unimplemented (even in MAME's own implementation)
+		if (slot.is_accon)
+		{
+		    BEENUKED_TRACE(TraceUnimplemented, ((slot_num << 4) | reg), data);
+		}
+
+		if (slot.waveform == 7)
+		{
+		    update_pcm_source(slot);
+		}
 	    }
 	    break;
 	    case 0xC:
 	    {
-		cout << "Setting algorithm register of slot " << dec << int(slot_num) << endl;
 		slot.algorithm = (data & 0xF);
 	    }
 	    break;
@@ -324,12 +574,14 @@ namespace beenuked
 	    {
 		slot.ch_level[0] = (data >> 4);
 		slot.ch_level[1] = (data & 0xF);
+		update_gains(slot);
 	    }
 	    break;
 	    case 0xE:
 	    {
 		slot.ch_level[2] = (data >> 4);
 		slot.ch_level[3] = (data & 0xF);
+		update_gains(slot);
 	    }
 	    break;
 	    default: break;
@@ -369,7 +621,7 @@ namespace beenuked
 		// A/L bit is unimplemented (even in MAME's own implementation)
 		if (slot.is_alt_loop)
 		{
-		    cout << "Undocumented A/L bit detected. Please contact BueniaDev." << endl;
+		    BEENUKED_TRACE(TraceUnimplemented, reg, data);
 		}
 	    }
 	    break;
@@ -412,6 +664,11 @@ namespace beenuked
 	    }
 	    break;
 	}
+
+	if ((slot.waveform == 7) && ((reg_addr <= 0x2) || (reg_addr == 0x9)))
+	{
+	    update_pcm_source(slot);
+	}
     }
 
     void YMF271::write_timer(uint8_t reg, uint8_t data)
@@ -428,49 +685,23 @@ namespace beenuked
 	    auto &group = groups[group_num];
 	    group.sync = (data & 0x3);
 	    group.is_pfm = testbit(data, 7);
+	    update_group_renderer(group_num);
 	}
 	else
 	{
 	    switch (reg)
 	    {
+		// Timers and the external memory interface aren't emulated yet
 		case 0x10:
-		{
-		    cout << "Writing to upper 8-bits of YMF271 timer A" << endl;
-		}
-		break;
 		case 0x11:
-		{
-		    cout << "Writing to lower 2-bits of YMF271 timer A" << endl;
-		}
-		break;
 		case 0x12:
-		{
-		    cout << "Writing to YMF271 timer B" << endl;
-		}
-		break;
 		case 0x13:
-		{
-		    cout << "Writing to YMF271 timer control register" << endl;
-		}
-		break;
 		case 0x14:
-		{
-		    cout << "Writing to YMF271 lower 8-bits of external address" << endl;
-		}
-		break;
 		case 0x15:
-		{
-		    cout << "Writing to YMF271 middle 8-bits of external address" << endl;
-		}
-		break;
 		case 0x16:
-		{
-		    cout << "Writing to YMF271 upper 7-bits/RW-bit of external address" << endl;
-		}
-		break;
 		case 0x17:
 		{
-		    cout << "Writing to YMF271 external address control register" << endl;
+		    BEENUKED_TRACE(TraceUnhandledWrite, reg, data);
 		}
 		break;
 		case 0x20:
@@ -481,25 +712,118 @@ namespace beenuked
 	}
     }
 
-    uint8_t YMF271::readROM(uint32_t addr)
+    shared_ptr<YMF271::opx_pcm_stores> YMF271::get_shared_pcm_stores(const shared_ptr<const uint8_t> &rom_owner, const uint8_t *rom_data, uint32_t rom_size)
     {
-	addr &= 0x7FFFFF;
-	return opx_rom.at(addr);
+	// Expanded stores are looked up by the owner of the ROM they were expanded from
+	// (rather than its address, which can be reused once the ROM is freed),
+	// and are freed once the last chip using that ROM lets go of them
+	static mutex cache_lock;
+	static map<weak_ptr<const uint8_t>, weak_ptr<opx_pcm_stores>, owner_less<weak_ptr<const uint8_t>>> cache;
+
+	lock_guard<mutex> lock(cache_lock);
+
+	for (auto it = cache.begin(); it != cache.end();)
+	{
+	    it = it->second.expired() ? cache.erase(it) : next(it);
+	}
+
+	auto &entry = cache[rom_owner];
+	auto stores = entry.lock();
+
+	// The same owner can also be attached with a different range of its data
+	if ((stores == NULL) || (stores->rom_data != rom_data) || (stores->rom_size != rom_size))
+	{
+	    stores = make_shared<opx_pcm_stores>();
+	    stores->rom_data = rom_data;
+	    stores->rom_size = rom_size;
+	    entry = stores;
+	}
+
+	return stores;
     }
 
-    void YMF271::update_pcm(opx_group &group, opx_slot &slot)
+    const vector<int16_t> &YMF271::get_pcm_store(bool is_12_bit, int alignment)
     {
-	if (!slot.is_key_on)
+	// The stores may be shared with chips on other threads,
+	// so each one is expanded exactly once and never changed afterwards
+	auto &shared = *pcm_stores;
+	int index = is_12_bit ? (alignment + 1) : 0;
+	auto &store = shared.stores[index];
+
+	call_once(shared.is_expanded[index], [&]()
 	{
-	    return;
+	    const uint8_t *rom_data = shared.rom_data;
+	    uint32_t rom_size = shared.rom_size;
+
+	    if (!is_12_bit)
+	    {
+		store.resize((rom_size + 1), 0);
+
+		for (uint32_t i = 0; i < rom_size; i++)
+		{
+		    store[i] = int16_t(rom_data[i] << 8);
+		}
+	    }
+	    else
+	    {
+		// Each pair of samples takes up 3 bytes,
+		// with the low nibbles of both samples in the middle byte
+		uint32_t num_pairs = (rom_size > uint32_t(alignment)) ? ((rom_size - alignment) / 3) : 0;
+		store.resize(((num_pairs * 2) + 1), 0);
+
+		for (uint32_t i = 0; i < num_pairs; i++)
+		{
+		    const uint8_t *pair = &rom_data[(alignment + (i * 3))];
+		    store[(i * 2)] = int16_t((pair[0] << 8) | (pair[1] & 0xF0));
+		    store[((i * 2) + 1)] = int16_t((pair[2] << 8) | ((pair[1] << 4) & 0xF0));
+		}
+	    }
+	});
+
+	return store;
+    }
+
+    void YMF271::update_pcm_source(opx_slot &slot)
+    {
+	// Addresses past the end of the ROM all point to the silent sample
+	uint32_t start = slot.start_address;
+	const auto &store = get_pcm_store(slot.is_12_bit, (start % 3));
+	uint32_t silent_pos = uint32_t(store.size() - 1);
+	uint32_t start_pos = slot.is_12_bit ? ((start / 3) * 2) : start;
+	start_pos = min(start_pos, silent_pos);
+
+	slot.pcm_data = (store.data() + start_pos);
+	slot.pcm_last = (silent_pos - start_pos);
+    }
+
+    void YMF271::rom_changed()
+    {
+	// Let go of the old stores first, so they can't be handed back for the new ROM
+	pcm_stores.reset();
+
+	if (opx_rom_owner != NULL)
+	{
+	    pcm_stores = get_shared_pcm_stores(opx_rom_owner, opx_rom_data, opx_rom_size);
+	}
+	else
+	{
+	    // ROM data copied in through writeROM or attached through a raw pointer belongs to this chip alone
+	    pcm_stores = make_shared<opx_pcm_stores>();
+	    pcm_stores->rom_data = opx_rom_data;
+	    pcm_stores->rom_size = opx_rom_size;
 	}
 
-	if (slot.waveform != 7)
+	for (auto &slot : slots)
 	{
-	    cout << "Error: Waveform " << dec << int(slot.waveform) << " in PCM update" << endl;
-	    exit(1);
+	    if (slot.waveform == 7)
+	    {
+		update_pcm_source(slot);
+	    }
 	}
+    }
 
+    void YMF271::wrap_pcm_position(opx_slot &slot)
+    {
 	if ((slot.step_ptr >> 16) > slot.end_address)
 	{
 	    slot.step_ptr = slot.step_ptr - ((uint64_t)slot.end_address << 16) + ((uint64_t)slot.loop_address << 16);
@@ -516,67 +840,208 @@ namespace beenuked
 		}
 	    }
 	}
-	
-	int16_t sample = 0;
+    }
+
+    void YMF271::render_pcm(opx_group &group, opx_slot &slot, size_t num_samples)
+    {
+	// Slots can't start partway through a block, but they can stop
+	size_t active_len = min(size_t(env_unit.active_len[slot.number]), num_samples);
 
-	if (!slot.is_12_bit)
+	if (active_len == 0)
 	{
-	    sample = (readROM(slot.start_address + (slot.step_ptr >> 16)) << 8);
+	    return;
 	}
-	else
+
+	if (slot.waveform != 7)
 	{
-	    sample = 0;
+	    BEENUKED_TRACE(TraceInvalidState, slot.number, slot.waveform);
+	    return;
 	}
 
-	int64_t final_volume = calc_slot_volume(slot);
+	// The fastest the LFO can make this slot step
+	uint64_t max_step = (((uint64_t(slot.step) * lfo_pms_max_table[env_unit.lfo_pms[slot.number]]) >> 16) + 1);
+	uint64_t end_limit = ((uint64_t(slot.end_address) + 1) << 16);
 
-	for (int i = 0; i < 4; i++)
+	size_t index = 0;
+
+	while (index < active_len)
 	{
-	    int ch_vol = ((final_volume * attenutation_table[slot.ch_level[i]]) >> 16);
-	    ch_vol = min(ch_vol, 65536);
-	    group.outputs[i] += ((sample * ch_vol) >> 16);
+	    wrap_pcm_position(slot);
+
+	    // Render as many samples as are guaranteed not to pass the end address
+	    // (the wrap-around above always leaves at least one)
+	    size_t span = size_t(((end_limit - slot.step_ptr) + (max_step - 1)) / max_step);
+	    size_t span_end = (index + min(span, (active_len - index)));
+
+	    switch (pcm_interp)
+	    {
+		case PCMNearest: render_pcm_span<PCMNearest>(group, slot, index, span_end); break;
+		case PCMLinear: render_pcm_span<PCMLinear>(group, slot, index, span_end); break;
+		case PCMCubic: render_pcm_span<PCMCubic>(group, slot, index, span_end); break;
+	    }
+
+	    index = span_end;
 	}
+    }
 
-	slot.step_ptr += slot.step;
+    template<int mode>
+    void YMF271::render_pcm_span(opx_group &group, opx_slot &slot, size_t start, size_t end)
+    {
+	const int16_t *data = slot.pcm_data;
+	uint32_t last = slot.pcm_last;
+	uint64_t step_ptr = slot.step_ptr;
+	uint32_t step = slot.step;
+
+	const auto &env_output = env_unit.output_block[slot.number];
+	const auto &phase_mod = env_unit.phase_mod_block[slot.number];
+	const auto &gains = slot.pcm_gains;
+
+	for (size_t index = start; index < end; index++)
+	{
+	    // The span never passes the end address,
+	    // but that can still be past the end of the ROM
+	    uint32_t sample_pos = min(uint32_t(step_ptr >> 16), last);
+	    int32_t sample = data[sample_pos];
+
+	    if constexpr (mode != PCMNearest)
+	    {
+		// Neighboring samples are taken from the ROM as-is (i.e. not wrapped around the loop)
+		int32_t frac = int32_t(step_ptr & 0xFFFF);
+		int32_t next = data[min((sample_pos + 1), last)];
+
+		if constexpr (mode == PCMLinear)
+		{
+		    sample += (((next - sample) * frac) >> 16);
+		}
+		else
+		{
+		    float prev = data[((sample_pos > 0) ? (sample_pos - 1) : 0)];
+		    float after = data[min((sample_pos + 2), last)];
+		    float cur = sample;
+		    float t = (frac / 65536.0f);
+
+		    float a = ((((3.0f * (cur - next)) + after) - prev) * 0.5f);
+		    float b = ((((2.0f * next) + prev) - (((5.0f * cur) + after) * 0.5f)));
+		    float c = ((next - prev) * 0.5f);
+		    float result = ((((((a * t) + b) * t) + c) * t) + cur);
+		    sample = int32_t(clamp(result, -32768.0f, 32767.0f));
+		}
+	    }
+
+	    // The sample is at most 16 bits, and the envelope and each gain are at most 1.0 (in 16.16 fixed point),
+	    // so this all fits in 32 bits (and compiles down to a single 4-wide multiply-accumulate)
+	    int32_t slot_output = ((sample * env_output[index]) >> 16);
+	    auto &outputs = group.outputs[index];
+
+	    for (int i = 0; i < 4; i++)
+	    {
+		outputs[i] += ((slot_output * gains[i]) >> 16);
+	    }
+
+	    step_ptr += uint32_t((uint64_t(step) * phase_mod[index]) >> 16);
+	}
+
+	slot.step_ptr = step_ptr;
     }
 
-    void YMF271::update_fm_2op(opx_group &group, opx_slot &slot1, opx_slot &slot3)
+    // Shared by every FM connection: evaluates num_ops operators (in the order S1, S3, S2, S4)
+    // as connected by 'combo', and mixes the outputs into sample 'index' of the group
+    void YMF271::render_fm(opx_group &group, const array<opx_slot*, 4> &ops, int num_ops, int combo, size_t index)
     {
-	int algorithm = (slot1.algorithm & 0x3);
+	array<int64_t, 4> opout = {0, 0, 0, 0};
+	array<int, 4> inputs = {0, ((combo >> 1) & 0x1), ((combo >> 2) & 0x3), ((combo >> 4) & 0x7)};
 
-	int combo = algorithm_2op_combinations[algorithm];
+	for (int op = 0; op < num_ops; op++)
+	{
+	    auto &slot = *ops[op];
+	    int64_t phase_mod = 0;
 
-	array<int64_t, 2> opout;
-	opout[0] = 0;
-	opout[1] = calculate_op(slot1, 0);
+	    if (op == 0)
+	    {
+		phase_mod = ((slot.feedback_mod0 + slot.feedback_mod1) / 2);
+		slot.feedback_mod0 = slot.feedback_mod1;
+	    }
+	    else if (inputs[op] != 0)
+	    {
+		int64_t input = 0;
 
-	int64_t input = opout[((combo >> 1) & 0x1)];
+		for (int src = 0; src < op; src++)
+		{
+		    if (testbit(inputs[op], src))
+		    {
+			input += opout[src];
+		    }
+		}
 
-	int64_t phase_mod = ((input << 8) * 16);
+		phase_mod = ((input << 8) * modulation_level[slot.feedback]);
+	    }
 
-	int64_t phase_out = calculate_op(slot3, phase_mod);
+	    opout[op] = calculate_op(slot, phase_mod, group.is_pfm, index);
+	}
 
-	for (int i = 0; i < 4; i++)
+	auto &slot1 = *ops[0];
+	int64_t feedback_out = testbit(combo, 0) ? opout[1] : opout[0];
+	slot1.feedback_mod1 = (((feedback_out << 8) * feedback_level[slot1.feedback]) / 16);
+
+	auto &outputs = group.outputs[index];
+
+	for (int op = 0; op < num_ops; op++)
 	{
-	    int64_t output3 = (phase_out * attenutation_table[slot3.ch_level[i]]);
-	    group.outputs[i] += ((output3) >> 16);
+	    if (!testbit(combo, (7 + op)))
+	    {
+		continue;
+	    }
+
+	    // Like the PCM output, each operator output is at most 16 bits
+	    int32_t op_output = int32_t(opout[op]);
+	    const auto &gains = ops[op]->fm_gains;
+
+	    for (int i = 0; i < 4; i++)
+	    {
+		outputs[i] += ((op_output * gains[i]) >> 16);
+	    }
 	}
     }
 
-    int64_t YMF271::calculate_op(opx_slot &slot, int64_t input)
+    int64_t YMF271::calculate_op(opx_slot &slot, int64_t phase_mod, bool is_pfm, size_t index)
     {
 	int64_t slot_output = 0;
 
-	int64_t env = calc_slot_volume(slot);
+	int64_t env = calc_slot_volume(slot, index);
 
-	auto step_ptr = (((slot.step_ptr + input) >> 16) & 0x3FF);
+	// In PFM mode, operators set to the external waveform use the PCM sample instead
+	if (is_pfm && (slot.waveform == 7))
+	{
+	    slot_output = fetch_pfm_sample(slot, phase_mod);
+	}
+	else
+	{
+	    auto step_ptr = (((slot.step_ptr + phase_mod) >> 16) & 0x3FF);
+	    slot_output = waveform_table[slot.waveform][step_ptr];
+	}
 
-	slot_output = waveform_table[slot.waveform][step_ptr];
 	slot_output = ((slot_output * env) >> 16);
-	slot.step_ptr += slot.step;
+	slot.step_ptr += get_phase_step(slot, index);
 	return slot_output;
     }
 
+    // The PCM sample is treated as a waveform, looping between the loop and end addresses
+    int64_t YMF271::fetch_pfm_sample(opx_slot &slot, int64_t phase_mod)
+    {
+	wrap_pcm_position(slot);
+
+	int64_t end = slot.end_address;
+	int64_t loop = min<int64_t>(slot.loop_address, end);
+	int64_t pos = max<int64_t>(((int64_t(slot.step_ptr) + phase_mod) >> 16), 0);
+
+	if (pos > end)
+	{
+	    pos = (loop + ((pos - loop) % ((end - loop) + 1)));
+	}
+
+	return slot.pcm_data[min(uint32_t(pos), slot.pcm_last)];
+    }
+
     uint32_t YMF271::get_sample_rate(uint32_t clock_rate)
     {
 	return (clock_rate / 384);
@@ -600,13 +1065,44 @@ namespace beenuked
 	    slot.step = 0;
 	    slot.step_ptr = 0;
 	    slot.is_key_on = false;
+	    update_gains(slot);
 	}
 
 	for (int i = 0; i < 12; i++)
 	{
 	    auto &group = groups[i];
-	    group.outputs.fill(0);
+
+	    for (auto &outputs : group.outputs)
+	    {
+		outputs.fill(0);
+	    }
+	}
+
+	last_block_len = 1;
+
+	for (int i = 0; i < 12; i++)
+	{
+	    update_group_renderer(i);
+	}
+
+	env_unit.active_mask = 0;
+	env_unit.state.fill(EnvRelease);
+	env_unit.volume.fill(0);
+	env_unit.decay_level.fill(0);
+
+	for (auto &steps : env_unit.steps)
+	{
+	    steps.fill(0);
 	}
+
+	env_unit.lfo_phase.fill(0);
+	env_unit.lfo_step.fill(0);
+	env_unit.lfo_wave.fill(0);
+	env_unit.lfo_pms.fill(0);
+	env_unit.lfo_ams.fill(0);
+	env_unit.output.fill(0);
+	env_unit.phase_mod.fill(65536);
+	env_unit.active_len.fill(0);
     }
 
     void YMF271::writeIO(int port, uint8_t data)
@@ -623,38 +1119,44 @@ namespace beenuked
 	    case 0xC: chip_address[5] = data; break;
 	    case 0x1:
 	    {
+		BEENUKED_PROFILE_WRITE(((0 << 8) | chip_address[0]));
 		write_fm(0, chip_address[0], data);
 	    }
 	    break;
 	    case 0x3:
 	    {
+		BEENUKED_PROFILE_WRITE(((1 << 8) | chip_address[1]));
 		write_fm(1, chip_address[1], data);
 	    }
 	    break;
 	    case 0x5:
 	    {
+		BEENUKED_PROFILE_WRITE(((2 << 8) | chip_address[2]));
 		write_fm(2, chip_address[2], data);
 	    }
 	    break;
 	    case 0x7:
 	    {
+		BEENUKED_PROFILE_WRITE(((3 << 8) | chip_address[3]));
 		write_fm(3, chip_address[3], data);
 	    }
 	    break;
 	    case 0x9:
 	    {
+		BEENUKED_PROFILE_WRITE((0x400 | chip_address[4]));
 		write_pcm(chip_address[4], data);
 	    }
 	    break;
 	    case 0xD:
 	    {
+		BEENUKED_PROFILE_WRITE((0x500 | chip_address[5]));
 		write_timer(chip_address[5], data);
 	    }
 	    break;
 	}
     }
 
-    void YMF271::writeROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, vector<uint8_t> rom_data)
+    void YMF271::writeROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, const vector<uint8_t> &rom_data)
     {
 	opx_rom.resize(rom_size, 0xFF);
 
@@ -672,56 +1174,154 @@ namespace beenuked
 	}
 
 	copy(rom_data.begin(), (rom_data.begin() + data_length), (opx_rom.begin() + data_start));
+
+	opx_rom_data = opx_rom.data();
+	opx_rom_size = opx_rom.size();
+	opx_rom_owner.reset();
+	rom_changed();
     }
 
-    void YMF271::clockchip()
+    void YMF271::attachROM(const uint8_t *rom_data, uint32_t rom_size)
     {
-	for (int i = 0; i < 12; i++)
+	// Free up any ROM data previously copied in through writeROM
+	vector<uint8_t>().swap(opx_rom);
+
+	opx_rom_data = rom_data;
+	opx_rom_size = (rom_data != NULL) ? rom_size : 0;
+	opx_rom_owner.reset();
+	rom_changed();
+    }
+
+    void YMF271::attachROM(shared_ptr<const uint8_t> rom_data, uint32_t rom_size)
+    {
+	vector<uint8_t>().swap(opx_rom);
+
+	opx_rom_data = rom_data.get();
+	opx_rom_size = (rom_data != NULL) ? rom_size : 0;
+	opx_rom_owner = rom_data;
+	rom_changed();
+    }
+
+    void YMF271::set_pcm_interpolation(opx_interpolation mode)
+    {
+	pcm_interp = mode;
+    }
+
+    void YMF271::update_group_renderer(int group_num)
+    {
+	auto &group = groups[group_num];
+
+	switch (group.sync)
 	{
-	    auto &slot_group = groups[i];
-	    slot_group.outputs.fill(0);
+	    case 0: group_renderers[group_num] = &YMF271::render_group_fm4; break;
+	    case 1: group_renderers[group_num] = &YMF271::render_group_fm2x2; break;
+	    case 2: group_renderers[group_num] = &YMF271::render_group_fm3_pcm; break;
+	    case 3: group_renderers[group_num] = &YMF271::render_group_pcm4; break;
+	}
+    }
 
-	    if (slot_group.is_pfm && (slot_group.sync != 3))
+    // 4-slot FM (S1 = slot 0, S2 = slot 12, S3 = slot 24, S4 = slot 36 of the group)
+    void YMF271::render_group_fm4(opx_group &group, int group_num, size_t num_samples)
+    {
+	auto &slot1 = slots[group_num];
+	array<opx_slot*, 4> ops = {&slot1, &slots[(group_num + 24)], &slots[(group_num + 12)], &slots[(group_num + 36)]};
+	int combo = algorithm_4op_combinations[(slot1.algorithm & 0xF)];
+
+	for (size_t index = 0; index < num_samples; index++)
+	{
+	    if (is_slot_active(slot1, index))
 	    {
-		cout << "Unimplemented YMF271 PFM detected, contact BueniaDev" << endl;
+		render_fm(group, ops, 4, combo, index);
 	    }
+	}
+    }
 
-	    switch (slot_group.sync)
+    // 2x 2-slot FM (S1 and S3 from slots 0 and 24, and from slots 12 and 36)
+    void YMF271::render_group_fm2x2(opx_group &group, int group_num, size_t num_samples)
+    {
+	for (int j = 0; j < 2; j++)
+	{
+	    auto &slot1 = slots[(group_num + (j * 12))];
+	    array<opx_slot*, 4> ops = {&slot1, &slots[(group_num + ((j + 2) * 12))], NULL, NULL};
+	    int combo = algorithm_2op_combinations[(slot1.algorithm & 0x3)];
+
+	    for (size_t index = 0; index < num_samples; index++)
 	    {
-		case 1:
-		{
-		    for (int j = 0; j < 2; j++)
-		    {
-			int slot1 = (i + (j * 12));
-			int slot3 = (i + ((j + 2) * 12));
-			update_fm_2op(slot_group, slots[slot1], slots[slot3]);
-		    }
-		}
-		break;
-		case 2:
-		{
-		    // TODO: Implement FM
-		    auto &slot = slots[(i + 36)];
-		    update_pcm(slot_group, slot);
-		}
-		break;
-		case 3:
+		if (is_slot_active(slot1, index))
 		{
-		    for (int j = 0; j < 4; j++)
-		    {
-			int pcm_slot_num = (i + (j * 12));
-			auto &slot = slots[pcm_slot_num];
-			update_pcm(slot_group, slot);
-		    }
+		    render_fm(group, ops, 2, combo, index);
 		}
-		break;
-		default: break;
 	    }
 	}
     }
 
-    vector<int32_t> YMF271::get_samples()
+    // 3-slot FM (S1 = slot 0, S2 = slot 12, S3 = slot 24), with slot 36 as PCM
+    void YMF271::render_group_fm3_pcm(opx_group &group, int group_num, size_t num_samples)
+    {
+	auto &slot1 = slots[group_num];
+	array<opx_slot*, 4> ops = {&slot1, &slots[(group_num + 24)], &slots[(group_num + 12)], NULL};
+	int combo = algorithm_3op_combinations[(slot1.algorithm & 0x7)];
+
+	for (size_t index = 0; index < num_samples; index++)
+	{
+	    if (is_slot_active(slot1, index))
+	    {
+		render_fm(group, ops, 3, combo, index);
+	    }
+	}
+
+	render_pcm(group, slots[(group_num + 36)], num_samples);
+    }
+
+    // 4 PCM slots (PFM has no effect here)
+    void YMF271::render_group_pcm4(opx_group &group, int group_num, size_t num_samples)
+    {
+	for (int j = 0; j < 4; j++)
+	{
+	    render_pcm(group, slots[(group_num + (j * 12))], num_samples);
+	}
+    }
+
+    void YMF271::clock_block(size_t num_samples)
     {
+	// The envelopes and LFOs are stepped for the whole block up front,
+	// so that each PCM slot can then be rendered in one go
+	// (and so are timed once per block, with the LFOs counted as part of the envelope stage)
+	BEENUKED_PROFILE_START();
+	env_unit.active_len.fill(0);
+
+	for (size_t index = 0; index < num_samples; index++)
+	{
+	    clock_envelopes(index);
+	}
+
+	BEENUKED_PROFILE_LAP(ProfileEnvelope);
+
+	for (int i = 0; i < 12; i++)
+	{
+	    auto &slot_group = groups[i];
+
+	    for (size_t index = 0; index < num_samples; index++)
+	    {
+		slot_group.outputs[index].fill(0);
+	    }
+
+	    (this->*group_renderers[i])(slot_group, i, num_samples);
+	}
+
+	// Includes the PCM slots
+	BEENUKED_PROFILE_LAP(ProfileOutput);
+	last_block_len = num_samples;
+    }
+
+    void YMF271::clockchip()
+    {
+	clock_block(1);
+    }
+
+    array<int32_t, 4> YMF271::mix_output(size_t index)
+    {
+	BEENUKED_PROFILE_START();
 	array<int32_t, 4> mixed_samples = {0, 0};
 
 	for (int i = 0; i < 4; i++)
@@ -729,11 +1329,19 @@ namespace beenuked
 	    for (int j = 0; j < 12; j++)
 	    {
 		int32_t old_sample = mixed_samples[i];
-		int32_t new_sample = clamp((groups[j].outputs[i] >> 2), -32768, 32767);
+		int32_t new_sample = clamp((groups[j].outputs[index][i] >> 2), -32768, 32767);
 		mixed_samples[i] = (old_sample + new_sample);
 	    }
 	}
 
+	BEENUKED_PROFILE_LAP(ProfileMix);
+	return mixed_samples;
+    }
+
+    vector<int32_t> YMF271::get_samples()
+    {
+	array<int32_t, 4> mixed_samples = mix_output((last_block_len - 1));
+
 	vector<int32_t> final_samples;
 	final_samples.push_back(mixed_samples[0]);
 	final_samples.push_back(mixed_samples[1]);
@@ -741,4 +1349,151 @@ namespace beenuked
 	final_samples.push_back(mixed_samples[3]);
 	return final_samples;
     }
+
+    void YMF271::render(vector<int32_t> &buffer, size_t num_samples)
+    {
+	BEENUKED_PROFILE_BLOCK_BEGIN();
+
+	size_t start = buffer.size();
+	buffer.resize((start + (num_samples * 4)));
+
+	for (size_t pos = 0; pos < num_samples; pos += block_size)
+	{
+	    size_t block_len = min(block_size, (num_samples - pos));
+	    clock_block(block_len);
+
+	    for (size_t index = 0; index < block_len; index++)
+	    {
+		array<int32_t, 4> output = mix_output(index);
+		copy(output.begin(), output.end(), (buffer.begin() + (start + ((pos + index) * 4))));
+	    }
+	}
+
+	BEENUKED_PROFILE_BLOCK_END(num_samples);
+    }
+
+    void YMF271::render(vector<float> &buffer, size_t num_samples)
+    {
+	float_scratch.clear();
+	render(float_scratch, num_samples);
+	convert_float_output(float_scratch, buffer);
+    }
+
+    template<typename Archive>
+    void YMF271::opx_slot::serialize_state(Archive &state)
+    {
+	state.value(number, 0, 47);
+	state.value(start_address, 0, 0x7FFFFF);
+	state.value(is_alt_loop);
+	state.value(end_address, 0, 0x7FFFFF);
+	state.value(loop_address, 0, 0x7FFFFF);
+	state.value(step_ptr);
+	state.value(step);
+	state.value(multiply, 0, 15);
+	state.value(total_level, 0, 127);
+	state.value(freq_num, 0, 0xFFF);
+	state.value(freq_hi);
+	state.value(block, 0, 15);
+	state.value(fs, 0, 3);
+	state.value(is_12_bit);
+	state.value(srcnote, 0, 3);
+	state.value(srcb, 0, 7);
+
+	// The PCM source (pcm_data and pcm_last) points into the sample stores, so it is set up again on load
+	state.value(algorithm, 0, 15);
+	state.value(feedback, 0, 7);
+	state.value(is_accon);
+	state.value(feedback_mod0);
+	state.value(feedback_mod1);
+	state.value(ext_out, 0, 15);
+	state.value(ext_enable);
+	state.value(waveform, 0, 7);
+	state.value(is_key_on);
+	state.value(lfo_freq, 0, 255);
+	state.value(lfo_wave, 0, 3);
+	state.value(pms, 0, 7);
+	state.value(ams, 0, 3);
+	state.value(attack_rate, 0, 31);
+	state.value(key_scale, 0, 7);
+	state.value(decay1_rate, 0, 31);
+	state.value(decay2_rate, 0, 31);
+	state.value(release_rate, 0, 15);
+	state.value(decay1_level, 0, 15);
+	state.value(ch_level, 0, 15);
+	state.value(fm_gains);
+	state.value(pcm_gains);
+    }
+
+    template<typename Archive>
+    void YMF271::serialize_state(Archive &state)
+    {
+	state.value(chip_address);
+
+	// Only the last output of each group is kept,
+	// as that's all get_samples() uses from the previous block
+	for (int i = 0; i < 12; i++)
+	{
+	    auto &group = groups[i];
+	    array<int32_t, 4> last_output = group.outputs[(last_block_len - 1)];
+	    state.value(group.sync, 0, 3);
+	    state.value(group.is_pfm);
+	    state.value(last_output);
+
+	    if (state.is_loading())
+	    {
+		group.outputs[0] = last_output;
+		update_group_renderer(i);
+	    }
+	}
+
+	if (state.is_loading())
+	{
+	    last_block_len = 1;
+	}
+
+	// PCM slots point into the sample stores, so that pointer is set up again on load
+	for (auto &slot : slots)
+	{
+	    state.value(slot);
+
+	    if (state.is_loading() && (slot.waveform == 7))
+	    {
+		update_pcm_source(slot);
+	    }
+	}
+
+	// The per-block envelope outputs are recalculated at the start of every block
+	state.value(env_unit.active_mask, 0, ((uint64_t(1) << 48) - 1));
+	state.value(env_unit.state, EnvAttack, EnvRelease);
+	state.value(env_unit.volume, 0, (255 << 16));
+	state.value(env_unit.decay_level, 0, 255);
+
+	// No step is larger than a full-scale volume change, which keeps the volume from overflowing
+	for (auto &steps : env_unit.steps)
+	{
+	    state.value(steps, 0, (255 << 16));
+	}
+
+	state.value(env_unit.lfo_phase);
+	state.value(env_unit.lfo_step);
+	state.value(env_unit.lfo_wave, 0, 3);
+	state.value(env_unit.lfo_pms, 0, 7);
+	state.value(env_unit.lfo_ams, 0, 3);
+	state.value(env_unit.output);
+	state.value(env_unit.phase_mod);
+    }
+
+    void YMF271::save_state(vector<uint8_t> &buffer)
+    {
+	BeeNukedStateWriter state(buffer, StateYMF271, state_version);
+	serialize_state(state);
+	state.finish();
+    }
+
+    void YMF271::load_state(const vector<uint8_t> &buffer)
+    {
+	BeeNukedStateReader state(buffer, StateYMF271, state_version);
+	serialize_state(state);
+	state.finish();
+    }
 }
\ No newline at end of file
@@ -19,7 +19,14 @@
 #ifndef BEENUKED_YMF271
 #define BEENUKED_YMF271
 
+#include <memory>
+#include <map>
+#include <mutex>
 #include "utils.h"
+#include "trace.h"
+#include "state.h"
+#include "profile.h"
+#include "float_output.h"
 
 namespace beenuked
 {
@@ -29,18 +36,76 @@ namespace beenuked
 	    YMF271();
 	    ~YMF271();
 
+	    // The chip keeps pointers to its own copy of the ROM and into its sample stores,
+	    // which a copy of the chip would leave pointing at the original's
+	    YMF271(const YMF271&) = delete;
+	    YMF271 &operator=(const YMF271&) = delete;
+
 	    uint32_t get_sample_rate(uint32_t clock_rate);
 	    void init();
-	    void writeROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, vector<uint8_t> rom_data);
+	    void writeROM(uint32_t rom_size, uint32_t data_start, uint32_t data_len, const vector<uint8_t> &rom_data);
 	    void writeIO(int port, uint8_t data);
 	    void clockchip();
 	    vector<int32_t> get_samples();
 
-	    void writeROM(vector<uint8_t> rom_data)
+	    // Clocks the chip for a block of samples, appending them to the buffer
+	    // (laid out the same way as get_samples())
+	    void render(vector<int32_t> &buffer, size_t num_samples);
+
+	    // Same as above, but as normalized floats (see float_output.h)
+	    void render(vector<float> &buffer, size_t num_samples);
+
+	    // Snapshots the chip's state into the buffer (replacing its contents),
+	    // or restores a previously saved snapshot (see state.h)
+	    void save_state(vector<uint8_t> &buffer);
+	    void load_state(const vector<uint8_t> &buffer);
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    // Render timings and event counts (see profile.h)
+	    const BeeNukedProfileStats &get_profile_stats()
+	    {
+		return profiler.get_stats();
+	    }
+
+	    void reset_profile_stats()
+	    {
+		profiler.reset();
+	    }
+#endif
+
+	    void writeROM(const vector<uint8_t> &rom_data)
 	    {
 		writeROM(rom_data.size(), 0, rom_data.size(), rom_data);
 	    }
 
+	    // Attaches externally owned sample ROM without copying it,
+	    // so the same ROM can be shared by any number of chips.
+	    // The raw pointer version requires the data to outlive the chip,
+	    // and expands it again on every attach (so a refilled buffer can simply be attached again).
+	    // The shared_ptr version (i.e. for a memory-mapped file) keeps the data alive,
+	    // and chips attached to the same one share its expanded samples,
+	    // so its contents must not change while it's attached.
+	    void attachROM(const uint8_t *rom_data, uint32_t rom_size);
+	    void attachROM(shared_ptr<const uint8_t> rom_data, uint32_t rom_size);
+
+	    enum opx_interpolation : int
+	    {
+		PCMNearest = 0, // Nearest sample (the chip's own behavior)
+		PCMLinear = 1,
+		PCMCubic = 2 // 4-point (Catmull-Rom) interpolation
+	    };
+
+	    // Sets how PCM slots interpolate between the samples in the ROM
+	    void set_pcm_interpolation(opx_interpolation mode);
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    // Diagnostic events reported by this chip (see trace.h)
+	    BeeNukedTraceRing &get_trace_ring()
+	    {
+		return trace_ring;
+	    }
+#endif
+
 	private:
 	    template<typename T>
 	    bool testbit(T reg, int bit)
@@ -48,6 +113,14 @@ namespace beenuked
 		return ((reg >> bit) & 1) ? true : false;
 	    }
 
+	    // Maximum number of samples clocked at once
+	    static constexpr size_t block_size = 64;
+
+	    void clock_block(size_t num_samples);
+	    size_t last_block_len = 1;
+
+	    array<int32_t, 4> mix_output(size_t index);
+
 	    void init_tables();
 	    void reset();
 
@@ -61,7 +134,7 @@ namespace beenuked
 	    {
 		int sync = 0;
 		bool is_pfm = false;
-		array<int32_t, 4> outputs = {0, 0, 0, 0};
+		array<array<int32_t, 4>, block_size> outputs;
 	    };
 
 	    struct opx_slot
@@ -83,16 +156,119 @@ namespace beenuked
 		int srcnote = 0;
 		int srcb = 0;
 
+		// First sample of the slot in the expanded sample store,
+		// and the index of the silent sample at the end of the store
+		// (kept up to date for every slot set to the PCM waveform, as PFM operators
+		// read the sample whether or not they're keyed on)
+		const int16_t *pcm_data = NULL;
+		uint32_t pcm_last = 0;
+
 		int algorithm = 0;
+		int feedback = 0;
+		bool is_accon = false;
+
+		// The last two feedback inputs of S1
+		int64_t feedback_mod0 = 0;
+		int64_t feedback_mod1 = 0;
 
 		int ext_out = 0;
 		bool ext_enable = false;
 
 		int waveform = 0;
 		bool is_key_on = false;
+
+		int lfo_freq = 0;
+		int lfo_wave = 0;
+		int pms = 0;
+		int ams = 0;
+
+		int attack_rate = 0;
+		int key_scale = 0;
+		int decay1_rate = 0;
+		int decay2_rate = 0;
+		int release_rate = 0;
+		int decay1_level = 0;
 		array<int, 4> ch_level = {0, 0, 0, 0};
+
+		// Gains for each of the 4 outputs, recalculated whenever the total level or a channel level is written
+		// (FM slots apply their total level in calculate_op, so only the PCM gains include it)
+		array<int32_t, 4> fm_gains = {0, 0, 0, 0};
+		array<int32_t, 4> pcm_gains = {0, 0, 0, 0};
+
+		template<typename Archive>
+		void serialize_state(Archive &state);
+	    };
+
+	    enum opx_env_state : int32_t
+	    {
+		EnvAttack = 0,
+		EnvDecay1 = 1,
+		EnvDecay2 = 2,
+		EnvRelease = 3
 	    };
 
+	    // Per-sample envelope and LFO state of all 48 slots (indexed by slot number),
+	    // with one array per field, so that clock_env_batch can step 8 slots at a time
+	    struct opx_env_unit
+	    {
+		// Slots with a running envelope (bit n = slot n)
+		uint64_t active_mask = 0;
+
+		array<int32_t, 48> state;
+		array<int32_t, 48> volume; // 8.16 fixed point (0 = -96 dB, 255 = 0 dB)
+		array<int32_t, 48> decay_level;
+		array<array<int32_t, 48>, 4> steps; // Volume change per sample in each state
+
+		array<uint32_t, 48> lfo_phase;
+		array<uint32_t, 48> lfo_step;
+		array<int32_t, 48> lfo_wave;
+		array<int32_t, 48> lfo_pms;
+		array<int32_t, 48> lfo_ams;
+
+		// Updated every sample (both in 16.16 fixed point)
+		array<int32_t, 48> output; // Envelope volume, including the LFO's amplitude modulation
+		array<int32_t, 48> phase_mod; // Frequency multiplier from the LFO's phase modulation
+
+		// The above outputs for every sample of the current block,
+		// along with the number of samples at the start of the block that each slot is active for
+		array<array<int32_t, block_size>, 48> output_block;
+		array<array<int32_t, block_size>, 48> phase_mod_block;
+		array<int32_t, 48> active_len;
+	    };
+
+	    opx_env_unit env_unit;
+
+	    void init_envelope(opx_slot &slot);
+	    void init_lfo(opx_slot &slot);
+	    int32_t calc_env_step(const array<double, 64> &times, int rate, int keycode, int key_scale, int distance);
+
+	    void clock_envelopes(size_t index);
+	    void clock_env_batch(int first, size_t index);
+
+	    bool is_slot_active(opx_slot &slot)
+	    {
+		return testbit(env_unit.active_mask, slot.number);
+	    }
+
+	    // Slots that have gone idle (or never started) in this block keep their last outputs
+	    bool is_slot_active(opx_slot &slot, size_t index)
+	    {
+		return (int32_t(index) < env_unit.active_len[slot.number]);
+	    }
+
+	    int32_t get_env_output(opx_slot &slot, size_t index)
+	    {
+		int num = slot.number;
+		return is_slot_active(slot, index) ? env_unit.output_block[num][index] : env_unit.output[num];
+	    }
+
+	    uint32_t get_phase_step(opx_slot &slot, size_t index)
+	    {
+		int num = slot.number;
+		int32_t phase_mod = is_slot_active(slot, index) ? env_unit.phase_mod_block[num][index] : env_unit.phase_mod[num];
+		return uint32_t((uint64_t(slot.step) * phase_mod) >> 16);
+	    }
+
 	    array<uint8_t, 6> chip_address;
 
 	    array<opx_group, 12> groups;
@@ -101,26 +277,97 @@ namespace beenuked
 	    void key_on(opx_slot &slot);
 	    void key_off(opx_slot &slot);
 
-	    void update_fm_2op(opx_group &group, opx_slot &slot1, opx_slot &slot3);
+	    // Each group's renderer is picked whenever its mode is written,
+	    // so clock_block doesn't have to check the mode of every group
+	    typedef void (YMF271::*opx_group_renderer)(opx_group &group, int group_num, size_t num_samples);
+	    array<opx_group_renderer, 12> group_renderers;
+
+	    void update_group_renderer(int group_num);
+
+	    void render_group_fm4(opx_group &group, int group_num, size_t num_samples);
+	    void render_group_fm2x2(opx_group &group, int group_num, size_t num_samples);
+	    void render_group_fm3_pcm(opx_group &group, int group_num, size_t num_samples);
+	    void render_group_pcm4(opx_group &group, int group_num, size_t num_samples);
 
-	    int64_t calculate_op(opx_slot &slot, int64_t input);
+	    void render_fm(opx_group &group, const array<opx_slot*, 4> &ops, int num_ops, int combo, size_t index);
+
+	    int64_t calculate_op(opx_slot &slot, int64_t phase_mod, bool is_pfm, size_t index);
+	    int64_t fetch_pfm_sample(opx_slot &slot, int64_t phase_mod);
+	    void wrap_pcm_position(opx_slot &slot);
 
 	    void calculate_step(opx_slot &slot);
 
-	    void update_pcm(opx_group &group, opx_slot &slot);
+	    opx_interpolation pcm_interp = PCMNearest;
+
+	    void render_pcm(opx_group &group, opx_slot &slot, size_t num_samples);
+
+	    template<int mode>
+	    void render_pcm_span(opx_group &group, opx_slot &slot, size_t start, size_t end);
 
 	    array<int, 16> attenutation_table;
 	    array<int, 128> total_level_table;
 
 	    array<array<int16_t, 1024>, 8> waveform_table;
 
-	    int64_t calc_slot_volume(opx_slot &slot);
+	    // Attack/release and decay times (in samples) for each envelope rate
+	    array<double, 64> env_ar_table;
+	    array<double, 64> env_dc_table;
+	    array<array<int, 8>, 32> key_scale_table;
+	    array<int32_t, 256> env_volume_table;
+
+	    array<double, 256> lfo_freq_table;
+	    array<int32_t, 4> lfo_ams_table;
+	    array<int32_t, 8> lfo_pms_max_table;
+	    array<array<int32_t, 256>, 4> alfo_table;
+	    array<array<array<int32_t, 256>, 8>, 4> plfo_table;
 
-	    uint8_t readROM(uint32_t addr);
+	    int64_t calc_slot_volume(opx_slot &slot, size_t index);
+	    void update_gains(opx_slot &slot);
 
 	    vector<uint8_t> opx_rom;
 
+	    const uint8_t *opx_rom_data = NULL;
+	    uint32_t opx_rom_size = 0;
+	    shared_ptr<const uint8_t> opx_rom_owner;
+
+	    // The ROM, expanded to one 16-bit sample per entry the first time each format is used,
+	    // with a silent sample added at the end of each store.
+	    // 12-bit samples are packed in pairs of 3 bytes, so there's a store for each
+	    // possible alignment of the start address (i.e. start address % 3).
+	    // Chips attached to the same shared_ptr ROM share one set of stores.
+	    struct opx_pcm_stores
+	    {
+		const uint8_t *rom_data = NULL;
+		uint32_t rom_size = 0;
+		// 8-bit store, followed by the 12-bit stores for each alignment
+		array<vector<int16_t>, 4> stores;
+		array<once_flag, 4> is_expanded;
+	    };
+
+	    shared_ptr<opx_pcm_stores> pcm_stores;
+
+	    static shared_ptr<opx_pcm_stores> get_shared_pcm_stores(const shared_ptr<const uint8_t> &rom_owner, const uint8_t *rom_data, uint32_t rom_size);
+	    const vector<int16_t> &get_pcm_store(bool is_12_bit, int alignment);
+	    void update_pcm_source(opx_slot &slot);
+	    void rom_changed();
+
+	    static constexpr uint32_t state_version = 2;
+
+	    template<typename Archive>
+	    void serialize_state(Archive &state);
+
+	    // Integer samples for the float render() (kept around to reuse the allocation)
+	    vector<int32_t> float_scratch;
+
 	    #include "opx_tables.inl"
+
+#if defined(BEENUKED_ENABLE_TRACE)
+	    BeeNukedTraceRing trace_ring;
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+	    BeeNukedProfiler profiler;
+#endif
 	};
 };
 
@@ -0,0 +1,641 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_BOARD_MIXER_H
+#define BEENUKED_BOARD_MIXER_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "resampler.h"
+#include "float_output.h"
+
+// Mixer for boards with several sound chips (i.e. 2x YM2151, or a YM2610 and its SSG)
+//
+// The mixer owns its chips, and renders a block from each of them at once,
+// resampling any chip whose native rate differs from the board's output rate (see resampler.h).
+// Every chip then goes through its own routing matrix, which maps each of its channels
+// (laid out the same way as its get_samples()) onto the board's output channels:
+//
+//     BeeNukedBoardMixer board;
+//     board.init(48000, 2);
+//     auto &opm = board.add_chip<YM2151>(3579545, 2);
+//     auto &opn = board.add_chip<YM2203>(4000000, 4);
+//     opm.init();
+//     opn.init();
+//     board.set_route(1, 3, 0, 0.5f); // YM2203 FM to both sides
+//     board.set_route(1, 3, 1, 0.5f);
+//     board.render(buffer, 800);
+//
+// By default, a mono chip goes to every output, and otherwise each chip channel goes to
+// the output channel of the same number (if there is one), so chips with extra channels
+// (i.e. the YM2203's SSG outputs, or the YM2608's SSG + FM layout) need their routes set.
+// The gain and pan of each chip are applied on top of its routes.
+//
+// Any other sound source (i.e. an SN76489) can be added as long as it has
+// get_sample_rate(clock), writeIO(port, data) and render(vector<int32_t>&, num_samples) functions.
+//
+// Chips are rendered into their own buffers, then converted to planar floats,
+// so that mixing is just multiply-adds over contiguous arrays, which the compiler can vectorize.
+// The output uses the same conventions as each core's float render() (see float_output.h).
+//
+// For boards with many chips, set_num_threads() spreads the chips over several threads.
+// Register writes for the next block are queued with write() (stamped with the frame they happen on),
+// and each chip is rendered by exactly one thread, in segments between its own writes.
+// The calling thread then waits for every chip at the end of the block, and mixes them in order,
+// so the output is the same for any number of threads (and any thread timing).
+// The chips returned by add_chip() can still be set up and written to directly,
+// but only between calls to render().
+
+namespace beenuked
+{
+    // Type-erased interface to a chip owned by the board
+    class BeeNukedBoardSource
+    {
+	public:
+	    virtual ~BeeNukedBoardSource()
+	    {
+
+	    }
+
+	    virtual void writeIO(int port, uint8_t data) = 0;
+	    virtual void render(std::vector<int32_t> &buffer, size_t num_samples) = 0;
+    };
+
+    template<typename Chip>
+    class BeeNukedBoardChip : public BeeNukedBoardSource
+    {
+	public:
+	    Chip chip;
+
+	    void writeIO(int port, uint8_t data) override
+	    {
+		chip.writeIO(port, data);
+	    }
+
+	    void render(std::vector<int32_t> &buffer, size_t num_samples) override
+	    {
+		chip.render(buffer, num_samples);
+	    }
+    };
+
+    class BeeNukedBoardMixer
+    {
+	public:
+	    ~BeeNukedBoardMixer()
+	    {
+		stop_workers();
+	    }
+
+	    void init(uint32_t sample_rate, int num_channels = 2, BeeNukedResamplerQuality quality = ResampleBalanced)
+	    {
+		if ((sample_rate == 0) || (num_channels <= 0))
+		{
+		    throw std::out_of_range("Invalid board mixer configuration");
+		}
+
+		output_rate = sample_rate;
+		output_channels = num_channels;
+		resampler_quality = quality;
+		chips.clear();
+	    }
+
+	    // Creates a chip running at 'clock_rate', with 'num_channels' output channels,
+	    // and returns it so that it can be set up and written to.
+	    // The chip's index (for the functions below) is the number of chips added before it.
+	    template<typename Chip>
+	    Chip &add_chip(uint32_t clock_rate, int num_channels)
+	    {
+		if (num_channels <= 0)
+		{
+		    throw std::out_of_range("Invalid number of chip channels");
+		}
+
+		auto source = std::make_unique<BeeNukedBoardChip<Chip>>();
+		Chip &chip = source->chip;
+
+		board_chip entry;
+		entry.sample_rate = chip.get_sample_rate(clock_rate);
+		entry.num_channels = num_channels;
+		entry.is_resampled = (entry.sample_rate != output_rate);
+
+		if (entry.is_resampled)
+		{
+		    entry.resampler.init(entry.sample_rate, output_rate, num_channels, resampler_quality);
+		}
+
+		entry.routes.assign((output_channels * num_channels), 0.0f);
+
+		for (int out_ch = 0; out_ch < output_channels; out_ch++)
+		{
+		    if (num_channels == 1)
+		    {
+			entry.routes[(out_ch * num_channels)] = 1.0f;
+		    }
+		    else if (out_ch < num_channels)
+		    {
+			entry.routes[((out_ch * num_channels) + out_ch)] = 1.0f;
+		    }
+		}
+
+		entry.source = std::move(source);
+		chips.push_back(std::move(entry));
+		update_matrix(chips.back());
+		return chip;
+	    }
+
+	    size_t get_num_chips() const
+	    {
+		return chips.size();
+	    }
+
+	    // Native sample rate of a chip
+	    uint32_t get_chip_sample_rate(size_t index) const
+	    {
+		return get_chip(index).sample_rate;
+	    }
+
+	    void set_gain(size_t index, float gain)
+	    {
+		auto &entry = get_chip(index);
+		entry.gain = gain;
+		update_matrix(entry);
+	    }
+
+	    // Balance between output channels 0 and 1 (from -1.0 for left only to 1.0 for right only),
+	    // which leaves the center at full volume
+	    void set_pan(size_t index, float pan)
+	    {
+		auto &entry = get_chip(index);
+		entry.pan = std::min(std::max(pan, -1.0f), 1.0f);
+		update_matrix(entry);
+	    }
+
+	    // Sets how much of a chip's channel goes to an output channel (0.0 to remove the route)
+	    void set_route(size_t index, int chip_channel, int out_channel, float gain)
+	    {
+		auto &entry = get_chip(index);
+
+		if ((chip_channel < 0) || (chip_channel >= entry.num_channels) || (out_channel < 0) || (out_channel >= output_channels))
+		{
+		    throw std::out_of_range("Invalid board mixer route");
+		}
+
+		entry.routes[((out_channel * entry.num_channels) + chip_channel)] = gain;
+		update_matrix(entry);
+	    }
+
+	    // Removes all of a chip's routes (silencing it)
+	    void clear_routes(size_t index)
+	    {
+		auto &entry = get_chip(index);
+		std::fill(entry.routes.begin(), entry.routes.end(), 0.0f);
+		update_matrix(entry);
+	    }
+
+	    // Clears the resamplers' buffered input and any queued writes
+	    // (i.e. after seeking or loading a state)
+	    void reset()
+	    {
+		for (auto &entry : chips)
+		{
+		    if (entry.is_resampled)
+		    {
+			entry.resampler.reset();
+		    }
+
+		    entry.writes.clear();
+		}
+	    }
+
+	    // Queues a register write for the next render(), to happen 'frame' output frames into the block.
+	    // Writes to the same chip on the same frame happen in the order they were queued,
+	    // and writes past the end of the block are carried over to the following ones.
+	    void write(size_t index, int port, uint8_t data, size_t frame = 0)
+	    {
+		board_write reg_write;
+		reg_write.frame = frame;
+		reg_write.port = port;
+		reg_write.data = data;
+		get_chip(index).writes.push_back(reg_write);
+	    }
+
+	    // Renders the chips on 'num_threads' threads, including the one calling render()
+	    // (1, the default, renders everything on the calling thread)
+	    void set_num_threads(int num_threads)
+	    {
+		if (num_threads <= 0)
+		{
+		    throw std::out_of_range("Invalid number of board mixer threads");
+		}
+
+		stop_workers();
+		thread_count = num_threads;
+
+		for (int thread_id = 1; thread_id < thread_count; thread_id++)
+		{
+		    workers.emplace_back(&BeeNukedBoardMixer::worker_loop, this, thread_id, frame_gen);
+		}
+	    }
+
+	    int get_num_threads() const
+	    {
+		return thread_count;
+	    }
+
+	    // Renders a chip on a specific thread (i.e. to give a YMF271 a thread of its own),
+	    // or on thread (index % number of threads) if 'thread_id' is -1 (the default)
+	    void set_chip_thread(size_t index, int thread_id)
+	    {
+		if (thread_id < -1)
+		{
+		    throw std::out_of_range("Invalid board mixer thread");
+		}
+
+		get_chip(index).thread_id = thread_id;
+	    }
+
+	    // Renders 'num_frames' frames from every chip, appending the mixed,
+	    // interleaved output to 'buffer'
+	    void render(std::vector<float> &buffer, size_t num_frames)
+	    {
+		render_chips(num_frames);
+		mix_chips(buffer, num_frames);
+	    }
+
+	private:
+	    struct board_write
+	    {
+		size_t frame = 0;
+		int port = 0;
+		uint8_t data = 0;
+	    };
+
+	    struct board_chip
+	    {
+		std::unique_ptr<BeeNukedBoardSource> source;
+		uint32_t sample_rate = 0;
+		int num_channels = 1;
+		bool is_resampled = false;
+		BeeNukedResampler resampler;
+
+		int thread_id = -1;
+		std::vector<board_write> writes;
+
+		float gain = 1.0f;
+		float pan = 0.0f;
+
+		// [out_channel][chip_channel], as set by the host,
+		// and with the gain, pan and float scale applied
+		std::vector<float> routes;
+		std::vector<float> matrix;
+
+		// Interleaved samples at the board's rate, and the same samples as planar floats
+		std::vector<int32_t> block;
+		std::vector<float> planar;
+	    };
+
+	    uint32_t output_rate = 44100;
+	    int output_channels = 2;
+	    BeeNukedResamplerQuality resampler_quality = ResampleBalanced;
+
+	    std::vector<board_chip> chips;
+	    std::vector<float> mix_buffer;
+
+	    // Worker threads (the calling thread is thread 0)
+	    int thread_count = 1;
+	    std::vector<std::thread> workers;
+
+	    // Frame handoff: the calling thread bumps frame_gen to start a block on every worker,
+	    // and each worker decrements frames_pending once its chips are done
+	    std::mutex frame_mutex;
+	    std::condition_variable frame_start;
+	    std::condition_variable frame_done;
+	    uint64_t frame_gen = 0;
+	    size_t frame_len = 0;
+	    int frames_pending = 0;
+	    bool is_stopping = false;
+	    std::exception_ptr worker_error;
+
+	    board_chip &get_chip(size_t index)
+	    {
+		if (index >= chips.size())
+		{
+		    throw std::out_of_range("Invalid board chip index");
+		}
+
+		return chips[index];
+	    }
+
+	    const board_chip &get_chip(size_t index) const
+	    {
+		if (index >= chips.size())
+		{
+		    throw std::out_of_range("Invalid board chip index");
+		}
+
+		return chips[index];
+	    }
+
+	    void update_matrix(board_chip &entry)
+	    {
+		entry.matrix.resize(entry.routes.size());
+
+		for (int out_ch = 0; out_ch < output_channels; out_ch++)
+		{
+		    float out_gain = (entry.gain * float_output_scale);
+
+		    // Panning only applies to the first two output channels
+		    if (out_ch == 0)
+		    {
+			out_gain *= std::min((1.0f - entry.pan), 1.0f);
+		    }
+		    else if (out_ch == 1)
+		    {
+			out_gain *= std::min((1.0f + entry.pan), 1.0f);
+		    }
+
+		    for (int in_ch = 0; in_ch < entry.num_channels; in_ch++)
+		    {
+			size_t route = ((out_ch * entry.num_channels) + in_ch);
+			entry.matrix[route] = (entry.routes[route] * out_gain);
+		    }
+		}
+	    }
+
+	    void stop_workers()
+	    {
+		if (workers.empty())
+		{
+		    return;
+		}
+
+		{
+		    std::lock_guard<std::mutex> lock(frame_mutex);
+		    is_stopping = true;
+		}
+
+		frame_start.notify_all();
+
+		for (auto &worker : workers)
+		{
+		    worker.join();
+		}
+
+		workers.clear();
+		is_stopping = false;
+	    }
+
+	    void worker_loop(int thread_id, uint64_t last_gen)
+	    {
+		while (true)
+		{
+		    size_t num_frames = 0;
+
+		    {
+			std::unique_lock<std::mutex> lock(frame_mutex);
+			frame_start.wait(lock, [&]()
+			{
+			    return (is_stopping || (frame_gen != last_gen));
+			});
+
+			if (is_stopping)
+			{
+			    return;
+			}
+
+			last_gen = frame_gen;
+			num_frames = frame_len;
+		    }
+
+		    std::exception_ptr error;
+
+		    try
+		    {
+			render_thread_chips(thread_id, num_frames);
+		    }
+		    catch (...)
+		    {
+			error = std::current_exception();
+		    }
+
+		    {
+			std::lock_guard<std::mutex> lock(frame_mutex);
+
+			if (error && !worker_error)
+			{
+			    worker_error = error;
+			}
+
+			frames_pending -= 1;
+		    }
+
+		    frame_done.notify_one();
+		}
+	    }
+
+	    // Renders every chip's block, waiting for the workers at the end of it
+	    // (any exception thrown while rendering is rethrown here)
+	    void render_chips(size_t num_frames)
+	    {
+		if (workers.empty())
+		{
+		    render_thread_chips(0, num_frames);
+		    return;
+		}
+
+		{
+		    std::lock_guard<std::mutex> lock(frame_mutex);
+		    frame_len = num_frames;
+		    frames_pending = int(workers.size());
+		    frame_gen += 1;
+		}
+
+		frame_start.notify_all();
+
+		std::exception_ptr error;
+
+		try
+		{
+		    render_thread_chips(0, num_frames);
+		}
+		catch (...)
+		{
+		    error = std::current_exception();
+		}
+
+		{
+		    std::unique_lock<std::mutex> lock(frame_mutex);
+		    frame_done.wait(lock, [&]()
+		    {
+			return (frames_pending == 0);
+		    });
+
+		    if (!error)
+		    {
+			error = worker_error;
+		    }
+
+		    worker_error = nullptr;
+		}
+
+		if (error)
+		{
+		    std::rethrow_exception(error);
+		}
+	    }
+
+	    void render_thread_chips(int thread_id, size_t num_frames)
+	    {
+		for (size_t index = 0; index < chips.size(); index++)
+		{
+		    int chip_thread = chips[index].thread_id;
+		    chip_thread = (chip_thread < 0) ? int(index % thread_count) : (chip_thread % thread_count);
+
+		    if (chip_thread == thread_id)
+		    {
+			render_chip(chips[index], num_frames);
+		    }
+		}
+	    }
+
+	    void render_segment(board_chip &entry, size_t num_frames)
+	    {
+		if (num_frames == 0)
+		{
+		    return;
+		}
+
+		if (entry.is_resampled)
+		{
+		    entry.resampler.render(*entry.source, entry.block, num_frames);
+		}
+		else
+		{
+		    entry.source->render(entry.block, num_frames);
+		}
+	    }
+
+	    // Renders a chip's block at the board's rate (applying its queued writes as it goes),
+	    // then splits it into planar floats (each chip only touches its own state here)
+	    void render_chip(board_chip &entry, size_t num_frames)
+	    {
+		auto &writes = entry.writes;
+		entry.block.clear();
+
+		std::stable_sort(writes.begin(), writes.end(), [](const board_write &a, const board_write &b)
+		{
+		    return (a.frame < b.frame);
+		});
+
+		size_t pos = 0;
+		size_t next_write = 0;
+
+		while (pos < num_frames)
+		{
+		    while ((next_write < writes.size()) && (writes[next_write].frame <= pos))
+		    {
+			entry.source->writeIO(writes[next_write].port, writes[next_write].data);
+			next_write += 1;
+		    }
+
+		    size_t end = (next_write < writes.size()) ? std::min(writes[next_write].frame, num_frames) : num_frames;
+		    render_segment(entry, (end - pos));
+		    pos = end;
+		}
+
+		// Carry the rest over to the next block
+		writes.erase(writes.begin(), (writes.begin() + next_write));
+
+		for (auto &reg_write : writes)
+		{
+		    reg_write.frame -= num_frames;
+		}
+
+		int num_channels = entry.num_channels;
+		entry.planar.resize((num_channels * num_frames));
+
+		for (int in_ch = 0; in_ch < num_channels; in_ch++)
+		{
+		    float *plane = (entry.planar.data() + (in_ch * num_frames));
+
+		    for (size_t i = 0; i < num_frames; i++)
+		    {
+			plane[i] = float(entry.block[((i * num_channels) + in_ch)]);
+		    }
+		}
+	    }
+
+	    void mix_chips(std::vector<float> &buffer, size_t num_frames)
+	    {
+		mix_buffer.assign((output_channels * num_frames), 0.0f);
+
+		for (auto &entry : chips)
+		{
+		    for (int out_ch = 0; out_ch < output_channels; out_ch++)
+		    {
+			float *mix = (mix_buffer.data() + (out_ch * num_frames));
+
+			for (int in_ch = 0; in_ch < entry.num_channels; in_ch++)
+			{
+			    float scale = entry.matrix[((out_ch * entry.num_channels) + in_ch)];
+
+			    if (scale == 0.0f)
+			    {
+				continue;
+			    }
+
+			    const float *plane = (entry.planar.data() + (in_ch * num_frames));
+
+			    for (size_t i = 0; i < num_frames; i++)
+			    {
+				mix[i] += (plane[i] * scale);
+			    }
+			}
+		    }
+		}
+
+		for (auto &sample : mix_buffer)
+		{
+		    sample = beenuked_soft_clip(sample);
+		}
+
+		size_t start = buffer.size();
+		buffer.resize((start + (output_channels * num_frames)));
+
+		for (int out_ch = 0; out_ch < output_channels; out_ch++)
+		{
+		    const float *mix = (mix_buffer.data() + (out_ch * num_frames));
+
+		    for (size_t i = 0; i < num_frames; i++)
+		    {
+			buffer[(start + (i * output_channels) + out_ch)] = mix[i];
+		    }
+		}
+	    }
+    };
+};
+
+#endif // BEENUKED_BOARD_MIXER_H
\ No newline at end of file
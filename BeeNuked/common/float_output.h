@@ -0,0 +1,77 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_FLOAT_OUTPUT_H
+#define BEENUKED_FLOAT_OUTPUT_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Float output for the BeeNuked cores
+//
+// Every core's integer output is already scaled to 16 bits (after its own mixing and DAC emulation),
+// so the float output uses the same convention for all of them: a full-scale sample of 32768 becomes 1.0.
+// Anything louder (i.e. the YMF271's 12 summed groups, or loud SSG samples from the host)
+// is soft clipped rather than wrapped or hard clipped, so the samples never leave [-1.0, 1.0].
+//
+// Each core's render(vector<float>&) renders a block as usual,
+// then converts the whole block in one pass (which the compiler can vectorize).
+
+namespace beenuked
+{
+    static constexpr float float_output_scale = (1.0f / 32768.0f);
+
+    // Samples below the knee (about -2.5 dBFS) are left untouched
+    static constexpr float float_output_knee = 0.75f;
+
+    // Above the knee, the overshoot is squashed with x / (1 + x),
+    // so the curve keeps a slope of 1 through the knee, and only approaches 1.0
+    //
+    // (max(x, 0) is written as (x + |x|) / 2, since compares and selects keep GCC from vectorizing
+    // the conversion loop unless -fno-trapping-math is used; below the knee it's still exactly 0)
+    inline float beenuked_soft_clip(float val)
+    {
+	constexpr float headroom = (1.0f - float_output_knee);
+
+	float mag = std::fabs(val);
+	float over = (0.5f * ((mag - float_output_knee) + std::fabs((mag - float_output_knee))));
+	float scaled = (over / headroom);
+	float clipped = ((mag - over) + (headroom * (scaled / (1.0f + scaled))));
+	return std::copysign(clipped, val);
+    }
+
+    inline void convert_float_output(const int32_t *samples, float *output, size_t count)
+    {
+	for (size_t i = 0; i < count; i++)
+	{
+	    output[i] = beenuked_soft_clip((float(samples[i]) * float_output_scale));
+	}
+    }
+
+    // Appends the converted samples to the buffer
+    inline void convert_float_output(const std::vector<int32_t> &samples, std::vector<float> &buffer)
+    {
+	size_t start = buffer.size();
+	buffer.resize((start + samples.size()));
+	convert_float_output(samples.data(), (buffer.data() + start), samples.size());
+    }
+};
+
+#endif // BEENUKED_FLOAT_OUTPUT_H
\ No newline at end of file
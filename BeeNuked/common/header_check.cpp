@@ -0,0 +1,22 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// The common headers are only compiled as part of the cores that use them,
+// so the ones that no core includes are built here, to keep them compiling
+#include "board_mixer.h"
+#include "keyframes.h"
\ No newline at end of file
@@ -0,0 +1,228 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_KEYFRAMES_H
+#define BEENUKED_KEYFRAMES_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "state.h"
+
+// Keyframe index for seeking in long register logs (i.e. VGM files)
+//
+// While a log is played through once, record() is called between register writes,
+// and saves the chip's state (see state.h) every 'interval' output samples,
+// along with the host's position in the log at that point.
+// A seek then restores the last keyframe before the target with seek(),
+// and only the remainder is emulated, instead of the whole log up to the target:
+//
+//     auto frame = index.seek(chip, target);
+//     (play the log from frame->stream_pos, discarding the first (target - frame->sample_pos) samples)
+//
+// The index only holds chip state, so any host-side state (i.e. a BeeNukedResampler)
+// should be reset on seeks. The states are stored back to back in a single buffer,
+// and the whole index can be saved alongside the log, so later sessions can seek right away
+// (like save states, a saved index is only meant for the same build of the library).
+
+namespace beenuked
+{
+    struct BeeNukedKeyframe
+    {
+	uint64_t sample_pos = 0; // Output samples rendered before the keyframe
+	uint64_t stream_pos = 0; // Host-defined position in the register log (i.e. a file offset)
+	uint64_t state_offset = 0;
+	uint64_t state_size = 0;
+
+	template<typename Archive>
+	void serialize_state(Archive &state)
+	{
+	    state.value(sample_pos);
+	    state.value(stream_pos);
+	    state.value(state_offset);
+	    state.value(state_size);
+	}
+    };
+
+    // 'INDX'
+    static constexpr uint32_t beenuked_keyframe_index_id = 0x58444E49;
+
+    class BeeNukedKeyframeIndex
+    {
+	public:
+	    // Sets the distance between keyframes, in output samples
+	    // (i.e. the sample rate times the number of seconds),
+	    // and clears any existing keyframes
+	    void init(uint64_t interval)
+	    {
+		if (interval == 0)
+		{
+		    throw std::out_of_range("Invalid keyframe interval");
+		}
+
+		keyframe_interval = interval;
+		clear();
+	    }
+
+	    void clear()
+	    {
+		keyframes.clear();
+		states.clear();
+	    }
+
+	    // Takes a keyframe if at least 'interval' samples have passed since the last one
+	    // (or if there aren't any yet), returning true if one was taken.
+	    // Positions before the last keyframe are ignored, so recording can simply carry on
+	    // after seeking back into the part of the log that's already indexed.
+	    template<typename Chip>
+	    bool record(Chip &chip, uint64_t sample_pos, uint64_t stream_pos)
+	    {
+		if (!keyframes.empty() && (sample_pos < (keyframes.back().sample_pos + keyframe_interval)))
+		{
+		    return false;
+		}
+
+		chip.save_state(state_buffer);
+
+		BeeNukedKeyframe frame;
+		frame.sample_pos = sample_pos;
+		frame.stream_pos = stream_pos;
+		frame.state_offset = states.size();
+		frame.state_size = state_buffer.size();
+
+		states.insert(states.end(), state_buffer.begin(), state_buffer.end());
+		keyframes.push_back(frame);
+		return true;
+	    }
+
+	    // Finds the last keyframe at or before 'sample_pos' (NULL if there isn't one)
+	    const BeeNukedKeyframe *find(uint64_t sample_pos) const
+	    {
+		auto iter = std::upper_bound(keyframes.begin(), keyframes.end(), sample_pos, [](uint64_t pos, const BeeNukedKeyframe &frame)
+		{
+		    return (pos < frame.sample_pos);
+		});
+
+		if (iter == keyframes.begin())
+		{
+		    return NULL;
+		}
+
+		return &*(iter - 1);
+	    }
+
+	    // Restores the chip to the last keyframe at or before 'sample_pos',
+	    // returning that keyframe (or NULL, leaving the chip untouched, if there isn't one)
+	    template<typename Chip>
+	    const BeeNukedKeyframe *seek(Chip &chip, uint64_t sample_pos)
+	    {
+		const BeeNukedKeyframe *frame = find(sample_pos);
+
+		if (frame == NULL)
+		{
+		    return NULL;
+		}
+
+		auto state_begin = (states.begin() + frame->state_offset);
+		state_buffer.assign(state_begin, (state_begin + frame->state_size));
+		chip.load_state(state_buffer);
+		return frame;
+	    }
+
+	    size_t get_num_keyframes() const
+	    {
+		return keyframes.size();
+	    }
+
+	    // Total size of the saved states, in bytes
+	    size_t get_state_bytes() const
+	    {
+		return states.size();
+	    }
+
+	    // Saves the whole index into the buffer (replacing its contents)
+	    void save(std::vector<uint8_t> &buffer)
+	    {
+		BeeNukedStateWriter state(buffer, beenuked_keyframe_index_id, index_version);
+		serialize(state);
+		state.finish();
+	    }
+
+	    // Loads a previously saved index,
+	    // throwing std::out_of_range (and leaving the index empty) if it isn't valid
+	    void load(const std::vector<uint8_t> &buffer)
+	    {
+		try
+		{
+		    BeeNukedStateReader state(buffer, beenuked_keyframe_index_id, index_version);
+		    serialize(state);
+		    state.finish();
+		    validate();
+		}
+		catch (std::out_of_range&)
+		{
+		    clear();
+		    throw;
+		}
+	    }
+
+	private:
+	    static constexpr uint32_t index_version = 2;
+
+	    uint64_t keyframe_interval = 1;
+	    std::vector<BeeNukedKeyframe> keyframes;
+	    std::vector<uint8_t> states;
+	    std::vector<uint8_t> state_buffer;
+
+	    template<typename Archive>
+	    void serialize(Archive &state)
+	    {
+		state.value(keyframe_interval);
+		state.value(keyframes);
+		state.value(states);
+	    }
+
+	    // Checks that the keyframes are in order, and that their states are in the buffer
+	    void validate()
+	    {
+		if (keyframe_interval == 0)
+		{
+		    throw std::out_of_range("Invalid keyframe interval");
+		}
+
+		for (size_t i = 0; i < keyframes.size(); i++)
+		{
+		    auto &frame = keyframes[i];
+
+		    if ((i != 0) && (frame.sample_pos <= keyframes[(i - 1)].sample_pos))
+		    {
+			throw std::out_of_range("Invalid keyframe index");
+		    }
+
+		    if ((frame.state_offset > states.size()) || (frame.state_size > (states.size() - frame.state_offset)))
+		    {
+			throw std::out_of_range("Invalid keyframe index");
+		    }
+		}
+	    }
+    };
+};
+
+#endif // BEENUKED_KEYFRAMES_H
\ No newline at end of file
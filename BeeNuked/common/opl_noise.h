@@ -0,0 +1,170 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_OPL_NOISE_H
+#define BEENUKED_OPL_NOISE_H
+
+#include <array>
+#include <cstdint>
+
+// Rhythm mode noise generator, shared by the OPL family cores (currently the YM3526, YMF262, YM2413 and YM2413xN)
+//
+// The cores keep the 23-bit noise LFSR as part of their own state, along with the number of steps
+// it's behind by. The noise is only ever read in rhythm mode, so outside of it the cores just count
+// the steps with skip() (modulo the LFSR's period of 2^23 - 1), and catch up in one go with sync()
+// the next time the noise output is actually needed.
+//
+// Advancing the LFSR is a linear operation, so the bit matrices for 2^k steps (used by sync()),
+// as well as byte-sliced lookup tables for the fixed per-sample steps, are precomputed.
+// The tables are built the first time they're used, and shared by every chip.
+
+namespace beenuked
+{
+    class BeeNukedOPLNoise
+    {
+	public:
+	    // Counts 'steps' more steps that the LFSR is behind by
+	    static void skip(uint32_t &cycles, uint32_t steps)
+	    {
+		cycles += steps;
+
+		if (cycles >= 0x7FFFFF)
+		{
+		    cycles -= 0x7FFFFF;
+		}
+	    }
+
+	    // Returns the LFSR advanced by the steps it's behind by (and clears the count)
+	    static uint32_t sync(uint32_t lfsr, uint32_t &cycles)
+	    {
+		auto &jump_pow = get_tables().jump_pow;
+
+		for (int k = 0; cycles != 0; k++)
+		{
+		    if ((cycles & 1) != 0)
+		    {
+			lfsr = apply_matrix(jump_pow[k], lfsr);
+		    }
+
+		    cycles >>= 1;
+		}
+
+		return lfsr;
+	    }
+
+	    // Returns the LFSR advanced by the 14 steps at the start of each rhythm mode sample
+	    static uint32_t jump14(uint32_t lfsr)
+	    {
+		return jump(get_tables().jump14, lfsr);
+	    }
+
+	    // Returns the LFSR advanced by the 4 steps at the end of each rhythm mode sample
+	    static uint32_t jump4(uint32_t lfsr)
+	    {
+		return jump(get_tables().jump4, lfsr);
+	    }
+
+	private:
+	    typedef std::array<std::array<uint32_t, 256>, 3> jump_table;
+
+	    struct noise_tables
+	    {
+		std::array<std::array<uint32_t, 23>, 23> jump_pow;
+		jump_table jump14;
+		jump_table jump4;
+	    };
+
+	    static const noise_tables &get_tables()
+	    {
+		static const noise_tables tables = init_tables();
+		return tables;
+	    }
+
+	    static noise_tables init_tables()
+	    {
+		noise_tables tables;
+
+		for (int bit = 0; bit < 23; bit++)
+		{
+		    tables.jump_pow[0][bit] = step(1 << bit);
+		}
+
+		for (int k = 1; k < 23; k++)
+		{
+		    for (int bit = 0; bit < 23; bit++)
+		    {
+			tables.jump_pow[k][bit] = apply_matrix(tables.jump_pow[k - 1], tables.jump_pow[k - 1][bit]);
+		    }
+		}
+
+		init_jump(tables.jump14, 14);
+		init_jump(tables.jump4, 4);
+		return tables;
+	    }
+
+	    static uint32_t step(uint32_t lfsr)
+	    {
+		if ((lfsr & 1) != 0)
+		{
+		    lfsr ^= 0x800200;
+		}
+
+		return (lfsr >> 1);
+	    }
+
+	    static uint32_t apply_matrix(const std::array<uint32_t, 23> &matrix, uint32_t lfsr)
+	    {
+		uint32_t result = 0;
+
+		for (int bit = 0; bit < 23; bit++)
+		{
+		    if (((lfsr >> bit) & 1) != 0)
+		    {
+			result ^= matrix[bit];
+		    }
+		}
+
+		return result;
+	    }
+
+	    static void init_jump(jump_table &table, int cycles)
+	    {
+		for (int index = 0; index < 3; index++)
+		{
+		    for (uint32_t value = 0; value < 256; value++)
+		    {
+			uint32_t lfsr = ((value << (index * 8)) & 0x7FFFFF);
+
+			for (int i = 0; i < cycles; i++)
+			{
+			    lfsr = step(lfsr);
+			}
+
+			table[index][value] = lfsr;
+		    }
+		}
+	    }
+
+	    static uint32_t jump(const jump_table &table, uint32_t lfsr)
+	    {
+		return (table[0][(lfsr & 0xFF)] ^ table[1][((lfsr >> 8) & 0xFF)] ^ table[2][((lfsr >> 16) & 0xFF)]);
+	    }
+    };
+};
+
+#endif // BEENUKED_OPL_NOISE_H
\ No newline at end of file
@@ -0,0 +1,242 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_PROFILE_H
+#define BEENUKED_PROFILE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Per-stage timing builds on the block timing below
+#if defined(BEENUKED_ENABLE_PROFILE_STAGES) && !defined(BEENUKED_ENABLE_PROFILE)
+#define BEENUKED_ENABLE_PROFILE
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BEENUKED_PROFILE_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BEENUKED_PROFILE_RDTSC
+#else
+#include <chrono>
+#endif
+#endif
+
+// Hot path profiling counters for the BeeNuked cores
+//
+// When the library is built with BEENUKED_ENABLE_PROFILE (the CMake option of the same name),
+// every core times each call to render(), and counts register writes and key-ons.
+// The clock (rdtsc on x86, with ticks being TSC cycles, or steady_clock nanoseconds elsewhere)
+// is only read at the start and end of each block, so this is cheap enough for canary builds.
+// Samples clocked one at a time through clockchip() aren't timed.
+//
+// Building with BEENUKED_ENABLE_PROFILE_STAGES as well also breaks the time down into
+// each stage of the core's pipeline. Stages are timed as laps: the core starts the clock
+// once per sample (or per block), and each BEENUKED_PROFILE_LAP() charges the time since
+// the previous lap to its stage. Only one start in every profile_sample_interval actually
+// reads the clock, and every other lap just counts the stage call, with each stage's ticks
+// then scaled up from its timed calls to estimate the total. As this still costs a counter
+// and a branch for every stage of every sample, it's meant for finding hot spots, not for canary builds.
+// Otherwise, BEENUKED_PROFILE_START() and BEENUKED_PROFILE_LAP() compile to nothing.
+//
+// The stats are plain counters, updated by the thread that clocks the chip,
+// so they should be read (i.e. once per rendered block) from that same thread.
+
+namespace beenuked
+{
+    enum BeeNukedProfileStage : int
+    {
+	ProfileTimers = 0,
+	ProfileLFO = 1,
+	ProfileSSGEG = 2,
+	ProfileEnvelope = 3,
+	ProfilePhase = 4,
+	ProfileOutput = 5, // Operator and channel output
+	ProfileRhythm = 6, // Rhythm and noise generators
+	ProfileADPCM = 7, // ADPCM and delta-T decoding (the YMF271's PCM slots count as output)
+	ProfileSSG = 8, // SSG resampling
+	ProfileMix = 9,
+	ProfileStageCount = 10
+    };
+
+    inline const char *get_profile_stage_name(BeeNukedProfileStage stage)
+    {
+	switch (stage)
+	{
+	    case ProfileTimers: return "Timers"; break;
+	    case ProfileLFO: return "LFO"; break;
+	    case ProfileSSGEG: return "SSG-EG"; break;
+	    case ProfileEnvelope: return "Envelope"; break;
+	    case ProfilePhase: return "Phase"; break;
+	    case ProfileOutput: return "Output"; break;
+	    case ProfileRhythm: return "Rhythm/noise"; break;
+	    case ProfileADPCM: return "ADPCM"; break;
+	    case ProfileSSG: return "SSG resample"; break;
+	    case ProfileMix: return "Mixing"; break;
+	    default: return "Unknown"; break;
+	}
+    }
+
+    struct BeeNukedProfileStats
+    {
+	// Calls to render(), the samples they rendered, and the ticks they took
+	uint64_t blocks = 0;
+	uint64_t block_samples = 0;
+	uint64_t block_ticks = 0;
+
+	// Only with BEENUKED_ENABLE_PROFILE_STAGES,
+	// with the ticks estimated from the timed samples (see above)
+	std::array<uint64_t, ProfileStageCount> stage_calls = {};
+	std::array<uint64_t, ProfileStageCount> stage_ticks = {};
+
+	// Indexed by register address, with bit 8 set for the second register bank
+	// (the YMF271 uses bits 8-10 for its 4 FM banks, PCM and timer registers)
+	std::array<uint64_t, 0x800> reg_writes = {};
+
+	// Number of operators (or YMF271 slots) and ADPCM channels keyed on
+	uint64_t key_ons = 0;
+    };
+
+#if defined(BEENUKED_ENABLE_PROFILE)
+
+    class BeeNukedProfiler
+    {
+	public:
+	    // Cores start the clock more than once per sample (i.e. once for the chip
+	    // and once for the mixer), so this is kept prime to time each of them in turn
+	    static constexpr uint32_t profile_sample_interval = 17;
+
+	    static uint64_t get_ticks()
+	    {
+#if defined(BEENUKED_PROFILE_RDTSC)
+		return __rdtsc();
+#else
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+#endif
+	    }
+
+	    void begin_block()
+	    {
+		block_start = get_ticks();
+	    }
+
+	    void end_block(size_t num_samples)
+	    {
+		stats.blocks += 1;
+		stats.block_samples += num_samples;
+		stats.block_ticks += (get_ticks() - block_start);
+	    }
+
+	    void start()
+	    {
+		is_timing = (--start_countdown == 0);
+
+		if (is_timing)
+		{
+		    start_countdown = profile_sample_interval;
+		    lap_ticks = get_ticks();
+		}
+	    }
+
+	    void lap(BeeNukedProfileStage stage)
+	    {
+		stats.stage_calls[stage] += 1;
+
+		if (is_timing)
+		{
+		    uint64_t ticks = get_ticks();
+		    timed_calls[stage] += 1;
+		    timed_ticks[stage] += (ticks - lap_ticks);
+		    lap_ticks = ticks;
+		}
+	    }
+
+	    void count_write(uint16_t reg)
+	    {
+		stats.reg_writes[(reg & 0x7FF)] += 1;
+	    }
+
+	    void count_key_on()
+	    {
+		stats.key_ons += 1;
+	    }
+
+	    const BeeNukedProfileStats &get_stats() const
+	    {
+		for (int i = 0; i < ProfileStageCount; i++)
+		{
+		    if (timed_calls[i] != 0)
+		    {
+			double calls_per_timed = (double(stats.stage_calls[i]) / double(timed_calls[i]));
+			stats.stage_ticks[i] = uint64_t(double(timed_ticks[i]) * calls_per_timed);
+		    }
+		}
+
+		return stats;
+	    }
+
+	    void reset()
+	    {
+		stats = BeeNukedProfileStats();
+		timed_calls.fill(0);
+		timed_ticks.fill(0);
+	    }
+
+	private:
+	    mutable BeeNukedProfileStats stats;
+	    std::array<uint64_t, ProfileStageCount> timed_calls = {};
+	    std::array<uint64_t, ProfileStageCount> timed_ticks = {};
+	    uint64_t block_start = 0;
+	    uint64_t lap_ticks = 0;
+	    uint32_t start_countdown = 1;
+	    bool is_timing = false;
+    };
+
+    // Expects the core to have a BeeNukedProfiler member named profiler
+    #define BEENUKED_PROFILE_BLOCK_BEGIN() profiler.begin_block()
+    #define BEENUKED_PROFILE_BLOCK_END(num_samples) profiler.end_block((num_samples))
+    #define BEENUKED_PROFILE_WRITE(reg) profiler.count_write((reg))
+    #define BEENUKED_PROFILE_KEY_ON() profiler.count_key_on()
+
+#else
+
+    #define BEENUKED_PROFILE_BLOCK_BEGIN() ((void)0)
+    #define BEENUKED_PROFILE_BLOCK_END(num_samples) ((void)(num_samples))
+    #define BEENUKED_PROFILE_WRITE(reg) ((void)(reg))
+    #define BEENUKED_PROFILE_KEY_ON() ((void)0)
+
+#endif
+
+#if defined(BEENUKED_ENABLE_PROFILE_STAGES)
+
+    #define BEENUKED_PROFILE_START() profiler.start()
+    #define BEENUKED_PROFILE_LAP(stage) profiler.lap((stage))
+
+#else
+
+    #define BEENUKED_PROFILE_START() ((void)0)
+    #define BEENUKED_PROFILE_LAP(stage) ((void)(stage))
+
+#endif
+};
+
+#endif // BEENUKED_PROFILE_H
\ No newline at end of file
@@ -0,0 +1,299 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_RESAMPLER_H
+#define BEENUKED_RESAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Optional output stage that converts a core's native sample rate
+// (i.e. clock / 144 for the YM2612, or clock / 72 for the YM3526) to any host rate
+//
+// This is a windowed-sinc (Kaiser window) resampler, with a table of precomputed
+// filter phases, which are linearly interpolated between for the exact output position.
+// The input and output are interleaved frames of any number of channels,
+// laid out the same way as each core's get_samples() (so 4 channels for the YMF271,
+// or SSG + FM left + FM right for the YM2608), and the input is fed
+// straight from each core's block render() function.
+//
+// The inner loops are plain float loops with 8 independent accumulators,
+// which the compiler can vectorize without any intrinsics.
+
+namespace beenuked
+{
+    enum BeeNukedResamplerQuality : int
+    {
+	ResampleFast = 0, // Shortest filter (lowest latency and CPU usage)
+	ResampleBalanced = 1,
+	ResampleBest = 2 // Longest filter, with the flattest passband
+    };
+
+    class BeeNukedResampler
+    {
+	public:
+	    void init(uint32_t in_rate, uint32_t out_rate, int num_channels, BeeNukedResamplerQuality quality = ResampleBalanced)
+	    {
+		if ((in_rate == 0) || (out_rate == 0) || (num_channels <= 0))
+		{
+		    throw std::out_of_range("Invalid resampler configuration");
+		}
+
+		input_rate = in_rate;
+		output_rate = out_rate;
+		channel_count = num_channels;
+
+		step_int = (input_rate / output_rate);
+		step_rem = (input_rate % output_rate);
+
+		init_filter(quality);
+		reset();
+	    }
+
+	    // Clears all buffered input (the output restarts from silence)
+	    void reset()
+	    {
+		// Prefilling with silence centers the first output on the first input sample
+		history.assign(channel_count, std::vector<float>((half_width - 1), 0.0f));
+		pos_int = 0;
+		pos_frac = 0;
+	    }
+
+	    // Delay of the output, in input samples
+	    int get_latency() const
+	    {
+		return half_width;
+	    }
+
+	    // Number of input frames that still need to be processed
+	    // before 'out_frames' more output frames can be produced
+	    size_t get_input_needed(size_t out_frames) const
+	    {
+		if (out_frames == 0)
+		{
+		    return 0;
+		}
+
+		uint64_t last = (out_frames - 1);
+		uint64_t frac_total = (pos_frac + (last * step_rem));
+		uint64_t last_pos = (pos_int + (last * step_int) + (frac_total / output_rate));
+		uint64_t total_needed = (last_pos + num_taps);
+		uint64_t buffered = history[0].size();
+		return (total_needed > buffered) ? size_t(total_needed - buffered) : 0;
+	    }
+
+	    // Buffers 'in_frames' input frames, then appends as many output frames as possible
+	    // (up to 'max_frames') to 'output'
+	    size_t process(const int32_t *input, size_t in_frames, std::vector<int32_t> &output, size_t max_frames = SIZE_MAX)
+	    {
+		for (int ch = 0; ch < channel_count; ch++)
+		{
+		    auto &buffer = history[ch];
+		    size_t start = buffer.size();
+		    buffer.resize((start + in_frames));
+
+		    for (size_t i = 0; i < in_frames; i++)
+		    {
+			buffer[(start + i)] = float(input[((i * channel_count) + ch)]);
+		    }
+		}
+
+		size_t available = history[0].size();
+		size_t produced = 0;
+
+		while ((produced < max_frames) && ((pos_int + num_taps) <= available))
+		{
+		    interpolate_taps();
+
+		    for (int ch = 0; ch < channel_count; ch++)
+		    {
+			float sample = dot_product(frame_taps.data(), &history[ch][pos_int], num_taps);
+			output.push_back(int32_t(std::lrint(sample)));
+		    }
+
+		    pos_int += step_int;
+		    pos_frac += step_rem;
+
+		    if (pos_frac >= output_rate)
+		    {
+			pos_frac -= output_rate;
+			pos_int += 1;
+		    }
+
+		    produced += 1;
+		}
+
+		// Drop the input that no future output needs
+		size_t consumed = std::min(pos_int, available);
+
+		for (auto &buffer : history)
+		{
+		    buffer.erase(buffer.begin(), (buffer.begin() + consumed));
+		}
+
+		pos_int -= consumed;
+		return produced;
+	    }
+
+	    // Renders exactly 'out_frames' output frames from a core,
+	    // appending them to 'buffer'
+	    template<typename Chip>
+	    void render(Chip &chip, std::vector<int32_t> &buffer, size_t out_frames)
+	    {
+		size_t in_frames = get_input_needed(out_frames);
+		input_block.clear();
+		chip.render(input_block, in_frames);
+		process(input_block.data(), in_frames, buffer, out_frames);
+	    }
+
+	private:
+	    uint32_t input_rate = 1;
+	    uint32_t output_rate = 1;
+	    int channel_count = 1;
+
+	    uint32_t step_int = 1;
+	    uint32_t step_rem = 0;
+
+	    // Position of the next output frame, in input frames from the start of the history
+	    // (the fractional part is in units of 1 / output_rate)
+	    size_t pos_int = 0;
+	    uint32_t pos_frac = 0;
+
+	    int half_width = 1;
+	    size_t num_taps = 8;
+	    int num_phases = 1;
+
+	    // (num_phases + 1) rows of num_taps taps each
+	    std::vector<float> filter_taps;
+	    std::vector<float> frame_taps;
+
+	    std::vector<std::vector<float>> history;
+	    std::vector<int32_t> input_block;
+
+	    static double bessel_i0(double x)
+	    {
+		double sum = 1.0;
+		double term = 1.0;
+
+		for (int k = 1; k < 32; k++)
+		{
+		    term *= ((x / (2.0 * k)) * (x / (2.0 * k)));
+		    sum += term;
+		}
+
+		return sum;
+	    }
+
+	    void init_filter(BeeNukedResamplerQuality quality)
+	    {
+		const double pi = 3.14159265358979323846;
+
+		int zero_crossings = 16;
+		double passband = 0.91;
+		double beta = 8.0;
+
+		switch (quality)
+		{
+		    case ResampleFast: zero_crossings = 8; passband = 0.85; beta = 6.0; num_phases = 64; break;
+		    case ResampleBalanced: zero_crossings = 16; passband = 0.91; beta = 8.0; num_phases = 256; break;
+		    case ResampleBest: zero_crossings = 32; passband = 0.95; beta = 10.0; num_phases = 1024; break;
+		    default: throw std::out_of_range("Invalid resampler quality"); break;
+		}
+
+		// Cutoff in cycles per input sample, below the lower of the two Nyquist frequencies
+		double ratio = (double(output_rate) / double(input_rate));
+		double cutoff = (0.5 * passband * std::min(1.0, ratio));
+
+		half_width = int(std::ceil(zero_crossings / (2.0 * cutoff)));
+		num_taps = (((2 * half_width) + 7) & ~7);
+
+		filter_taps.assign(((num_phases + 1) * num_taps), 0.0f);
+		frame_taps.assign(num_taps, 0.0f);
+
+		double window_scale = bessel_i0(beta);
+
+		for (int phase = 0; phase <= num_phases; phase++)
+		{
+		    double frac = (double(phase) / num_phases);
+		    std::vector<double> coeffs(num_taps, 0.0);
+		    double total = 0.0;
+
+		    for (size_t tap = 0; tap < num_taps; tap++)
+		    {
+			double x = (double(tap) - (half_width - 1) - frac);
+
+			if (std::fabs(x) >= half_width)
+			{
+			    continue;
+			}
+
+			double sinc_x = (2.0 * cutoff * x);
+			double sinc = (sinc_x == 0.0) ? 1.0 : (std::sin(pi * sinc_x) / (pi * sinc_x));
+			double u = (x / half_width);
+			double window = (bessel_i0((beta * std::sqrt((1.0 - (u * u))))) / window_scale);
+			coeffs[tap] = (sinc * window);
+			total += coeffs[tap];
+		    }
+
+		    // Every phase is normalized to unity gain
+		    for (size_t tap = 0; tap < num_taps; tap++)
+		    {
+			filter_taps[((phase * num_taps) + tap)] = float(coeffs[tap] / total);
+		    }
+		}
+	    }
+
+	    // Interpolates the filter taps for the current output position
+	    void interpolate_taps()
+	    {
+		uint64_t phase_pos = (uint64_t(pos_frac) * num_phases);
+		size_t phase = size_t(phase_pos / output_rate);
+		float blend = (float(phase_pos % output_rate) / float(output_rate));
+
+		const float *taps0 = &filter_taps[(phase * num_taps)];
+		const float *taps1 = (taps0 + num_taps);
+
+		for (size_t tap = 0; tap < num_taps; tap++)
+		{
+		    frame_taps[tap] = (taps0[tap] + ((taps1[tap] - taps0[tap]) * blend));
+		}
+	    }
+
+	    // 'count' must be a multiple of 8
+	    static float dot_product(const float *taps, const float *samples, size_t count)
+	    {
+		float sums[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+
+		for (size_t i = 0; i < count; i += 8)
+		{
+		    for (int lane = 0; lane < 8; lane++)
+		    {
+			sums[lane] += (taps[(i + lane)] * samples[(i + lane)]);
+		    }
+		}
+
+		return (((sums[0] + sums[4]) + (sums[1] + sums[5])) + ((sums[2] + sums[6]) + (sums[3] + sums[7])));
+	    }
+    };
+};
+
+#endif // BEENUKED_RESAMPLER_H
\ No newline at end of file
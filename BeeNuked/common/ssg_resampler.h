@@ -0,0 +1,282 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_SSG_RESAMPLER_H
+#define BEENUKED_SSG_RESAMPLER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// SSG to FM rate converter, shared by the OPN family cores (currently the YM2203, YM2608 and YM2610)
+//
+// For a ratio of out_samples:src_samples, every output sample spans src_samples "units",
+// and every SSG sample spans out_samples units. By default, each output is the sum of
+// the SSG samples it overlaps, each weighted by the number of units it overlaps
+// (i.e. a box filter), which is exactly what the chips' own hard-coded resamplers did.
+// The sums are scaled by get_divisor(), so the caller does the final division
+// (each core rounds in its own way).
+//
+// Optionally, a band-limited mode instead runs the SSG samples through a
+// windowed-sinc polyphase filter, with one set of taps per output phase.
+// This removes most of the aliasing of the box filter, at the cost of a few samples of latency.
+
+namespace beenuked
+{
+    class BeeNukedSSGResampler
+    {
+	public:
+	    typedef std::array<int32_t, 3> ssg_frame;
+
+	    // 'phase' is the number of units of the current SSG sample that haven't been output yet
+	    // (0 means that the next output starts on a new SSG sample)
+	    void configure(int out_samples, int src_samples, int phase = 0)
+	    {
+		out_units = out_samples;
+		src_units = src_samples;
+		remaining = phase;
+
+		if (is_band_limited)
+		{
+		    init_filter();
+		}
+	    }
+
+	    void set_band_limited(bool val)
+	    {
+		is_band_limited = val;
+
+		if (is_band_limited)
+		{
+		    init_filter();
+		}
+	    }
+
+	    int get_divisor() const
+	    {
+		return src_units;
+	    }
+
+	    // Saves or loads the resampler's position (see state.h).
+	    // Band-limited mode is a host setting, so its filter is rebuilt here
+	    // if the loaded ratio doesn't match the current one.
+	    template<typename Archive>
+	    void serialize_state(Archive &state)
+	    {
+		int prev_out_units = out_units;
+		int prev_src_units = src_units;
+
+		// The cores only use ratios of up to 4:3 (YM2203 and YM2608) and 2:9 (YM2610)
+		state.value(out_units, 1, 4);
+		state.value(src_units, 1, 9);
+		state.value(remaining, 0, (out_units - 1));
+		state.value(last_sample);
+		state.value(history_pos);
+		state.value(history);
+
+		if (!state.is_loading() || !is_band_limited)
+		{
+		    return;
+		}
+
+		std::vector<ssg_frame> saved_history;
+		saved_history.swap(history);
+		size_t saved_pos = history_pos;
+
+		if ((out_units != prev_out_units) || (src_units != prev_src_units) || filter_taps.empty())
+		{
+		    init_filter();
+		}
+		else
+		{
+		    history.assign((history_mask + 1), last_sample);
+		    history_pos = 0;
+		}
+
+		if (saved_history.size() == history.size())
+		{
+		    history.swap(saved_history);
+		    history_pos = saved_pos;
+		}
+	    }
+
+	    // Produces num_samples output sums, calling clock_ssg(ssg_frame &sample)
+	    // every time a new SSG sample is needed
+	    // (if the SSG isn't available, clock_ssg can leave the previous sample as it is)
+	    template<typename Source>
+	    void resample(ssg_frame *output, size_t num_samples, Source &&clock_ssg)
+	    {
+		if (is_band_limited)
+		{
+		    resample_filtered(output, num_samples, clock_ssg);
+		    return;
+		}
+
+		for (size_t i = 0; i < num_samples; i++)
+		{
+		    // Whatever is left of the current SSG sample comes first
+		    int weight = std::min(remaining, src_units);
+		    int needed = (src_units - weight);
+		    remaining -= weight;
+
+		    ssg_frame sum;
+
+		    for (int ch = 0; ch < 3; ch++)
+		    {
+			sum[ch] = (last_sample[ch] * weight);
+		    }
+
+		    while (needed > 0)
+		    {
+			clock_ssg(last_sample);
+			weight = std::min(out_units, needed);
+			needed -= weight;
+			remaining = (out_units - weight);
+
+			for (int ch = 0; ch < 3; ch++)
+			{
+			    sum[ch] += (last_sample[ch] * weight);
+			}
+		    }
+
+		    output[i] = sum;
+		}
+	    }
+
+	private:
+	    int out_units = 1;
+	    int src_units = 1;
+	    int remaining = 0;
+	    ssg_frame last_sample = {0, 0, 0};
+
+	    bool is_band_limited = false;
+
+	    static constexpr int filter_shift = 14;
+
+	    // Taps for each value of 'remaining' after the last SSG sample of an output is fetched,
+	    // newest SSG sample first
+	    std::vector<std::vector<int32_t>> filter_taps;
+	    std::vector<ssg_frame> history;
+	    size_t history_pos = 0;
+	    size_t history_mask = 0;
+
+	    void init_filter()
+	    {
+		const double pi = 3.14159265358979323846;
+
+		// Cutoff (in cycles per SSG sample) at just below the lower of the two Nyquist frequencies,
+		// with 8 zero crossings on each side of the kernel
+		double ratio = (double(out_units) / double(src_units));
+		double cutoff = (0.45 * std::min(1.0, ratio));
+		double half_width = (8.0 / (2.0 * cutoff));
+
+		// The kernel is centered 'delay' SSG samples behind the newest one,
+		// so that it never needs samples that haven't been fetched yet
+		double center_offset = (double(src_units) / (2.0 * out_units));
+		int delay = int(std::ceil(half_width + 0.5));
+		int num_taps = (delay + int(std::ceil(half_width + 1.5 + center_offset)));
+
+		filter_taps.assign(out_units, std::vector<int32_t>(num_taps, 0));
+
+		for (int phase = 0; phase < out_units; phase++)
+		{
+		    std::vector<double> coeffs(num_taps, 0.0);
+		    double total = 0.0;
+
+		    for (int tap = 0; tap < num_taps; tap++)
+		    {
+			double x = (delay - tap - 0.5 + ((phase + (src_units / 2.0)) / out_units));
+
+			if (std::fabs(x) >= half_width)
+			{
+			    continue;
+			}
+
+			double sinc_x = (2.0 * cutoff * x);
+			double sinc = (sinc_x == 0.0) ? 1.0 : (std::sin(pi * sinc_x) / (pi * sinc_x));
+			double u = (x / half_width);
+			double window = (0.42 + (0.5 * std::cos(pi * u)) + (0.08 * std::cos(2.0 * pi * u)));
+			coeffs[tap] = (sinc * window);
+			total += coeffs[tap];
+		    }
+
+		    // Every phase is normalized to unity gain
+		    for (int tap = 0; tap < num_taps; tap++)
+		    {
+			filter_taps[phase][tap] = int32_t(std::lround((coeffs[tap] / total) * (1 << filter_shift)));
+		    }
+		}
+
+		size_t history_size = 1;
+
+		while (history_size < size_t(num_taps))
+		{
+		    history_size <<= 1;
+		}
+
+		history.assign(history_size, last_sample);
+		history_mask = (history_size - 1);
+		history_pos = 0;
+	    }
+
+	    template<typename Source>
+	    void resample_filtered(ssg_frame *output, size_t num_samples, Source &clock_ssg)
+	    {
+		for (size_t i = 0; i < num_samples; i++)
+		{
+		    int needed = (src_units - std::min(remaining, src_units));
+		    remaining -= std::min(remaining, src_units);
+
+		    while (needed > 0)
+		    {
+			clock_ssg(last_sample);
+			history_pos = ((history_pos + 1) & history_mask);
+			history[history_pos] = last_sample;
+
+			int weight = std::min(out_units, needed);
+			needed -= weight;
+			remaining = (out_units - weight);
+		    }
+
+		    const auto &taps = filter_taps[remaining];
+		    std::array<int64_t, 3> sum = {0, 0, 0};
+
+		    for (size_t tap = 0; tap < taps.size(); tap++)
+		    {
+			const auto &sample = history[((history_pos - tap) & history_mask)];
+
+			for (int ch = 0; ch < 3; ch++)
+			{
+			    sum[ch] += (int64_t(taps[tap]) * sample[ch]);
+			}
+		    }
+
+		    for (int ch = 0; ch < 3; ch++)
+		    {
+			int32_t filtered = int32_t((sum[ch] + (1 << (filter_shift - 1))) >> filter_shift);
+			output[i][ch] = (filtered * src_units);
+		    }
+		}
+	    }
+    };
+};
+
+#endif // BEENUKED_SSG_RESAMPLER_H
\ No newline at end of file
@@ -0,0 +1,376 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_STATE_H
+#define BEENUKED_STATE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Save state support for the BeeNuked cores
+//
+// Every core has save_state(buffer) and load_state(buffer) functions, which
+// snapshot and restore all of its emulation state as a single blob.
+// The blob starts with a small header (magic, chip ID, state version and size),
+// followed by the core's state, one field at a time, in the order they're listed
+// in the core's serialize_state() function (and in the serialize_state() functions
+// of the structs it saves). That same function is used for both saving and loading,
+// so the two can't get out of sync. As only the fields themselves are stored
+// (never the padding between them), two cores in the same state save identical blobs.
+//
+// Bools are stored as a single 0 or 1 byte, and enums and anything used as an index
+// are saved with the value(val, min_val, max_val) overload, so a corrupt blob
+// is caught (with std::out_of_range) instead of being loaded into the core.
+// As those checks happen as the state is read, a core that failed to load
+// is left partly loaded, and should be reset (or have a good state loaded) before it's used.
+//
+// Lookup tables, sample ROMs and host settings (i.e. DAC bypass or interpolation modes)
+// aren't part of the state, so a state should only be loaded into a core
+// with the same ROMs attached. As the values are stored in the host's byte order,
+// states are only meant to be loaded by the same build of the library that saved them
+// (i.e. for rollback or seeking), not stored long-term.
+//
+// Saving into the same buffer every frame reuses its allocation,
+// so after the first save, taking a snapshot is just a few kilobytes of copying.
+
+namespace beenuked
+{
+    enum BeeNukedStateChip : uint32_t
+    {
+	StateYM2612 = 0x2612,
+	StateYM2151 = 0x2151,
+	StateYM2203 = 0x2203,
+	StateYM2608 = 0x2608,
+	StateYM2610 = 0x2610,
+	StateYM2413 = 0x2413,
+	StateYM3526 = 0x3526,
+	StateYMF262 = 0xF262,
+	StateYMF271 = 0xF271
+    };
+
+    struct BeeNukedStateHeader
+    {
+	uint32_t magic = 0;
+	uint32_t chip_id = 0;
+	uint32_t version = 0;
+	uint32_t size = 0; // Size of the state after the header, in bytes
+
+	template<typename Archive>
+	void serialize_state(Archive &state)
+	{
+	    state.value(magic);
+	    state.value(chip_id);
+	    state.value(version);
+	    state.value(size);
+	}
+    };
+
+    // 'BNKS'
+    static constexpr uint32_t beenuked_state_magic = 0x534B4E42;
+
+    class BeeNukedStateWriter
+    {
+	public:
+	    BeeNukedStateWriter(std::vector<uint8_t> &buffer, uint32_t chip_id, uint32_t version) : data(buffer)
+	    {
+		BeeNukedStateHeader header;
+		header.magic = beenuked_state_magic;
+		header.chip_id = chip_id;
+		header.version = version;
+
+		data.clear();
+		value(header);
+	    }
+
+	    bool is_loading() const
+	    {
+		return false;
+	    }
+
+	    // Structs are saved through their own serialize_state() function
+	    template<typename T>
+	    void value(T &val)
+	    {
+		static_assert(!std::is_enum<T>::value, "Enums must be saved with a range");
+
+		if constexpr (std::is_same<T, bool>::value)
+		{
+		    uint8_t flag = val ? 1 : 0;
+		    write_bytes(&flag, sizeof(flag));
+		}
+		else if constexpr (std::is_arithmetic<T>::value)
+		{
+		    write_bytes(&val, sizeof(T));
+		}
+		else
+		{
+		    val.serialize_state(*this);
+		}
+	    }
+
+	    // The range is only checked on load
+	    template<typename T>
+	    void value(T &val, typename std::common_type<T>::type, typename std::common_type<T>::type)
+	    {
+		write_bytes(&val, sizeof(T));
+	    }
+
+	    template<typename T, size_t N>
+	    void value(std::array<T, N> &arr)
+	    {
+		if constexpr (is_raw_value<T>())
+		{
+		    write_bytes(arr.data(), (N * sizeof(T)));
+		}
+		else
+		{
+		    for (auto &elem : arr)
+		    {
+			value(elem);
+		    }
+		}
+	    }
+
+	    template<typename T, size_t N>
+	    void value(std::array<T, N> &arr, typename std::common_type<T>::type, typename std::common_type<T>::type)
+	    {
+		write_bytes(arr.data(), (N * sizeof(T)));
+	    }
+
+	    template<typename T>
+	    void value(std::vector<T> &vec)
+	    {
+		uint32_t count = uint32_t(vec.size());
+		value(count);
+
+		if constexpr (is_raw_value<T>())
+		{
+		    write_bytes(vec.data(), (count * sizeof(T)));
+		}
+		else
+		{
+		    for (auto &elem : vec)
+		    {
+			value(elem);
+		    }
+		}
+	    }
+
+	    // Fills in the size of the state
+	    void finish()
+	    {
+		uint32_t size = uint32_t(data.size() - sizeof(BeeNukedStateHeader));
+		std::memcpy(&data[offsetof(BeeNukedStateHeader, size)], &size, sizeof(size));
+	    }
+
+	private:
+	    std::vector<uint8_t> &data;
+
+	    template<typename T>
+	    static constexpr bool is_raw_value()
+	    {
+		return (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value);
+	    }
+
+	    void write_bytes(const void *src, size_t size)
+	    {
+		if (size == 0)
+		{
+		    return;
+		}
+
+		size_t pos = data.size();
+		data.resize((pos + size));
+		std::memcpy(&data[pos], src, size);
+	    }
+    };
+
+    class BeeNukedStateReader
+    {
+	public:
+	    // Throws std::out_of_range (before any of the core's state is touched)
+	    // if the blob isn't a state of the expected chip and version
+	    BeeNukedStateReader(const std::vector<uint8_t> &buffer, uint32_t chip_id, uint32_t version) : data(buffer)
+	    {
+		BeeNukedStateHeader header;
+
+		if (data.size() < sizeof(header))
+		{
+		    throw std::out_of_range("Invalid save state");
+		}
+
+		value(header);
+
+		if ((header.magic != beenuked_state_magic) || (header.chip_id != chip_id))
+		{
+		    throw std::out_of_range("Invalid save state");
+		}
+
+		if (header.version != version)
+		{
+		    throw std::out_of_range("Unsupported save state version");
+		}
+
+		if (header.size != (data.size() - sizeof(header)))
+		{
+		    throw std::out_of_range("Invalid save state size");
+		}
+	    }
+
+	    bool is_loading() const
+	    {
+		return true;
+	    }
+
+	    template<typename T>
+	    void value(T &val)
+	    {
+		static_assert(!std::is_enum<T>::value, "Enums must be loaded with a range");
+
+		if constexpr (std::is_same<T, bool>::value)
+		{
+		    uint8_t flag = 0;
+		    read_bytes(&flag, sizeof(flag));
+
+		    if (flag > 1)
+		    {
+			throw std::out_of_range("Invalid save state value");
+		    }
+
+		    val = (flag != 0);
+		}
+		else if constexpr (std::is_arithmetic<T>::value)
+		{
+		    read_bytes(&val, sizeof(T));
+		}
+		else
+		{
+		    val.serialize_state(*this);
+		}
+	    }
+
+	    template<typename T>
+	    void value(T &val, typename std::common_type<T>::type min_val, typename std::common_type<T>::type max_val)
+	    {
+		static_assert((std::is_arithmetic<T>::value || std::is_enum<T>::value), "Only numbers and enums can be range checked");
+		T loaded;
+		read_bytes(&loaded, sizeof(T));
+
+		if ((loaded < min_val) || (loaded > max_val))
+		{
+		    throw std::out_of_range("Invalid save state value");
+		}
+
+		val = loaded;
+	    }
+
+	    template<typename T, size_t N>
+	    void value(std::array<T, N> &arr)
+	    {
+		if constexpr (is_raw_value<T>())
+		{
+		    read_bytes(arr.data(), (N * sizeof(T)));
+		}
+		else
+		{
+		    for (auto &elem : arr)
+		    {
+			value(elem);
+		    }
+		}
+	    }
+
+	    template<typename T, size_t N>
+	    void value(std::array<T, N> &arr, typename std::common_type<T>::type min_val, typename std::common_type<T>::type max_val)
+	    {
+		for (auto &elem : arr)
+		{
+		    value(elem, min_val, max_val);
+		}
+	    }
+
+	    template<typename T>
+	    void value(std::vector<T> &vec)
+	    {
+		uint32_t count = 0;
+		value(count);
+
+		// Every value takes up at least a byte
+		if (count > (data.size() - pos))
+		{
+		    throw std::out_of_range("Save state is truncated");
+		}
+
+		vec.resize(count);
+
+		if constexpr (is_raw_value<T>())
+		{
+		    read_bytes(vec.data(), (count * sizeof(T)));
+		}
+		else
+		{
+		    for (auto &elem : vec)
+		    {
+			value(elem);
+		    }
+		}
+	    }
+
+	    // Checks that the whole state was used
+	    void finish()
+	    {
+		if (pos != data.size())
+		{
+		    throw std::out_of_range("Invalid save state size");
+		}
+	    }
+
+	private:
+	    const std::vector<uint8_t> &data;
+	    size_t pos = 0;
+
+	    template<typename T>
+	    static constexpr bool is_raw_value()
+	    {
+		return (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value);
+	    }
+
+	    void read_bytes(void *dst, size_t size)
+	    {
+		if (size > (data.size() - pos))
+		{
+		    throw std::out_of_range("Save state is truncated");
+		}
+
+		if (size == 0)
+		{
+		    return;
+		}
+
+		std::memcpy(dst, &data[pos], size);
+		pos += size;
+	    }
+    };
+};
+
+#endif // BEENUKED_STATE_H
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_TRACE_H
+#define BEENUKED_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(BEENUKED_ENABLE_TRACE)
+#include <array>
+#include <atomic>
+#endif
+
+// Diagnostics hook for the BeeNuked cores
+//
+// Cores report unhandled register writes, unimplemented features and the like
+// through BEENUKED_TRACE(), which compiles to nothing unless the library is built
+// with BEENUKED_ENABLE_TRACE (the CMake option of the same name).
+//
+// When enabled, every core that reports events owns a BeeNukedTraceRing,
+// which it fills from the thread that clocks it, and which the host can drain
+// from any other (single) thread through get_trace_ring().
+// The core never blocks on the ring; when it is full, new events are dropped (and counted).
+
+namespace beenuked
+{
+    enum BeeNukedTraceType : uint8_t
+    {
+	// Write to a register that isn't emulated (reg = register, data = value written)
+	TraceUnhandledWrite = 0,
+	// Read from a register that isn't emulated (reg = register)
+	TraceUnhandledRead = 1,
+	// Chip feature that isn't emulated yet (reg and data are chip-specific)
+	TraceUnimplemented = 2,
+	// Chip state that shouldn't be reachable (reg and data are chip-specific)
+	TraceInvalidState = 3
+    };
+
+    struct BeeNukedTraceEvent
+    {
+	BeeNukedTraceType type = TraceUnhandledWrite;
+	uint16_t reg = 0;
+	uint32_t data = 0;
+    };
+
+#if defined(BEENUKED_ENABLE_TRACE)
+
+    // Lock-free single-producer, single-consumer ring of trace events
+    class BeeNukedTraceRing
+    {
+	public:
+	    // Must be a power of two
+	    static constexpr size_t capacity = 1024;
+
+	    // Called by the core only
+	    void push(BeeNukedTraceType type, uint16_t reg, uint32_t data)
+	    {
+		size_t head = write_pos.load(std::memory_order_relaxed);
+
+		if ((head - read_pos.load(std::memory_order_acquire)) == capacity)
+		{
+		    dropped_events.fetch_add(1, std::memory_order_relaxed);
+		    return;
+		}
+
+		auto &event = events[(head & (capacity - 1))];
+		event.type = type;
+		event.reg = reg;
+		event.data = data;
+		write_pos.store((head + 1), std::memory_order_release);
+	    }
+
+	    // Fetches the oldest pending event, returning false if there isn't one
+	    bool pop(BeeNukedTraceEvent &event)
+	    {
+		size_t tail = read_pos.load(std::memory_order_relaxed);
+
+		if (tail == write_pos.load(std::memory_order_acquire))
+		{
+		    return false;
+		}
+
+		event = events[(tail & (capacity - 1))];
+		read_pos.store((tail + 1), std::memory_order_release);
+		return true;
+	    }
+
+	    // Number of events lost so far because the ring was full
+	    uint64_t get_dropped() const
+	    {
+		return dropped_events.load(std::memory_order_relaxed);
+	    }
+
+	private:
+	    static_assert(((capacity & (capacity - 1)) == 0), "Trace ring capacity must be a power of two");
+
+	    std::array<BeeNukedTraceEvent, capacity> events;
+
+	    // Kept on separate cache lines, so the core and the draining thread don't contend
+	    alignas(64) std::atomic<size_t> write_pos{0};
+	    alignas(64) std::atomic<size_t> read_pos{0};
+	    alignas(64) std::atomic<uint64_t> dropped_events{0};
+    };
+
+    // Expects the core to have a BeeNukedTraceRing member named trace_ring
+    #define BEENUKED_TRACE(type, reg, data) trace_ring.push((type), (reg), (data))
+
+#else
+
+    // Arguments are still "used" so that values computed only for tracing don't cause warnings,
+    // but they're never stored anywhere, so the compiler drops them entirely
+    #define BEENUKED_TRACE(type, reg, data) ((void)(type), (void)(reg), (void)(data))
+
+#endif
+};
+
+#endif // BEENUKED_TRACE_H
\ No newline at end of file
@@ -0,0 +1,164 @@
+/*
+    This file is part of the BeeNuked engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeNuked is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeNuked is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeNuked.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BEENUKED_YM3014
+#define BEENUKED_YM3014
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// YM3014 DAC emulation (derived from the ymfm engine)
+// (https://github.com/aaronsgiles/ymfm)
+//
+// Shared by every core that outputs through a YM3014 (currently the YM3526, YM2151 and YM2203)
+
+namespace beenuked
+{
+#if defined(__GNUC__)
+
+    inline uint8_t beenuked_clz(uint32_t value)
+    {
+	if (value == 0)
+	{
+	    return 32;
+	}
+
+	return __builtin_clz(value);
+    }
+
+#elif defined(_MSC_VER)
+
+    inline uint8_t beenuked_clz(uint32_t value)
+    {
+	unsigned long index;
+	return _BitScanReverse(&index, value) ? uint8_t(31U - index) : 32U;
+    }
+
+#else
+
+    inline uint8_t beenuked_clz(uint32_t value)
+    {
+	if (value == 0)
+	{
+	    return 32;
+	}
+
+	uint32_t temp_val = value;
+
+	uint8_t count;
+
+	for (count = 0; int32_t(temp_val) >= 0; count++)
+	{
+	    temp_val <<= 1;
+	}
+
+	return count;
+    }
+
+#endif
+
+    inline int16_t encode_fp(int32_t val)
+    {
+	if (val < -32768)
+	{
+	    return 0x1C00;
+	}
+
+	if (val > 32767)
+	{
+	    return 0x1FFF;
+	}
+
+	int32_t scanvalue = (val ^ (int32_t(val) >> 31));
+
+	int exponent = 7 - beenuked_clz(scanvalue << 17);
+
+	exponent = std::max(exponent, 1);
+
+	int32_t mantissa = (val >> (exponent - 1));
+
+	return (((exponent << 10) | (mantissa & 0x3FF)) ^ 0x200);
+    }
+
+    inline int16_t decode_fp(int16_t val)
+    {
+	val ^= 0x1E00;
+	return (int16_t(val << 6) >> ((val >> 10) & 0x7));
+    }
+
+    inline int16_t dac_ym3014(int32_t val)
+    {
+	if (val < -32768)
+	{
+	    return -32768;
+	}
+
+	if (val > 32767)
+	{
+	    return 32767;
+	}
+
+	int32_t scanvalue = (val ^ (int32_t(val) >> 31));
+
+	int exponent = 7 - beenuked_clz(scanvalue << 17);
+
+	exponent = std::max(exponent, 1);
+	exponent -= 1;
+
+	return ((val >> exponent) << exponent);
+    }
+
+    // Block version of dac_ym3014, applied in place.
+    //
+    // The number of mantissa bits dropped is simply the number of exponent thresholds
+    // (512, 1024, ..., 16384) that the sample's magnitude reaches, so this loop
+    // is just compares, adds and shifts, which the compiler can vectorize.
+    inline void dac_ym3014(int32_t *samples, size_t count)
+    {
+	for (size_t i = 0; i < count; i++)
+	{
+	    int32_t val = samples[i];
+	    int32_t clamped = std::min(std::max(val, -32768), 32767);
+	    int32_t scanvalue = (clamped ^ (clamped >> 31));
+
+	    int shift = (scanvalue >= 0x200) + (scanvalue >= 0x400) + (scanvalue >= 0x800);
+	    shift += (scanvalue >= 0x1000) + (scanvalue >= 0x2000) + (scanvalue >= 0x4000);
+
+	    int32_t quantized = ((clamped >> shift) << shift);
+
+	    // Positive overflow saturates to 32767, rather than to the nearest step
+	    samples[i] = (val > 32767) ? 32767 : quantized;
+	}
+    }
+
+    // Bypasses the DAC quantization entirely, only clamping samples to 16 bits
+    inline void dac_bypass(int32_t *samples, size_t count)
+    {
+	for (size_t i = 0; i < count; i++)
+	{
+	    samples[i] = std::min(std::max(samples[i], -32768), 32767);
+	}
+    }
+};
+
+#endif // BEENUKED_YM3014
\ No newline at end of file